@@ -0,0 +1,34 @@
+'use client'
+import useSWR from 'swr'
+import { apiFetcher } from '../../lib/api-utils'
+import type { TemperatureData } from './temperature'
+import type { WiFiStationInfo } from './wifi-station'
+
+// Resources polled by the web UI, fetched together from /api/v1/batch so a
+// refresh costs one request instead of one per resource
+export interface DashboardData {
+  temp?: TemperatureData
+  station?: WiFiStationInfo
+}
+
+// Every hook using this key shares one SWR cache entry, and with it one request per interval
+export const DASHBOARD_KEY = '/api/v1/batch?include=temp,station'
+
+export function useDashboardData(shouldFetch: boolean = true) {
+  const { data, error, isLoading, mutate } = useSWR(
+    shouldFetch ? DASHBOARD_KEY : null,
+    apiFetcher,
+    {
+      revalidateOnFocus: true,
+      revalidateOnReconnect: true,
+      refreshInterval: 1000, // Refresh every 1 second
+    }
+  )
+
+  return {
+    data: data as DashboardData | undefined,
+    error,
+    isLoading,
+    mutate,
+  }
+}
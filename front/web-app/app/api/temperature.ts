@@ -1,9 +1,13 @@
 'use client'
-import useSWR from 'swr'
-import { apiFetcher, apiPostFetcher } from '../../lib/api-utils'
+import { apiPatchFetcher, apiPostFetcher } from '../../lib/api-utils'
+import { useDashboardData } from './dashboard'
 
 // Types for temperature data
 export interface TemperatureData {
+  // Number of the sample on the device and its uptime when it was taken; both
+  // stay the same between polls until the next sample
+  seq?: number
+  time_ms?: number
   temp_0: number
   temp_1: number
   temp_2: number
@@ -12,6 +16,8 @@ export interface TemperatureData {
   temp_1_target: number
   temp_2_target: number
   temp_3_target: number
+  // Bit n set while probe n is unplugged or faulty, its temp_n is then 0
+  faults?: number
 }
 
 export interface TemperatureTargets {
@@ -21,20 +27,12 @@ export interface TemperatureTargets {
   temp_3: number
 }
 
-// Hook for fetching current temperature data
+// Hook for fetching current temperature data, served by the batched dashboard request
 export function useTemperatureData(shouldFetch: boolean = true) {
-  const { data, error, isLoading, mutate } = useSWR(
-    shouldFetch ? '/api/v1/temp/current' : null,
-    apiFetcher,
-    {
-      revalidateOnFocus: true,
-      revalidateOnReconnect: true,
-      refreshInterval: 1000, // Refresh every 1 second
-    }
-  )
+  const { data, error, isLoading, mutate } = useDashboardData(shouldFetch)
 
   return {
-    data: data as TemperatureData | undefined,
+    data: data?.temp,
     error,
     isLoading,
     mutate,
@@ -53,5 +51,16 @@ export function useSetTemperatureTargets() {
     }
   }
 
-  return { setTargets }
+  // Change the target of a single probe, leaving the others untouched
+  const setTarget = async (probe: number, target: number) => {
+    try {
+      const response = await apiPatchFetcher('/api/v1/temp/target', { [`temp_${probe}`]: target })
+      return response
+    } catch (error) {
+      console.error('Failed to set temperature target:', error)
+      throw error
+    }
+  }
+
+  return { setTargets, setTarget }
 }
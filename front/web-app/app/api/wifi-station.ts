@@ -1,6 +1,6 @@
 'use client'
-import useSWR from 'swr'
-import { apiFetcher, apiPostFetcher } from '../../lib/api-utils'
+import { apiPostFetcher } from '../../lib/api-utils'
+import { useDashboardData } from './dashboard'
 
 // Types for WiFi station data
 export interface WiFiStationInfo {
@@ -12,20 +12,12 @@ export interface WiFiCredentials {
   password: string
 }
 
-// Hook for fetching current WiFi station info
+// Hook for fetching current WiFi station info, served by the batched dashboard request
 export function useWiFiStationInfo(shouldFetch: boolean = true) {
-  const { data, error, isLoading, mutate } = useSWR(
-    shouldFetch ? '/api/v1/wifi/station' : null,
-    apiFetcher,
-    {
-      revalidateOnFocus: true,
-      revalidateOnReconnect: true,
-      refreshInterval: 5000, // Refresh every 5 seconds
-    }
-  )
+  const { data, error, isLoading, mutate } = useDashboardData(shouldFetch)
 
   return {
-    data: data as WiFiStationInfo | undefined,
+    data: data?.station,
     error,
     isLoading,
     mutate,
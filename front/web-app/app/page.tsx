@@ -1,6 +1,6 @@
 "use client"
 
-import { useState } from "react"
+import { useEffect, useState } from "react"
 import { Card, CardContent, CardHeader, CardTitle } from "../components/ui/card"
 import { Button } from "../components/ui/button"
 import { Input } from "../components/ui/input"
@@ -8,6 +8,7 @@ import { Label } from "../components/ui/label"
 import { Dialog, DialogContent, DialogHeader, DialogTitle, DialogFooter } from "../components/ui/dialog"
 import { Settings, Thermometer, Target } from "lucide-react"
 import Link from "next/link"
+import TemperatureChart from "../components/TemperatureChart"
 import { useTemperatureData, useSetTemperatureTargets } from "./api/temperature"
 
 interface ThermometerData {
@@ -19,11 +20,20 @@ interface ThermometerData {
 
 export default function Dashboard() {
   const { data: tempData, isLoading, error, mutate } = useTemperatureData()
-  const { setTargets } = useSetTemperatureTargets()
+  const { setTarget } = useSetTemperatureTargets()
   const [isTargetModalOpen, setIsTargetModalOpen] = useState(false)
   const [editingThermometer, setEditingThermometer] = useState<ThermometerData | null>(null)
   const [newTargetTemp, setNewTargetTemp] = useState("")
   const [isUpdating, setIsUpdating] = useState(false)
+  const [chartBenchPoints, setChartBenchPoints] = useState<number | undefined>(undefined)
+
+  // ?chartbench=<points> fills the chart with synthetic history and shows frame times
+  useEffect(() => {
+    const points = parseInt(new URLSearchParams(window.location.search).get("chartbench") || "")
+    if (points > 0) {
+      setChartBenchPoints(points)
+    }
+  }, [])
 
   // Convert API data to thermometer format
   const thermometers: ThermometerData[] = tempData ? [
@@ -65,16 +75,9 @@ export default function Dashboard() {
       if (!isNaN(temp) && temp >= 0 && temp <= 300) {
         setIsUpdating(true)
         try {
-          // Update the specific probe target
+          // Update only the specific probe target
           const probeIndex = parseInt(editingThermometer.id) - 1
-          const targets = {
-            temp_0: probeIndex === 0 ? temp : tempData?.temp_0_target || 0,
-            temp_1: probeIndex === 1 ? temp : tempData?.temp_1_target || 0,
-            temp_2: probeIndex === 2 ? temp : tempData?.temp_2_target || 0,
-            temp_3: probeIndex === 3 ? temp : tempData?.temp_3_target || 0,
-          }
-          
-          await setTargets(targets)
+          await setTarget(probeIndex, temp)
           await mutate() // Refresh data
           setIsTargetModalOpen(false)
           setEditingThermometer(null)
@@ -196,6 +199,20 @@ export default function Dashboard() {
           </div>
         )}
 
+        {/* Temperature History */}
+        {!error && (
+          <Card className="mb-8 border-0 bg-blue-200 dark:bg-blue-800/40">
+            <CardHeader>
+              <CardTitle className="text-lg sm:text-xl font-bold text-gray-900 dark:text-white">
+                History
+              </CardTitle>
+            </CardHeader>
+            <CardContent className="h-64 sm:h-80">
+              <TemperatureChart data={tempData} benchPoints={chartBenchPoints} />
+            </CardContent>
+          </Card>
+        )}
+
         {/* Settings Button */}
         <div className="flex justify-end">
           <Link href="/settings">
@@ -0,0 +1,237 @@
+"use client"
+
+import { useEffect, useRef } from "react"
+import { TemperatureData } from "../app/api/temperature"
+import { SampleRing } from "../lib/sample-ring"
+import { lttb } from "../lib/lttb"
+
+const PROBE_COUNT = 4
+// 10 hours at the default 1 s sampling period
+const HISTORY_SAMPLES = 36000
+const PROBE_COLORS = ["#ef4444", "#f59e0b", "#10b981", "#8b5cf6"]
+const PADDING = { left: 36, right: 8, top: 8, bottom: 20 }
+
+interface TemperatureChartProps {
+  data?: TemperatureData
+  className?: string
+  // Prefill every probe with this many synthetic samples and redraw on every
+  // frame, reporting frame times. Used to check slow devices.
+  benchPoints?: number
+}
+
+interface ChartState {
+  rings: SampleRing[]
+  lastSeq?: number
+  lastTime: number
+  targets: number[]
+  outX: Float64Array
+  outY: Float32Array
+  dirty: boolean
+  drawMs: number
+  frames: number[]
+}
+
+function formatDuration(ms: number) {
+  const minutes = Math.round(ms / 60000)
+  return minutes >= 60 ? `${Math.floor(minutes / 60)}h ${minutes % 60}m` : `${minutes}m`
+}
+
+function fillSynthetic(state: ChartState, points: number) {
+  const now = Date.now()
+  state.rings.forEach((ring, probe) => {
+    ring.clear()
+    for (let i = 0; i < points; i++) {
+      const t = i / points
+      const value = 20 + (60 + probe * 10) * (1 - Math.exp(-4 * t)) + 2 * Math.sin(i / 50) + Math.random()
+      ring.push(now - (points - i) * 1000, value)
+    }
+    state.targets[probe] = 80 + probe * 10
+  })
+}
+
+function draw(canvas: HTMLCanvasElement, state: ChartState, showStats: boolean) {
+  const ctx = canvas.getContext("2d")
+  if (!ctx) {
+    return
+  }
+  const dpr = window.devicePixelRatio || 1
+  const width = canvas.clientWidth
+  const height = canvas.clientHeight
+  if (canvas.width !== Math.round(width * dpr) || canvas.height !== Math.round(height * dpr)) {
+    canvas.width = Math.round(width * dpr)
+    canvas.height = Math.round(height * dpr)
+  }
+  ctx.setTransform(dpr, 0, 0, dpr, 0, 0)
+  ctx.clearRect(0, 0, width, height)
+
+  let t0 = Infinity
+  let t1 = -Infinity
+  let v0 = Infinity
+  let v1 = -Infinity
+  for (const ring of state.rings) {
+    const span = ring.span()
+    const range = ring.range()
+    if (!span || !range) continue
+    t0 = Math.min(t0, span[0])
+    t1 = Math.max(t1, span[1])
+    v0 = Math.min(v0, range[0])
+    v1 = Math.max(v1, range[1])
+  }
+  if (t0 === Infinity) {
+    return
+  }
+  for (const target of state.targets) {
+    if (target > 0) {
+      v0 = Math.min(v0, target)
+      v1 = Math.max(v1, target)
+    }
+  }
+  v0 = Math.floor(v0 - 2)
+  v1 = Math.ceil(v1 + 2)
+
+  const plotW = width - PADDING.left - PADDING.right
+  const plotH = height - PADDING.top - PADDING.bottom
+  const x = (t: number) => PADDING.left + (t1 > t0 ? ((t - t0) / (t1 - t0)) * plotW : plotW)
+  const y = (v: number) => PADDING.top + (1 - (v - v0) / (v1 - v0)) * plotH
+
+  ctx.font = "11px sans-serif"
+  ctx.fillStyle = "#6b7280"
+  ctx.textAlign = "right"
+  ctx.fillText(`${v1}°`, PADDING.left - 4, PADDING.top + 10)
+  ctx.fillText(`${v0}°`, PADDING.left - 4, PADDING.top + plotH)
+  ctx.textAlign = "left"
+  ctx.fillText(`-${formatDuration(t1 - t0)}`, PADDING.left, height - 6)
+  ctx.textAlign = "right"
+  ctx.fillText("now", width - PADDING.right, height - 6)
+
+  // One output point per horizontal pixel is all the screen can show
+  const threshold = Math.max(3, Math.min(Math.floor(plotW), state.outX.length))
+  state.rings.forEach((ring, probe) => {
+    if (ring.length === 0) return
+    const count = lttb(ring, threshold, state.outX, state.outY)
+    ctx.strokeStyle = PROBE_COLORS[probe]
+    ctx.lineWidth = 1.5
+    ctx.setLineDash([])
+    ctx.beginPath()
+    ctx.moveTo(x(state.outX[0]), y(state.outY[0]))
+    for (let i = 1; i < count; i++) {
+      ctx.lineTo(x(state.outX[i]), y(state.outY[i]))
+    }
+    ctx.stroke()
+
+    const target = state.targets[probe]
+    if (target > 0) {
+      ctx.lineWidth = 1
+      ctx.setLineDash([4, 4])
+      ctx.beginPath()
+      ctx.moveTo(PADDING.left, y(target))
+      ctx.lineTo(PADDING.left + plotW, y(target))
+      ctx.stroke()
+    }
+  })
+
+  if (showStats) {
+    const frames = state.frames
+    const sorted = [...frames].sort((a, b) => a - b)
+    const avg = frames.reduce((sum, f) => sum + f, 0) / Math.max(frames.length, 1)
+    const p95 = sorted[Math.floor(sorted.length * 0.95)] ?? 0
+    const points = state.rings.reduce((sum, ring) => sum + ring.length, 0)
+    ctx.textAlign = "left"
+    ctx.fillStyle = "#6b7280"
+    ctx.fillText(
+      `${points} pts, draw ${state.drawMs.toFixed(1)} ms, frame avg ${avg.toFixed(1)} / p95 ${p95.toFixed(1)} ms`,
+      PADDING.left + 4,
+      PADDING.top + 10,
+    )
+  }
+}
+
+export default function TemperatureChart({ data, className, benchPoints }: TemperatureChartProps) {
+  const canvasRef = useRef<HTMLCanvasElement>(null)
+  const stateRef = useRef<ChartState | null>(null)
+
+  if (stateRef.current === null) {
+    stateRef.current = {
+      rings: Array.from({ length: PROBE_COUNT }, () => new SampleRing(HISTORY_SAMPLES)),
+      targets: new Array(PROBE_COUNT).fill(0),
+      lastTime: -Infinity,
+      outX: new Float64Array(4096),
+      outY: new Float32Array(4096),
+      dirty: true,
+      drawMs: 0,
+      frames: [],
+    }
+  }
+
+  // Samples go straight into the rings; the canvas picks them up on the next
+  // animation frame without going through React state. Each device sample is
+  // plotted once at the time the device took it, however often it is polled.
+  useEffect(() => {
+    const state = stateRef.current
+    if (!data || !state || benchPoints) {
+      return
+    }
+    for (let probe = 0; probe < PROBE_COUNT; probe++) {
+      state.targets[probe] = data[`temp_${probe}_target` as keyof TemperatureData] as number
+    }
+    state.dirty = true
+    if (data.seq !== undefined && data.seq === state.lastSeq) {
+      return
+    }
+    const time = data.time_ms ?? Date.now()
+    if (time < state.lastTime) {
+      // The device restarted, its uptime starts over
+      state.rings.forEach((ring) => ring.clear())
+    }
+    state.lastSeq = data.seq
+    state.lastTime = time
+    for (let probe = 0; probe < PROBE_COUNT; probe++) {
+      // Skip readings of an unplugged probe rather than plotting a drop to 0
+      if (!((data.faults ?? 0) & (1 << probe))) {
+        state.rings[probe].push(time, data[`temp_${probe}` as keyof TemperatureData] as number)
+      }
+    }
+  }, [data, benchPoints])
+
+  useEffect(() => {
+    const canvas = canvasRef.current
+    const state = stateRef.current
+    if (!canvas || !state) {
+      return
+    }
+    if (benchPoints) {
+      fillSynthetic(state, Math.min(benchPoints, HISTORY_SAMPLES))
+    }
+
+    const observer = new ResizeObserver(() => {
+      state.dirty = true
+    })
+    observer.observe(canvas)
+
+    let frame = 0
+    let last = performance.now()
+    const loop = (now: number) => {
+      if (benchPoints) {
+        state.frames.push(now - last)
+        if (state.frames.length > 300) state.frames.shift()
+        state.dirty = true
+      }
+      last = now
+      if (state.dirty) {
+        state.dirty = false
+        const start = performance.now()
+        draw(canvas, state, !!benchPoints)
+        state.drawMs = performance.now() - start
+      }
+      frame = requestAnimationFrame(loop)
+    }
+    frame = requestAnimationFrame(loop)
+
+    return () => {
+      cancelAnimationFrame(frame)
+      observer.disconnect()
+    }
+  }, [benchPoints])
+
+  return <canvas ref={canvasRef} className={className} style={{ width: "100%", height: "100%" }} />
+}
@@ -67,6 +67,26 @@ export const apiPutFetcher = async (url: string, data: unknown, options: Request
   return response.json()
 }
 
+// Generic PATCH fetcher for partial updates
+export const apiPatchFetcher = async (url: string, data: unknown, options: RequestInit = {}) => {
+  const response = await fetch(url, {
+    method: 'PATCH',
+    headers: {
+      'Content-Type': 'application/json',
+      ...options.headers,
+    },
+    body: JSON.stringify(data),
+    signal: AbortSignal.timeout(10000), // 10 second timeout
+    ...options,
+  })
+
+  if (!response.ok) {
+    throw new Error(`HTTP error! status: ${response.status}`)
+  }
+
+  return response.json()
+}
+
 // Generic DELETE fetcher for API calls
 export const apiDeleteFetcher = async (url: string, options: RequestInit = {}) => {
   const response = await fetch(url, {
@@ -0,0 +1,75 @@
+import { SampleRing } from './sample-ring'
+
+// Largest-Triangle-Three-Buckets downsampling (Steinarsson, 2013).
+// Keeps the first and last sample and, from every bucket in between, the
+// sample forming the largest triangle with the previously kept sample and
+// the average of the next bucket. This preserves peaks and drops, which
+// plain striding or averaging flattens.
+//
+// Writes up to `threshold` points into outX/outY and returns how many were
+// written. The output arrays are owned by the caller so repeated calls do
+// not allocate.
+export function lttb(
+  ring: SampleRing,
+  threshold: number,
+  outX: Float64Array,
+  outY: Float32Array,
+): number {
+  const n = ring.length
+  if (threshold >= n || threshold < 3) {
+    const count = Math.min(n, outX.length)
+    for (let i = 0; i < count; i++) {
+      outX[i] = ring.timeAt(i)
+      outY[i] = ring.valueAt(i)
+    }
+    return count
+  }
+
+  const bucketSize = (n - 2) / (threshold - 2)
+  let kept = 0
+  let a = 0
+
+  outX[kept] = ring.timeAt(0)
+  outY[kept] = ring.valueAt(0)
+  kept++
+
+  for (let bucket = 0; bucket < threshold - 2; bucket++) {
+    // Average of the next bucket, the third triangle vertex
+    const nextStart = Math.floor((bucket + 1) * bucketSize) + 1
+    const nextEnd = Math.min(Math.floor((bucket + 2) * bucketSize) + 1, n)
+    let avgX = 0
+    let avgY = 0
+    for (let i = nextStart; i < nextEnd; i++) {
+      avgX += ring.timeAt(i)
+      avgY += ring.valueAt(i)
+    }
+    const nextCount = nextEnd - nextStart
+    avgX /= nextCount
+    avgY /= nextCount
+
+    // Pick the point of the current bucket with the largest triangle area
+    const start = Math.floor(bucket * bucketSize) + 1
+    const end = Math.floor((bucket + 1) * bucketSize) + 1
+    const ax = ring.timeAt(a)
+    const ay = ring.valueAt(a)
+    let maxArea = -1
+    let chosen = start
+    for (let i = start; i < end; i++) {
+      const area = Math.abs((ax - avgX) * (ring.valueAt(i) - ay) - (ax - ring.timeAt(i)) * (avgY - ay))
+      if (area > maxArea) {
+        maxArea = area
+        chosen = i
+      }
+    }
+
+    outX[kept] = ring.timeAt(chosen)
+    outY[kept] = ring.valueAt(chosen)
+    kept++
+    a = chosen
+  }
+
+  outX[kept] = ring.timeAt(n - 1)
+  outY[kept] = ring.valueAt(n - 1)
+  kept++
+  return kept
+}
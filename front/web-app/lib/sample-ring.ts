@@ -0,0 +1,71 @@
+// Fixed-capacity ring of (time, value) samples backed by typed arrays.
+// Pushing never allocates, so a 10-hour cook at 1 Hz stays a constant
+// ~430 KB per probe instead of a growing array of objects.
+
+export class SampleRing {
+  readonly capacity: number
+  private times: Float64Array
+  private values: Float32Array
+  private head = 0 // Index of the next write
+  private count = 0
+
+  constructor(capacity: number) {
+    this.capacity = capacity
+    this.times = new Float64Array(capacity)
+    this.values = new Float32Array(capacity)
+  }
+
+  get length() {
+    return this.count
+  }
+
+  push(time: number, value: number) {
+    this.times[this.head] = time
+    this.values[this.head] = value
+    this.head = (this.head + 1) % this.capacity
+    if (this.count < this.capacity) {
+      this.count++
+    }
+  }
+
+  clear() {
+    this.head = 0
+    this.count = 0
+  }
+
+  // Physical index of the i-th oldest sample
+  private index(i: number) {
+    return (this.head - this.count + i + this.capacity) % this.capacity
+  }
+
+  timeAt(i: number) {
+    return this.times[this.index(i)]
+  }
+
+  valueAt(i: number) {
+    return this.values[this.index(i)]
+  }
+
+  // Time of the oldest and newest sample, or undefined when empty
+  span(): [number, number] | undefined {
+    if (this.count === 0) {
+      return undefined
+    }
+    return [this.timeAt(0), this.timeAt(this.count - 1)]
+  }
+
+  // Smallest and largest value currently stored
+  range(): [number, number] | undefined {
+    if (this.count === 0) {
+      return undefined
+    }
+    let min = Infinity
+    let max = -Infinity
+    for (let i = 0; i < this.count; i++) {
+      const v = this.values[i]
+      if (v < min) min = v
+      if (v > max) max = v
+    }
+    return [min, max]
+  }
+}
@@ -0,0 +1,227 @@
+#include "bench.h"
+#include "buf_pool.h"
+#include "cJSON.h"
+#include "cbor.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "rest_server.h"
+#include "settings.h"
+#include "temperature.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BENCH_FS_DIR        "/www"
+#define BENCH_NVS_WRITE_MAX 32
+#define BENCH_CBOR_BUF      128
+
+static const char *TAG = "bench";
+
+typedef struct {
+    int arg;
+    void *buf;
+    char path[64];
+    uint32_t bytes;
+    int32_t targets[TEMPERATURE_PROBE_COUNT];
+    temperature_snapshot_t snapshot;
+} bench_ctx_t;
+
+typedef struct {
+    const char *name;
+    uint32_t iterations; /* Default */
+    uint32_t max_iterations;
+    esp_err_t (*setup)(bench_ctx_t *ctx);
+    esp_err_t (*run)(bench_ctx_t *ctx, uint32_t i);
+    void (*teardown)(bench_ctx_t *ctx);
+    int arg;
+} bench_case_t;
+
+/* Build and print the GET /api/v1/temp/current body the same way the handler does */
+static esp_err_t json_temp_run(bench_ctx_t *ctx, uint32_t i) {
+    cJSON *root = cJSON_CreateObject();
+    rest_add_temp_json(root, &ctx->snapshot);
+    char *response = cJSON_Print(root);
+    cJSON_Delete(root);
+    if (response == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctx->bytes = strlen(response);
+    cJSON_free(response);
+    return ESP_OK;
+}
+
+static esp_err_t cbor_temp_run(bench_ctx_t *ctx, uint32_t i) {
+    uint8_t buf[BENCH_CBOR_BUF];
+    CborEncoder root;
+    cbor_encoder_init(&root, buf, sizeof(buf), 0);
+    rest_encode_temp_cbor(&root, &ctx->snapshot);
+    if (cbor_encoder_get_extra_bytes_needed(&root) > 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctx->bytes = cbor_encoder_get_buffer_size(&root, buf);
+    return ESP_OK;
+}
+
+static esp_err_t snapshot_setup(bench_ctx_t *ctx) {
+    temperature_get_snapshot(&ctx->snapshot);
+    return ESP_OK;
+}
+
+static esp_err_t nvs_get_run(bench_ctx_t *ctx, uint32_t i) {
+    settings_get_temp_target(&ctx->targets[0], &ctx->targets[1], &ctx->targets[2], &ctx->targets[3]);
+    return ESP_OK;
+}
+
+static esp_err_t nvs_set_setup(bench_ctx_t *ctx) {
+    settings_get_temp_target(&ctx->targets[0], &ctx->targets[1], &ctx->targets[2], &ctx->targets[3]);
+    return ESP_OK;
+}
+
+/*
+ * Writes as many values as settings_set_temp_target() does, but to scratch keys, so a
+ * reset or power cut mid-run cannot leave the probes with altered targets. NVS skips
+ * writes of an unchanged value, so alternate the last bit to force a real write and commit.
+ */
+static esp_err_t nvs_set_run(bench_ctx_t *ctx, uint32_t i) {
+    int32_t flip = (i & 1) ? 0 : 1;
+    int32_t values[TEMPERATURE_PROBE_COUNT];
+    for (int p = 0; p < TEMPERATURE_PROBE_COUNT; p++) {
+        values[p] = ctx->targets[p] ^ flip;
+    }
+    settings_set_scratch(values, TEMPERATURE_PROBE_COUNT);
+    return ESP_OK;
+}
+
+static void nvs_set_teardown(bench_ctx_t *ctx) {
+    settings_erase_scratch(TEMPERATURE_PROBE_COUNT);
+}
+
+/* Pick the largest regular file at the top of the web root */
+static esp_err_t fs_read_setup(bench_ctx_t *ctx) {
+    DIR *dir = opendir(BENCH_FS_DIR);
+    if (dir == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    off_t largest = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[sizeof(ctx->path)];
+        struct stat st;
+        if (snprintf(path, sizeof(path), BENCH_FS_DIR "/%s", entry->d_name) >= sizeof(path)) {
+            continue;
+        }
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > largest) {
+            largest = st.st_size;
+            strlcpy(ctx->path, path, sizeof(ctx->path));
+        }
+    }
+    closedir(dir);
+    if (largest == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    ESP_LOGI(TAG, "Reading %s (%ld bytes)", ctx->path, largest);
+
+    ctx->buf = buf_pool_get(BUF_POOL_LARGE);
+    return ctx->buf ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t fs_read_run(bench_ctx_t *ctx, uint32_t i) {
+    int fd = open(ctx->path, O_RDONLY);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    size_t size = buf_pool_size(BUF_POOL_LARGE);
+    uint32_t total = 0;
+    ssize_t n;
+    while ((n = read(fd, ctx->buf, size)) > 0) {
+        total += n;
+    }
+    close(fd);
+    ctx->bytes = total;
+    return n < 0 ? ESP_FAIL : ESP_OK;
+}
+
+static void fs_read_teardown(bench_ctx_t *ctx) {
+    buf_pool_put(ctx->buf);
+}
+
+static esp_err_t probe_run(bench_ctx_t *ctx, uint32_t i) {
+    volatile int32_t value = temperature_get_value(ctx->arg);
+    (void)value;
+    return ESP_OK;
+}
+
+static const bench_case_t s_cases[] = {
+    {"json_temp", 1000, UINT32_MAX, snapshot_setup, json_temp_run, NULL, 0},
+    {"cbor_temp", 1000, UINT32_MAX, snapshot_setup, cbor_temp_run, NULL, 0},
+    {"nvs_get", 200, UINT32_MAX, NULL, nvs_get_run, NULL, 0},
+    {"nvs_set", 16, BENCH_NVS_WRITE_MAX, nvs_set_setup, nvs_set_run, nvs_set_teardown, 0},
+    {"fs_read", 10, UINT32_MAX, fs_read_setup, fs_read_run, fs_read_teardown, 0},
+    {"probe_0", 1000, UINT32_MAX, NULL, probe_run, NULL, 0},
+    {"probe_1", 1000, UINT32_MAX, NULL, probe_run, NULL, 1},
+    {"probe_2", 1000, UINT32_MAX, NULL, probe_run, NULL, 2},
+    {"probe_3", 1000, UINT32_MAX, NULL, probe_run, NULL, 3},
+};
+
+static void run_case(const bench_case_t *bench, uint32_t iterations, bench_result_t *result) {
+    bench_ctx_t ctx = {.arg = bench->arg};
+    memset(result, 0, sizeof(*result));
+    result->name = bench->name;
+    result->min_cycles = UINT32_MAX;
+
+    if (iterations == 0) {
+        iterations = bench->iterations;
+    }
+    if (iterations > bench->max_iterations) {
+        iterations = bench->max_iterations;
+    }
+    if (bench->setup != NULL && (result->err = bench->setup(&ctx)) != ESP_OK) {
+        result->min_cycles = 0;
+        return;
+    }
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        esp_err_t err = bench->run(&ctx, i);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        if (err != ESP_OK) {
+            result->err = err;
+            break;
+        }
+        result->iterations++;
+        result->total_cycles += cycles;
+        if (cycles < result->min_cycles) {
+            result->min_cycles = cycles;
+        }
+        if (cycles > result->max_cycles) {
+            result->max_cycles = cycles;
+        }
+    }
+    result->bytes = ctx.bytes;
+    if (result->iterations == 0) {
+        result->min_cycles = 0;
+    }
+
+    if (bench->teardown != NULL) {
+        bench->teardown(&ctx);
+    }
+}
+
+size_t bench_run(const char *filter, uint32_t iterations, bench_result_t *results, size_t max_results) {
+    size_t count = 0;
+    for (size_t i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]) && count < max_results; i++) {
+        if (filter != NULL && strncmp(s_cases[i].name, filter, strlen(filter)) != 0) {
+            continue;
+        }
+        run_case(&s_cases[i], iterations, &results[count++]);
+    }
+    return count;
+}
+
+uint32_t bench_cycles_per_us(void) {
+    return esp_rom_get_cpu_ticks_per_us();
+}
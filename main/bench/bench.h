@@ -0,0 +1,41 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_MAX_RESULTS 12
+
+/**
+ * @brief Timing of one benchmark, in CPU cycles per iteration
+ */
+typedef struct {
+    const char *name;
+    uint32_t iterations;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t bytes; /* Bytes processed per iteration, 0 unless the benchmark measures throughput */
+    esp_err_t err;  /* Set if setup or an iteration failed, the timings are then incomplete */
+} bench_result_t;
+
+/**
+ * @brief Run the built-in microbenchmarks of the firmware's hot paths
+ *
+ * Iterations are timed with the cycle counter of the calling core, so the
+ * caller must be pinned to a core. nvs_set writes to flash and is capped at a
+ * few dozen iterations whatever is requested; the previous targets are
+ * restored afterwards.
+ *
+ * @param filter Only run benchmarks whose name starts with this, NULL for all
+ * @param iterations Iterations per benchmark, 0 for each benchmark's default
+ * @param results Destination
+ * @param max_results Number of entries in results
+ * @return size_t Number of results written
+ */
+size_t bench_run(const char *filter, uint32_t iterations, bench_result_t *results, size_t max_results);
+
+/**
+ * @brief Cycle counter frequency, to convert results to time
+ */
+uint32_t bench_cycles_per_us(void);
@@ -0,0 +1,101 @@
+#include "buf_pool.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <sys/param.h>
+
+/*
+ * Each class is a static array of equally sized buffers plus a counting semaphore
+ * holding the number of free ones. Taking the semaphore reserves a buffer, which
+ * is then picked from the free bitmap under a spinlock, so a request can never be
+ * handed a buffer another request still uses.
+ */
+
+#define SMALL_COUNT CONFIG_METER_BUF_POOL_SMALL_COUNT
+#define SMALL_SIZE  CONFIG_METER_BUF_POOL_SMALL_SIZE
+#define LARGE_COUNT CONFIG_METER_BUF_POOL_LARGE_COUNT
+#define LARGE_SIZE  CONFIG_METER_BUF_POOL_LARGE_SIZE
+
+typedef struct {
+    uint8_t *storage;
+    uint32_t free_mask;
+    SemaphoreHandle_t available;
+    StaticSemaphore_t available_buf;
+    buf_pool_stats_t stats;
+} pool_class_t;
+
+static const char *TAG = "buf_pool";
+
+static uint8_t s_small[SMALL_COUNT][SMALL_SIZE] __attribute__((aligned(4)));
+static uint8_t s_large[LARGE_COUNT][LARGE_SIZE] __attribute__((aligned(4)));
+
+static pool_class_t s_classes[BUF_POOL_CLASS_COUNT] = {
+    [BUF_POOL_SMALL] = {.storage = &s_small[0][0], .stats = {.size = SMALL_SIZE, .count = SMALL_COUNT}},
+    [BUF_POOL_LARGE] = {.storage = &s_large[0][0], .stats = {.size = LARGE_SIZE, .count = LARGE_COUNT}},
+};
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void buf_pool_init(void) {
+    for (int i = 0; i < BUF_POOL_CLASS_COUNT; i++) {
+        pool_class_t *c = &s_classes[i];
+        c->free_mask = (1u << c->stats.count) - 1;
+        c->available = xSemaphoreCreateCountingStatic(c->stats.count, c->stats.count, &c->available_buf);
+    }
+    ESP_LOGI(TAG, "%d x %d and %d x %d byte request buffers", SMALL_COUNT, SMALL_SIZE, LARGE_COUNT, LARGE_SIZE);
+}
+
+void *buf_pool_get(buf_pool_class_t cls) {
+    pool_class_t *c = &s_classes[cls];
+
+    if (xSemaphoreTake(c->available, pdMS_TO_TICKS(CONFIG_METER_BUF_POOL_WAIT_MS)) != pdTRUE) {
+        portENTER_CRITICAL(&s_lock);
+        c->stats.timeouts++;
+        portEXIT_CRITICAL(&s_lock);
+        ESP_LOGW(TAG, "No %s buffer free after %d ms", cls == BUF_POOL_SMALL ? "small" : "large",
+                 CONFIG_METER_BUF_POOL_WAIT_MS);
+        return NULL;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    int index = __builtin_ctz(c->free_mask);
+    c->free_mask &= ~(1u << index);
+    c->stats.in_use++;
+    c->stats.high_water = MAX(c->stats.high_water, c->stats.in_use);
+    c->stats.checkouts++;
+    portEXIT_CRITICAL(&s_lock);
+
+    return c->storage + index * c->stats.size;
+}
+
+void buf_pool_put(void *buf) {
+    if (buf == NULL) {
+        return;
+    }
+    for (int i = 0; i < BUF_POOL_CLASS_COUNT; i++) {
+        pool_class_t *c = &s_classes[i];
+        uint8_t *p = buf;
+        if (p < c->storage || p >= c->storage + c->stats.count * c->stats.size) {
+            continue;
+        }
+        int index = (p - c->storage) / c->stats.size;
+
+        portENTER_CRITICAL(&s_lock);
+        c->free_mask |= 1u << index;
+        c->stats.in_use--;
+        portEXIT_CRITICAL(&s_lock);
+
+        xSemaphoreGive(c->available);
+        return;
+    }
+    ESP_LOGE(TAG, "%p is not a pool buffer", buf);
+}
+
+size_t buf_pool_size(buf_pool_class_t cls) {
+    return s_classes[cls].stats.size;
+}
+
+void buf_pool_get_stats(buf_pool_class_t cls, buf_pool_stats_t *stats) {
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_classes[cls].stats;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Size classes of request buffers
+ */
+typedef enum {
+    BUF_POOL_SMALL, /* Encoded responses and request bodies, CONFIG_METER_BUF_POOL_SMALL_SIZE bytes */
+    BUF_POOL_LARGE, /* File and upload chunks, CONFIG_METER_BUF_POOL_LARGE_SIZE bytes */
+    BUF_POOL_CLASS_COUNT,
+} buf_pool_class_t;
+
+/**
+ * @brief Occupancy of one size class
+ */
+typedef struct {
+    size_t size;
+    uint8_t count;
+    uint8_t in_use;
+    uint8_t high_water;
+    uint32_t checkouts;
+    uint32_t timeouts; /* Requests that gave up waiting for a free buffer */
+} buf_pool_stats_t;
+
+/**
+ * @brief Set up the statically allocated buffers. Must be called before the first buf_pool_get()
+ */
+void buf_pool_init(void);
+
+/**
+ * @brief Check out a buffer, waiting at most CONFIG_METER_BUF_POOL_WAIT_MS for one to be returned
+ *
+ * @param cls Size class
+ * @return void* The buffer, or NULL if the class stayed exhausted
+ */
+void *buf_pool_get(buf_pool_class_t cls);
+
+/**
+ * @brief Return a buffer obtained from buf_pool_get()
+ *
+ * @param buf Buffer, NULL is ignored
+ */
+void buf_pool_put(void *buf);
+
+/**
+ * @brief Size in bytes of every buffer of a class
+ */
+size_t buf_pool_size(buf_pool_class_t cls);
+
+/**
+ * @brief Copy the occupancy of a class
+ *
+ * @param cls Size class
+ * @param stats Destination of the copy
+ */
+void buf_pool_get_stats(buf_pool_class_t cls, buf_pool_stats_t *stats);
@@ -0,0 +1,295 @@
+#include "checkpoint.h"
+#include "sdkconfig.h"
+
+static const char *s_source_names[] = {
+    [CHECKPOINT_SOURCE_NONE] = "none",
+    [CHECKPOINT_SOURCE_RTC] = "rtc",
+    [CHECKPOINT_SOURCE_NVS] = "nvs",
+};
+
+const char *checkpoint_source_name(checkpoint_source_t source) {
+    return source < sizeof(s_source_names) / sizeof(s_source_names[0]) ? s_source_names[source] : "unknown";
+}
+
+#if CONFIG_METER_CHECKPOINT
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mem.h"
+#include "nvs.h"
+#include "session.h"
+#include <stddef.h>
+#include <string.h>
+#include <sys/param.h>
+
+/*
+ * Every sample is checkpointed into one of two slots in RTC memory, which keeps
+ * its contents through every reset but a power-on one. Slots are written in
+ * turn, so a reset while one is written leaves the other, one sample older,
+ * intact; the CRC tells which. RTC memory is lost with the power, so a task
+ * copies the newest slot to NVS, but only when the session, alarms or faults
+ * changed, or every CONFIG_METER_CHECKPOINT_NVS_S while readings move, and
+ * never more often than every CONFIG_METER_CHECKPOINT_NVS_MIN_S.
+ *
+ * Nothing keeps time while the power is off, so age is counted in boots: every
+ * boot takes the next number from NVS and stamps its checkpoints with it, and
+ * the first checkpoint of a boot always goes to NVS, so a copy carried on from
+ * an earlier boot is renewed as long as the device runs long enough.
+ */
+
+#define CHECKPOINT_MAGIC 0x32504b43 /* "CKP2" */
+#define NVS_NAMESPACE    "checkpoint"
+#define NVS_KEY          "state"
+#define NVS_KEY_BOOT     "boot"
+/* Kconfig cannot keep NVS_S above NVS_MIN_S, a shorter period falls back to the minimum */
+#define NVS_PERIOD_S     MAX(CONFIG_METER_CHECKPOINT_NVS_S, CONFIG_METER_CHECKPOINT_NVS_MIN_S)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t generation; /* Incremented with every checkpoint, the larger of two intact slots is newer */
+    uint32_t boot;       /* Boot that wrote it */
+    checkpoint_state_t state;
+    uint32_t crc; /* Of everything before it */
+} checkpoint_slot_t;
+
+static const char *TAG = "checkpoint";
+
+static RTC_NOINIT_ATTR checkpoint_slot_t s_rtc[2];
+
+static checkpoint_state_t s_restored;
+static bool s_have_restored;
+static uint32_t s_generation;
+
+/* Newest slot for the NVS task */
+static checkpoint_slot_t s_latest;
+static bool s_have_latest;
+static portMUX_TYPE s_latest_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t s_boot;
+
+/* Written by the sampler and the NVS task, read by the metrics handler */
+static checkpoint_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t slot_crc(const checkpoint_slot_t *slot) {
+    return esp_rom_crc32_le(0, (const uint8_t *)slot, offsetof(checkpoint_slot_t, crc));
+}
+
+static bool slot_valid(const checkpoint_slot_t *slot) {
+    return slot->magic == CHECKPOINT_MAGIC && slot->crc == slot_crc(slot);
+}
+
+/* The newer of two slots, either of which may be NULL or damaged */
+static const checkpoint_slot_t *newer(const checkpoint_slot_t *a, const checkpoint_slot_t *b) {
+    if (a == NULL || !slot_valid(a)) {
+        return b != NULL && slot_valid(b) ? b : NULL;
+    }
+    if (b == NULL || !slot_valid(b)) {
+        return a;
+    }
+    return (int32_t)(b->generation - a->generation) > 0 ? b : a;
+}
+
+/* Whether a slot differs from the one last written to NVS in a way a restore must not miss */
+static bool important_change(const checkpoint_slot_t *a, const checkpoint_slot_t *b) {
+    return a->boot != b->boot || a->state.session_id != b->state.session_id ||
+           a->state.alarm_mask != b->state.alarm_mask || a->state.fault_mask != b->state.fault_mask;
+}
+
+/* A slot written too many boots ago to describe the cook still going on, if any */
+static bool stale(const checkpoint_slot_t *slot) {
+    return slot != NULL && s_boot - slot->boot > CONFIG_METER_CHECKPOINT_MAX_BOOTS;
+}
+
+/* Take the next boot number, 0 if NVS cannot keep it, which makes every checkpoint look current */
+static uint32_t next_boot(nvs_handle_t handle) {
+    uint32_t boot = 0;
+    nvs_get_u32(handle, NVS_KEY_BOOT, &boot);
+    boot++;
+    if (nvs_set_u32(handle, NVS_KEY_BOOT, boot) != ESP_OK || nvs_commit(handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot count boots, not checking the age of checkpoints");
+        return 0;
+    }
+    return boot;
+}
+
+static void nvs_task(void *arg) {
+    const checkpoint_slot_t *restored = arg;
+    checkpoint_slot_t written = {0};
+    if (restored != NULL) {
+        written = *restored;
+    }
+    int64_t written_us = esp_timer_get_time();
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot open NVS namespace: %s", esp_err_to_name(err));
+        vTaskDelete(NULL);
+        return;
+    }
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_METER_CHECKPOINT_NVS_MIN_S * 1000));
+
+        checkpoint_slot_t slot;
+        portENTER_CRITICAL(&s_latest_lock);
+        bool have = s_have_latest;
+        slot = s_latest;
+        portEXIT_CRITICAL(&s_latest_lock);
+        if (!have) {
+            continue;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        bool periodic = now_us - written_us >= NVS_PERIOD_S * 1000000LL &&
+                        memcmp(slot.state.temp, written.state.temp, sizeof(slot.state.temp)) != 0;
+        if (!periodic && !important_change(&slot, &written)) {
+            continue;
+        }
+
+        err = nvs_set_blob(handle, NVS_KEY, &slot, sizeof(slot));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        uint32_t us = esp_timer_get_time() - now_us;
+        portENTER_CRITICAL(&s_stats_lock);
+        if (err != ESP_OK) {
+            s_stats.nvs_errors++;
+        } else {
+            s_stats.nvs_writes++;
+            s_stats.nvs_write_total_us += us;
+            s_stats.nvs_write_max_us = MAX(s_stats.nvs_write_max_us, us);
+        }
+        portEXIT_CRITICAL(&s_stats_lock);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Cannot write checkpoint to NVS: %s", esp_err_to_name(err));
+        }
+        /* Also after a failure, so a full or worn NVS is not hammered every few seconds */
+        written = slot;
+        written_us = now_us;
+    }
+}
+
+void checkpoint_init(void) {
+    static checkpoint_slot_t s_nvs;
+    int64_t start_us = esp_timer_get_time();
+
+    /* After a power-on reset RTC memory holds noise, which the CRC would almost certainly reject anyway */
+    const checkpoint_slot_t *slot = NULL;
+    if (esp_reset_reason() != ESP_RST_POWERON) {
+        slot = newer(&s_rtc[0], &s_rtc[1]);
+    }
+    checkpoint_source_t source = slot != NULL ? CHECKPOINT_SOURCE_RTC : CHECKPOINT_SOURCE_NONE;
+
+    const checkpoint_slot_t *nvs = NULL;
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        size_t size = sizeof(s_nvs);
+        if (nvs_get_blob(handle, NVS_KEY, &s_nvs, &size) == ESP_OK && size == sizeof(s_nvs) && slot_valid(&s_nvs)) {
+            nvs = &s_nvs;
+        }
+        s_boot = next_boot(handle);
+        nvs_close(handle);
+    }
+    if (slot == NULL && nvs != NULL) {
+        slot = nvs;
+        source = CHECKPOINT_SOURCE_NVS;
+    }
+    s_stats.boot = s_boot;
+    if (s_boot != 0 && stale(slot)) {
+        s_stats.stale_boots = s_boot - slot->boot;
+        ESP_LOGW(TAG, "Discarding the cook state in %s, written %lu boots ago", checkpoint_source_name(source),
+                 s_stats.stale_boots);
+        slot = NULL;
+        source = CHECKPOINT_SOURCE_NONE;
+    }
+
+    if (slot != NULL) {
+        s_restored = slot->state;
+        s_have_restored = true;
+        s_generation = slot->generation;
+    }
+    s_stats.source = source;
+    s_stats.restore_us = esp_timer_get_time() - start_us;
+    s_stats.restored_at_us = esp_timer_get_time();
+
+    if (slot != NULL) {
+        ESP_LOGI(TAG, "Restored from %s in %lu us, %lu ms after boot: session %lu, alarms 0x%x, sample %lu",
+                 checkpoint_source_name(source), s_stats.restore_us, s_stats.restored_at_us / 1000,
+                 s_restored.session_id, s_restored.alarm_mask, s_restored.seq);
+    } else {
+        ESP_LOGI(TAG, "No cook state to restore");
+    }
+    MEM_TASK_CREATE(nvs_task, "checkpoint", 3072, (void *)nvs, 1, CONFIG_METER_NETWORK_CORE);
+}
+
+const checkpoint_state_t *checkpoint_restored(void) {
+    return s_have_restored ? &s_restored : NULL;
+}
+
+void checkpoint_save(const temperature_snapshot_t *snapshot, const sched_t *sched) {
+    int64_t start_us = esp_timer_get_time();
+
+    /* Fill the slot not holding the newest checkpoint */
+    checkpoint_slot_t *slot = &s_rtc[++s_generation & 1];
+    slot->magic = CHECKPOINT_MAGIC;
+    slot->generation = s_generation;
+    slot->boot = s_boot;
+    checkpoint_state_t *state = &slot->state;
+    memset(state, 0, sizeof(*state));
+    state->seq = snapshot->seq;
+    state->period_ms = sched->period_ms;
+    state->alarm_mask = snapshot->alarm_mask;
+    state->fault_mask = snapshot->fault_mask;
+    state->reason = sched->reason;
+    if (!session_get_active(snapshot->timestamp_us, &state->session_id, &state->session_ms)) {
+        state->session_id = 0;
+        state->session_ms = 0;
+    }
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        state->temp[i] = snapshot->temp[i];
+        state->slope[i] = sched->slope[i];
+    }
+    slot->crc = slot_crc(slot);
+
+    portENTER_CRITICAL(&s_latest_lock);
+    s_latest = *slot;
+    s_have_latest = true;
+    portEXIT_CRITICAL(&s_latest_lock);
+
+    uint32_t us = esp_timer_get_time() - start_us;
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.saves++;
+    s_stats.save_total_us += us;
+    s_stats.save_max_us = MAX(s_stats.save_max_us, us);
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+void checkpoint_get_stats(checkpoint_stats_t *stats) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+#else
+
+void checkpoint_init(void) {
+}
+
+const checkpoint_state_t *checkpoint_restored(void) {
+    return NULL;
+}
+
+void checkpoint_save(const temperature_snapshot_t *snapshot, const sched_t *sched) {
+}
+
+void checkpoint_get_stats(checkpoint_stats_t *stats) {
+    *stats = (checkpoint_stats_t){0};
+}
+
+#endif
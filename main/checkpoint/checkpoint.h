@@ -0,0 +1,76 @@
+#pragma once
+
+#include "sched.h"
+#include "temperature.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Cook state that survives a reset
+ */
+typedef struct {
+    uint32_t seq;        /* Of the snapshot it was taken from */
+    uint32_t session_id; /* Session being recorded, 0 for none */
+    uint32_t session_ms; /* Length of that session at the snapshot */
+    uint32_t period_ms;  /* Sampling period the scheduler had picked */
+    float slope[TEMPERATURE_PROBE_COUNT]; /* The scheduler's rate of change estimate, C per minute */
+    int16_t temp[TEMPERATURE_PROBE_COUNT];
+    uint8_t alarm_mask;
+    uint8_t fault_mask;
+    uint8_t reason; /* sched_reason_t */
+} checkpoint_state_t;
+
+typedef enum {
+    CHECKPOINT_SOURCE_NONE,
+    CHECKPOINT_SOURCE_RTC,
+    CHECKPOINT_SOURCE_NVS,
+} checkpoint_source_t;
+
+typedef struct {
+    checkpoint_source_t source; /* Where the state restored at boot came from */
+    uint32_t boot;              /* Number of this boot, counted in NVS */
+    uint32_t stale_boots;       /* Age in boots of a copy discarded as stale, 0 if none was */
+    uint32_t restore_us;        /* Time checkpoint_init() took to find and check it */
+    uint32_t restored_at_us;    /* Time since boot when it was available */
+    uint32_t saves;             /* Checkpoints written to RTC memory */
+    uint32_t save_max_us;
+    uint64_t save_total_us;
+    uint32_t nvs_writes;
+    uint32_t nvs_errors;
+    uint32_t nvs_write_max_us;
+    uint64_t nvs_write_total_us;
+} checkpoint_stats_t;
+
+/**
+ * @brief Restore the state the last boot left behind and start copying checkpoints to NVS
+ *
+ * The newest intact record in RTC memory wins. After a power-on reset, or if
+ * neither RTC record is intact, the copy in NVS is used. Either is discarded if
+ * it was written more than CONFIG_METER_CHECKPOINT_MAX_BOOTS boots ago. Call
+ * right after settings_nvs_init() and before session_init() and
+ * temperature_sampler_start(), which pick the state up through
+ * checkpoint_restored().
+ */
+void checkpoint_init(void);
+
+/**
+ * @brief State restored by checkpoint_init()
+ *
+ * @return const checkpoint_state_t* NULL if there was none or CONFIG_METER_CHECKPOINT is off
+ */
+const checkpoint_state_t *checkpoint_restored(void);
+
+/**
+ * @brief Record the state after a sample. Called from the sampler task, does not block
+ *
+ * @param snapshot Latest snapshot
+ * @param sched Schedule after it was updated with the snapshot
+ */
+void checkpoint_save(const temperature_snapshot_t *snapshot, const sched_t *sched);
+
+void checkpoint_get_stats(checkpoint_stats_t *stats);
+
+/**
+ * @brief Name of a source for logs and metrics
+ */
+const char *checkpoint_source_name(checkpoint_source_t source);
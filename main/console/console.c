@@ -1,8 +1,18 @@
 #include "esp_console.h"
+#include "esp_app_desc.h"
+#include "esp_chip_info.h"
 #include "esp_log.h"
 #include "settings.h"
+#include "bench.h"
 #include "esp_heap_caps.h"
 #include "wifi_scan.h"
+#include "display.h"
+#include "log_ring.h"
+#include "mem.h"
+#include "temperature.h"
+#include "probe.h"
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char *TAG = "console";
@@ -48,12 +58,8 @@ void task_info_builder(char *pcWriteBuffer) {
      * function is executing. */
     uxArraySize = uxTaskGetNumberOfTasks();
 
-    /* Allocate an array index for each task.  NOTE!  if
-     * configSUPPORT_DYNAMIC_ALLOCATION is set to 0 then pvPortMalloc() will
-     * equate to NULL. */
-    pxTaskStatusArray = pvPortMalloc(uxArraySize * sizeof(TaskStatus_t)); /*lint !e9079 All values returned by pvPortMalloc() have at least the
-                                                                             alignment required by the MCU's stack and this allocation allocates a
-                                                                             struct that has the alignment requirements of a pointer. */
+    /* Allocate an array index for each task. */
+    pxTaskStatusArray = mem_tag_malloc(MEM_TAG_CONSOLE, uxArraySize * sizeof(TaskStatus_t));
 
     /* Generate the (binary) data. */
     uxArraySize = uxTaskGetSystemState(pxTaskStatusArray, uxArraySize, &ulTotalTime);
@@ -135,9 +141,8 @@ void task_info_builder(char *pcWriteBuffer) {
             pcWriteBuffer += strlen(pcWriteBuffer);
         }
 
-        /* Free the array again.  NOTE!  If configSUPPORT_DYNAMIC_ALLOCATION
-         * is 0 then vPortFree() will be #defined to nothing. */
-        vPortFree(pxTaskStatusArray);
+        /* Free the array again. */
+        mem_tag_free(MEM_TAG_CONSOLE, pxTaskStatusArray);
     }
 }
 
@@ -146,7 +151,7 @@ static int tasks_info(int argc, char **argv) {
     (void)argv;
 
     const size_t bytes_per_task = 128; /* see vTaskList description */
-    char *task_list_buffer = malloc(uxTaskGetNumberOfTasks() * bytes_per_task);
+    char *task_list_buffer = mem_tag_malloc(MEM_TAG_CONSOLE, uxTaskGetNumberOfTasks() * bytes_per_task);
     if (task_list_buffer == NULL) {
         printf("failed to allocate buffer for vTaskList output\n");
         return 1;
@@ -154,7 +159,7 @@ static int tasks_info(int argc, char **argv) {
     fputs("Name                            State\tPrio\tCPU#\tStack\tAffinity\t%Time\n", stdout);
     task_info_builder(task_list_buffer);
     fputs(task_list_buffer, stdout);
-    free(task_list_buffer);
+    mem_tag_free(MEM_TAG_CONSOLE, task_list_buffer);
     return 0;
 }
 
@@ -221,13 +226,62 @@ static void register_free(void) {
     ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
 }
 
+static int heap_cmd_func(int argc, char **argv) {
+    mem_stats_t mem;
+    mem_get_stats(&mem);
+    printf("Internal free:  %u bytes\n"
+           "Largest block:  %u bytes\n"
+           "Low water:      %u bytes\n"
+           "Fragmentation:  %u%%\n",
+           mem.internal_free,
+           mem.internal_largest,
+           mem.internal_min_free,
+           mem.internal_free ? 100 - mem.internal_largest * 100 / mem.internal_free : 0);
+    printf("Tag          Live     Peak   Allocs    Frees  Failed\n");
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        mem_tag_stats_t tag;
+        mem_get_tag_stats(i, &tag);
+        printf("%-10s %6u   %6u %8lu %8lu  %6lu\n", mem_tag_name(i), tag.live_bytes, tag.peak_bytes, tag.allocs,
+               tag.frees, tag.failures);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "history") == 0) {
+        printf("Uptime s      Free  Largest  Low water\n");
+        uint32_t seq;
+        uint32_t head = mem_heap_history(&seq);
+        for (; seq != head; seq++) {
+            mem_heap_sample_t sample;
+            if (mem_heap_sample(seq, &sample)) {
+                printf("%8lu  %8lu %8lu   %8lu\n", sample.uptime_s, sample.free, sample.largest, sample.min_free);
+            }
+        }
+    }
+    return 0;
+}
+
+static void register_heap(void) {
+    const esp_console_cmd_t cmd = {
+        .command = "heap",
+        .help = "Show heap use per owner and fragmentation, with the samples taken every "
+                "CONFIG_METER_HEAP_SAMPLE_S seconds",
+        .hint = "[history]",
+        .func = &heap_cmd_func,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+}
+
 
 static int wifi_scan_cmd_func(int argc, char **argv) {
-    wifi_ap_record_t ap_info[10];
+    wifi_ap_record_t *ap_info = mem_tag_calloc(MEM_TAG_WIFI_SCAN, 10, sizeof(wifi_ap_record_t));
+    if (ap_info == NULL) {
+        printf("No memory for scan results\n");
+        return 1;
+    }
     int ap_count = wifi_scan(ap_info, 10);
     for (int i = 0; i < ap_count; i++) {
         ESP_LOGI(TAG, "SSID: %s, RSSI: %d", ap_info[i].ssid, ap_info[i].rssi);
     }
+    mem_tag_free(MEM_TAG_WIFI_SCAN, ap_info);
     return ESP_OK;
 }
 
@@ -268,16 +322,259 @@ static void register_wifi_commands(void) {
     ESP_ERROR_CHECK(esp_console_cmd_register(&wifi_set_credentials_cmd));
 }
 
+static int display_stats_cmd_func(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    display_stats_t stats;
+    display_get_stats(&stats);
+    printf("Updates:        %lu\n"
+           "Last area:      %lu px\n"
+           "Last render:    %lu ms\n"
+           "Last flush:     %lu us\n"
+           "Max flush:      %lu us\n"
+           "Total area:     %llu px\n",
+           stats.updates,
+           stats.last_area_px,
+           stats.last_render_ms,
+           stats.last_flush_us,
+           stats.max_flush_us,
+           stats.total_area_px);
+    return 0;
+}
+
+static void register_display(void) {
+    const esp_console_cmd_t cmd = {
+        .command = "display",
+        .help = "Get display refresh statistics",
+        .hint = NULL,
+        .func = &display_stats_cmd_func,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+}
+
+static int log_level_cmd_func(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: log_level <tag|*> <none|error|warn|info|debug|verbose>\n");
+        return 1;
+    }
+    if (log_ring_set_level(argv[1], argv[2]) != ESP_OK) {
+        printf("Unknown level: %s\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
+
+static int logs_cmd_func(int argc, char **argv) {
+    char line[256];
+    uint32_t head = log_ring_head();
+    for (uint32_t seq = log_ring_tail(); seq != head; seq++) {
+        if (log_ring_format(seq, line, sizeof(line)) >= 0) {
+            fputs(line, stdout);
+        }
+    }
+    return 0;
+}
+
+static void register_log_commands(void) {
+    const esp_console_cmd_t log_level_cmd = {
+        .command = "log_level",
+        .help = "Set the log level of a tag, '*' for all tags",
+        .hint = "<tag|*> <none|error|warn|info|debug|verbose>",
+        .func = &log_level_cmd_func,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&log_level_cmd));
+
+    const esp_console_cmd_t logs_cmd = {
+        .command = "logs",
+        .help = "Print the log entries kept in RAM",
+        .hint = NULL,
+        .func = &logs_cmd_func,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&logs_cmd));
+}
+
+static int jitter_cmd_func(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        temperature_reset_jitter();
+        printf("Jitter histogram cleared\n");
+        return 0;
+    }
+
+    temperature_jitter_t jitter;
+    temperature_get_jitter(&jitter);
+    printf("Period:         %lu us\n"
+           "Samples:        %lu\n"
+           "Missed:         %lu\n"
+           "Dropped:        %lu\n"
+           "Max late:       %lu us\n"
+           "Mean late:      %llu us\n"
+           "Max work:       %lu us\n",
+           jitter.period_us,
+           jitter.samples,
+           jitter.missed,
+           jitter.dropped,
+           jitter.max_late_us,
+           jitter.samples ? jitter.total_late_us / jitter.samples : 0,
+           jitter.max_work_us);
+    for (int i = 0; i < TEMPERATURE_JITTER_BUCKETS; i++) {
+        if (jitter.bucket_le_us[i] == UINT32_MAX) {
+            printf("  > %6lu us  %lu\n", jitter.bucket_le_us[i - 1], jitter.buckets[i]);
+        } else {
+            printf("  <= %5lu us  %lu\n", jitter.bucket_le_us[i], jitter.buckets[i]);
+        }
+    }
+    return 0;
+}
+
+static void register_jitter(void) {
+    const esp_console_cmd_t cmd = {
+        .command = "jitter",
+        .help = "Show how late samples were taken compared to their schedule",
+        .hint = "[reset]",
+        .func = &jitter_cmd_func,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+}
+
+static void print_bench_json(const bench_result_t *results, size_t count) {
+    esp_chip_info_t chip_info;
+    esp_chip_info(&chip_info);
+    const esp_app_desc_t *app = esp_app_get_description();
+    printf("{\"app\":\"%s\",\"idf\":\"%s\",\"chip_revision\":%u,\"cycles_per_us\":%lu,\"results\":[",
+           app->version, app->idf_ver, chip_info.revision, bench_cycles_per_us());
+    for (size_t i = 0; i < count; i++) {
+        const bench_result_t *r = &results[i];
+        printf("%s{\"name\":\"%s\",\"iterations\":%lu,\"min_cycles\":%lu,\"avg_cycles\":%llu,"
+               "\"max_cycles\":%lu,\"bytes\":%lu,",
+               i ? "," : "", r->name, r->iterations, r->min_cycles,
+               r->iterations ? r->total_cycles / r->iterations : 0, r->max_cycles, r->bytes);
+        if (r->err != ESP_OK) {
+            printf("\"error\":\"%s\"}", esp_err_to_name(r->err));
+        } else {
+            printf("\"error\":null}");
+        }
+    }
+    printf("]}\n");
+}
+
+static void print_bench_table(const bench_result_t *results, size_t count) {
+    uint32_t per_us = bench_cycles_per_us();
+    printf("Name         Iter    Min cyc    Avg cyc    Max cyc     Avg us       KB/s\n");
+    for (size_t i = 0; i < count; i++) {
+        const bench_result_t *r = &results[i];
+        if (r->iterations == 0) {
+            printf("%-10s failed: %s\n", r->name, esp_err_to_name(r->err));
+            continue;
+        }
+        uint64_t avg = r->total_cycles / r->iterations;
+        printf("%-10s %6lu %10lu %10llu %10lu %10llu", r->name, r->iterations, r->min_cycles, avg, r->max_cycles,
+               avg / per_us);
+        if (r->bytes > 0 && avg > 0) {
+            printf(" %10llu", (uint64_t)r->bytes * per_us * 1000000 / avg / 1024);
+        }
+        if (r->err != ESP_OK) {
+            printf("  stopped: %s", esp_err_to_name(r->err));
+        }
+        printf("\n");
+    }
+}
+
+static int bench_cmd_func(int argc, char **argv) {
+    bool json = false;
+    uint32_t iterations = 0;
+    const char *filter = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && filter == NULL) {
+            filter = argv[i];
+        } else {
+            printf("Usage: bench [-j] [-n iterations] [name prefix]\n");
+            return 1;
+        }
+    }
+
+    bench_result_t results[BENCH_MAX_RESULTS];
+    size_t count = bench_run(filter, iterations, results, BENCH_MAX_RESULTS);
+    if (count == 0) {
+        printf("No benchmark matches '%s'\n", filter);
+        return 1;
+    }
+    if (json) {
+        print_bench_json(results, count);
+    } else {
+        print_bench_table(results, count);
+    }
+    return 0;
+}
+
+static void register_bench(void) {
+    const esp_console_cmd_t cmd = {
+        .command = "bench",
+        .help = "Time JSON/CBOR encoding, NVS, LittleFS reads and probe reads in CPU cycles. "
+                "nvs_set writes scratch keys to flash",
+        .hint = "[-j] [-n iterations] [json|cbor|nvs|fs|probe]",
+        .func = &bench_cmd_func,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+}
+
+static int probe_cmd_func(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "driver") == 0) {
+        esp_err_t err = probe_select(argv[2]);
+        if (err != ESP_OK) {
+            printf("Cannot switch to %s: %s\n", argv[2], esp_err_to_name(err));
+            return 1;
+        }
+    } else if (argc == 3 && strcmp(argv[1], "scale") == 0) {
+        if (probe_set_time_scale(strtoul(argv[2], NULL, 10)) != ESP_OK) {
+            printf("Scale must be 1-1000\n");
+            return 1;
+        }
+    } else if (argc != 1) {
+        printf("Usage: probe [driver <adc|replay|sim>] [scale <1-1000>]\n");
+        return 1;
+    }
+
+    probe_reading_t readings[TEMPERATURE_PROBE_COUNT];
+    probe_read(readings);
+    printf("Driver: %s, time scale %lux\n", probe_driver_name(), probe_get_time_scale());
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        printf("  Probe %d: %4ld C  %s\n", i + 1, readings[i].temp, probe_fault_name(readings[i].fault));
+    }
+    return 0;
+}
+
+static void register_probe(void) {
+    const esp_console_cmd_t cmd = {
+        .command = "probe",
+        .help = "Show probe readings, switch the probe driver or the simulation time scale",
+        .hint = "[driver <adc|replay|sim>] [scale <1-1000>]",
+        .func = &probe_cmd_func,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
+}
+
 static void register_commands(void) {
     register_wifi_commands();
     register_reboot();
     register_free();
+    register_heap();
     register_tasks();
+    register_display();
+    register_log_commands();
+    register_jitter();
+    register_bench();
+    register_probe();
 }
 
 void console_init(void) {
     esp_console_repl_t *repl = NULL;
     esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.task_core_id = CONFIG_METER_NETWORK_CORE;
     
     register_commands();
 
@@ -0,0 +1,313 @@
+#include "display.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lvgl.h"
+#include "mem.h"
+#include "sdkconfig.h"
+#include "temperature.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CONFIG_METER_DISPLAY_PANEL_ST7789
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_vendor.h"
+#endif
+
+static const char *TAG = "display";
+
+#ifdef CONFIG_METER_DISPLAY_ENABLE
+
+#define DISPLAY_W         CONFIG_METER_DISPLAY_WIDTH
+#define DISPLAY_H         CONFIG_METER_DISPLAY_HEIGHT
+#define DISPLAY_BUF_PX    (DISPLAY_W * CONFIG_METER_DISPLAY_BUF_LINES)
+#define DISPLAY_MAX_SLEEP 50
+#define LCD_HOST          SPI2_HOST
+#define LCD_PIXEL_CLOCK   (40 * 1000 * 1000)
+
+#if CONFIG_LV_FONT_MONTSERRAT_28
+#define VALUE_FONT (&lv_font_montserrat_28)
+#else
+#define VALUE_FONT LV_FONT_DEFAULT
+#endif
+
+static lv_disp_draw_buf_t s_draw_buf;
+static lv_disp_drv_t s_disp_drv;
+
+static display_stats_t s_stats;
+/* Also guards the flush timing, which the SPI transfer-done ISR updates */
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_flush_start_us;
+static uint32_t s_flush_us_acc;
+
+static lv_obj_t *s_temp_labels[TEMPERATURE_PROBE_COUNT];
+static lv_obj_t *s_target_labels[TEMPERATURE_PROBE_COUNT];
+static int32_t s_shown_temp[TEMPERATURE_PROBE_COUNT];
+static int32_t s_shown_target[TEMPERATURE_PROBE_COUNT];
+
+static void flush_start(void) {
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_stats_lock);
+    s_flush_start_us = now_us;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/* Account for one finished flush; may run from the SPI transfer-done ISR */
+static void flush_done(void) {
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL_SAFE(&s_stats_lock);
+    s_flush_us_acc += (uint32_t)(now_us - s_flush_start_us);
+    portEXIT_CRITICAL_SAFE(&s_stats_lock);
+    lv_disp_flush_ready(&s_disp_drv);
+}
+
+#ifdef CONFIG_METER_DISPLAY_PANEL_ST7789
+
+static esp_lcd_panel_handle_t s_panel;
+
+static bool on_color_trans_done(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata,
+                                void *user_ctx) {
+    flush_done();
+    return false;
+}
+
+static void flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_map) {
+    flush_start();
+    /* Queued as a DMA transfer; LVGL renders into the other buffer meanwhile */
+    esp_lcd_panel_draw_bitmap(s_panel, area->x1, area->y1, area->x2 + 1, area->y2 + 1, color_map);
+}
+
+static void panel_init(void) {
+    spi_bus_config_t buscfg = {
+        .sclk_io_num = CONFIG_METER_DISPLAY_PIN_SCLK,
+        .mosi_io_num = CONFIG_METER_DISPLAY_PIN_MOSI,
+        .miso_io_num = -1,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = DISPLAY_BUF_PX * sizeof(lv_color_t),
+    };
+    ESP_ERROR_CHECK(spi_bus_initialize(LCD_HOST, &buscfg, SPI_DMA_CH_AUTO));
+
+    esp_lcd_panel_io_handle_t io_handle = NULL;
+    esp_lcd_panel_io_spi_config_t io_config = {
+        .dc_gpio_num = CONFIG_METER_DISPLAY_PIN_DC,
+        .cs_gpio_num = CONFIG_METER_DISPLAY_PIN_CS,
+        .pclk_hz = LCD_PIXEL_CLOCK,
+        .lcd_cmd_bits = 8,
+        .lcd_param_bits = 8,
+        .spi_mode = 0,
+        .trans_queue_depth = 10,
+        .on_color_trans_done = on_color_trans_done,
+    };
+    ESP_ERROR_CHECK(esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)LCD_HOST, &io_config, &io_handle));
+
+    esp_lcd_panel_dev_config_t panel_config = {
+        .reset_gpio_num = CONFIG_METER_DISPLAY_PIN_RST,
+        .rgb_ele_order = LCD_RGB_ELEMENT_ORDER_RGB,
+        .bits_per_pixel = 16,
+    };
+    ESP_ERROR_CHECK(esp_lcd_new_panel_st7789(io_handle, &panel_config, &s_panel));
+    ESP_ERROR_CHECK(esp_lcd_panel_reset(s_panel));
+    ESP_ERROR_CHECK(esp_lcd_panel_init(s_panel));
+    ESP_ERROR_CHECK(esp_lcd_panel_invert_color(s_panel, true));
+    ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(s_panel, true));
+
+    if (CONFIG_METER_DISPLAY_PIN_BL >= 0) {
+        gpio_config_t bl_config = {
+            .mode = GPIO_MODE_OUTPUT,
+            .pin_bit_mask = 1ULL << CONFIG_METER_DISPLAY_PIN_BL,
+        };
+        ESP_ERROR_CHECK(gpio_config(&bl_config));
+        gpio_set_level(CONFIG_METER_DISPLAY_PIN_BL, 1);
+    }
+}
+
+const uint16_t *display_get_framebuffer(void) {
+    return NULL;
+}
+
+#else /* CONFIG_METER_DISPLAY_PANEL_FRAMEBUFFER */
+
+static uint16_t *s_framebuffer;
+
+static void flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_map) {
+    flush_start();
+    int32_t width = lv_area_get_width(area);
+    for (int32_t y = area->y1; y <= area->y2; y++) {
+#if LV_COLOR_16_SWAP
+        /* LVGL renders in the SPI panel's byte order, the framebuffer is plain RGB565 */
+        uint16_t *row = &s_framebuffer[y * DISPLAY_W + area->x1];
+        for (int32_t x = 0; x < width; x++) {
+            row[x] = __builtin_bswap16(color_map[x].full);
+        }
+#else
+        memcpy(&s_framebuffer[y * DISPLAY_W + area->x1], color_map, width * sizeof(lv_color_t));
+#endif
+        color_map += width;
+    }
+    flush_done();
+}
+
+static void panel_init(void) {
+    /* Only written by the CPU in flush_cb, so it can live in PSRAM */
+    s_framebuffer = mem_alloc_cold(DISPLAY_W * DISPLAY_H * sizeof(uint16_t));
+    ESP_ERROR_CHECK(s_framebuffer ? ESP_OK : ESP_ERR_NO_MEM);
+}
+
+const uint16_t *display_get_framebuffer(void) {
+    return s_framebuffer;
+}
+
+#endif
+
+/* Called by LVGL after every refresh with the render time and number of redrawn pixels */
+static void monitor_cb(lv_disp_drv_t *drv, uint32_t time, uint32_t px) {
+    portENTER_CRITICAL(&s_stats_lock);
+    uint32_t flush_us = s_flush_us_acc;
+    s_flush_us_acc = 0;
+    s_stats.updates++;
+    s_stats.last_area_px = px;
+    s_stats.last_render_ms = time;
+    s_stats.last_flush_us = flush_us;
+    if (flush_us > s_stats.max_flush_us) {
+        s_stats.max_flush_us = flush_us;
+    }
+    s_stats.total_area_px += px;
+    portEXIT_CRITICAL(&s_stats_lock);
+    ESP_LOGD(TAG, "Redrew %lu px: render %lu ms, flush %lu us", px, time, flush_us);
+}
+
+static void create_ui(void) {
+    lv_obj_t *screen = lv_scr_act();
+    lv_obj_set_style_bg_color(screen, lv_color_black(), 0);
+    lv_obj_set_style_text_color(screen, lv_color_white(), 0);
+
+    const lv_coord_t row_h = DISPLAY_H / TEMPERATURE_PROBE_COUNT;
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        lv_obj_t *name = lv_label_create(screen);
+        lv_label_set_text_fmt(name, "P%d", i + 1);
+        lv_obj_align(name, LV_ALIGN_TOP_LEFT, 8, i * row_h + 8);
+
+        s_temp_labels[i] = lv_label_create(screen);
+        lv_obj_set_style_text_font(s_temp_labels[i], VALUE_FONT, 0);
+        lv_label_set_text(s_temp_labels[i], "--");
+        lv_obj_align(s_temp_labels[i], LV_ALIGN_TOP_LEFT, 40, i * row_h + 4);
+
+        s_target_labels[i] = lv_label_create(screen);
+        lv_obj_set_style_text_color(s_target_labels[i], lv_palette_main(LV_PALETTE_GREY), 0);
+        lv_label_set_text(s_target_labels[i], "--");
+        lv_obj_align(s_target_labels[i], LV_ALIGN_TOP_RIGHT, -8, i * row_h + 8);
+
+        s_shown_temp[i] = INT32_MIN;
+        s_shown_target[i] = INT32_MIN;
+    }
+}
+
+/* Only touch labels whose value changed so LVGL invalidates just those areas */
+static void update_values(const temperature_snapshot_t *snapshot) {
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        /* A faulty probe is shown as "--", INT32_MIN stands for that in s_shown_temp */
+        int32_t temp = (snapshot->fault_mask & (1 << i)) ? INT32_MIN : snapshot->temp[i];
+        if (temp != s_shown_temp[i]) {
+            if (temp == INT32_MIN) {
+                lv_label_set_text(s_temp_labels[i], "--");
+            } else {
+                lv_label_set_text_fmt(s_temp_labels[i], "%ld°C", temp);
+            }
+            s_shown_temp[i] = temp;
+        }
+        if (snapshot->target[i] != s_shown_target[i]) {
+            lv_label_set_text_fmt(s_target_labels[i], "-> %ld°C", snapshot->target[i]);
+            s_shown_target[i] = snapshot->target[i];
+        }
+    }
+}
+
+static void display_task(void *arg) {
+    temperature_snapshot_t snapshot;
+    uint32_t last_seq = 0;
+    int64_t last_tick_us = esp_timer_get_time();
+
+    for (;;) {
+        temperature_get_snapshot(&snapshot);
+        if (snapshot.seq != last_seq) {
+            update_values(&snapshot);
+            last_seq = snapshot.seq;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        lv_tick_inc((uint32_t)((now_us - last_tick_us) / 1000));
+        last_tick_us = now_us - (now_us - last_tick_us) % 1000;
+
+        uint32_t sleep_ms = lv_timer_handler();
+        if (sleep_ms > DISPLAY_MAX_SLEEP) {
+            sleep_ms = DISPLAY_MAX_SLEEP;
+        }
+        vTaskDelay(pdMS_TO_TICKS(sleep_ms) + 1);
+    }
+}
+
+void display_init(void) {
+    lv_init();
+    panel_init();
+
+    /*
+     * Two partial buffers so LVGL renders one while the other is being flushed.
+     * They are rendered into on every refresh and read by SPI DMA, so they stay
+     * in internal RAM even when PSRAM is available.
+     */
+#ifdef CONFIG_METER_STATIC_ALLOC
+    static DMA_ATTR lv_color_t buf1[DISPLAY_BUF_PX];
+    static DMA_ATTR lv_color_t buf2[DISPLAY_BUF_PX];
+#else
+    lv_color_t *buf1 = heap_caps_malloc(DISPLAY_BUF_PX * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    lv_color_t *buf2 = heap_caps_malloc(DISPLAY_BUF_PX * sizeof(lv_color_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (buf1 == NULL || buf2 == NULL) {
+        ESP_LOGE(TAG, "No memory for draw buffers");
+        free(buf1);
+        free(buf2);
+        return;
+    }
+#endif
+    lv_disp_draw_buf_init(&s_draw_buf, buf1, buf2, DISPLAY_BUF_PX);
+
+    lv_disp_drv_init(&s_disp_drv);
+    s_disp_drv.hor_res = DISPLAY_W;
+    s_disp_drv.ver_res = DISPLAY_H;
+    s_disp_drv.flush_cb = flush_cb;
+    s_disp_drv.monitor_cb = monitor_cb;
+    s_disp_drv.draw_buf = &s_draw_buf;
+    lv_disp_drv_register(&s_disp_drv);
+
+    create_ui();
+
+    ESP_LOGI(TAG, "%dx%d display, 2 x %d byte draw buffers", DISPLAY_W, DISPLAY_H, DISPLAY_BUF_PX * sizeof(lv_color_t));
+    MEM_TASK_CREATE(display_task, "display", 4096, NULL, CONFIG_METER_DISPLAY_TASK_PRIORITY, CONFIG_METER_NETWORK_CORE);
+}
+
+void display_get_stats(display_stats_t *stats) {
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+#else
+
+void display_init(void) {
+}
+
+void display_get_stats(display_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+const uint16_t *display_get_framebuffer(void) {
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Rendering cost of the display, updated after every LVGL refresh
+ */
+typedef struct {
+    uint32_t updates;          /* Refreshes that redrew at least one area */
+    uint32_t last_area_px;     /* Pixels redrawn by the last refresh */
+    uint32_t last_render_ms;   /* LVGL render time of the last refresh */
+    uint32_t last_flush_us;    /* Time spent pushing the last refresh to the panel */
+    uint32_t max_flush_us;     /* Worst flush time seen so far */
+    uint64_t total_area_px;    /* Pixels redrawn since boot */
+} display_stats_t;
+
+/**
+ * @brief Initialize LVGL and the panel, and start the display task
+ *
+ * Does nothing unless CONFIG_METER_DISPLAY_ENABLE is set.
+ */
+void display_init(void);
+
+/**
+ * @brief Copy the rendering statistics
+ *
+ * @param stats Destination of the copy
+ */
+void display_get_stats(display_stats_t *stats);
+
+/**
+ * @brief Get the in-memory framebuffer (RGB565 in native byte order, row-major)
+ *
+ * Pixels are unswapped on copy when LVGL renders byte-swapped for the SPI
+ * panel (CONFIG_LV_COLOR_16_SWAP), so red is always bits 15-11.
+ *
+ * @return const uint16_t* NULL unless CONFIG_METER_DISPLAY_PANEL_FRAMEBUFFER is set
+ */
+const uint16_t *display_get_framebuffer(void);
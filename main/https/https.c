@@ -0,0 +1,77 @@
+#include "https.h"
+#include <stdbool.h>
+#include <string.h>
+#include "sdkconfig.h"
+
+static https_stats_t s_stats;
+
+#if CONFIG_METER_HTTPS_ENABLE
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "mbedtls/ssl_ticket.h"
+
+static const char *TAG = "https";
+
+/*
+ * esp_https_server performs the handshake inside its open hook and reports
+ * nothing about it, so the calls it makes are intercepted at link time
+ * (-Wl,--wrap, see main/CMakeLists.txt). All handshakes run on the server
+ * task one after another, which is why a single flag is enough to tell which
+ * handshake a ticket belongs to.
+ */
+static bool s_ticket_accepted;
+
+int __real_esp_tls_server_session_create(esp_tls_cfg_server_t *cfg, int sockfd, esp_tls_t *tls);
+int __real_mbedtls_ssl_ticket_parse(void *p_ticket, mbedtls_ssl_session *session, unsigned char *buf, size_t len);
+int __real_mbedtls_ssl_ticket_write(void *p_ticket, const mbedtls_ssl_session *session, unsigned char *start,
+                                    const unsigned char *end, size_t *tlen, uint32_t *lifetime);
+
+int __wrap_esp_tls_server_session_create(esp_tls_cfg_server_t *cfg, int sockfd, esp_tls_t *tls) {
+    s_ticket_accepted = false;
+    int64_t start_us = esp_timer_get_time();
+    int ret = __real_esp_tls_server_session_create(cfg, sockfd, tls);
+    uint32_t elapsed_us = esp_timer_get_time() - start_us;
+
+    if (ret != 0) {
+        s_stats.failed++;
+    } else if (s_ticket_accepted) {
+        s_stats.resumed++;
+        s_stats.resumed_us += elapsed_us;
+        if (elapsed_us > s_stats.resumed_max_us) {
+            s_stats.resumed_max_us = elapsed_us;
+        }
+    } else {
+        s_stats.full++;
+        s_stats.full_us += elapsed_us;
+        if (elapsed_us > s_stats.full_max_us) {
+            s_stats.full_max_us = elapsed_us;
+        }
+    }
+    ESP_LOGD(TAG, "%s handshake on socket %d took %lu us", ret != 0 ? "Failed" : s_ticket_accepted ? "Resumed" : "Full",
+             sockfd, (unsigned long)elapsed_us);
+    return ret;
+}
+
+/* A ticket that decrypts and has not expired lets the handshake skip the key exchange */
+int __wrap_mbedtls_ssl_ticket_parse(void *p_ticket, mbedtls_ssl_session *session, unsigned char *buf, size_t len) {
+    int ret = __real_mbedtls_ssl_ticket_parse(p_ticket, session, buf, len);
+    if (ret == 0) {
+        s_ticket_accepted = true;
+    }
+    return ret;
+}
+
+int __wrap_mbedtls_ssl_ticket_write(void *p_ticket, const mbedtls_ssl_session *session, unsigned char *start,
+                                    const unsigned char *end, size_t *tlen, uint32_t *lifetime) {
+    int ret = __real_mbedtls_ssl_ticket_write(p_ticket, session, start, end, tlen, lifetime);
+    if (ret == 0) {
+        s_stats.tickets_issued++;
+    }
+    return ret;
+}
+#endif
+
+void https_get_stats(https_stats_t *stats) {
+    memcpy(stats, &s_stats, sizeof(*stats));
+}
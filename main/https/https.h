@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief TLS handshake counters of the HTTPS server
+ *
+ * Full handshakes run the ECDHE key exchange and sign with the server key,
+ * resumed ones only decrypt the session ticket the client presented.
+ */
+typedef struct {
+    uint32_t full;           /* Completed handshakes with a full key exchange */
+    uint32_t resumed;        /* Completed handshakes that resumed a session from a ticket */
+    uint32_t failed;         /* Handshakes that did not complete */
+    uint32_t tickets_issued; /* Session tickets sent to clients */
+    uint64_t full_us;        /* Total time spent in full handshakes */
+    uint64_t resumed_us;     /* Total time spent in resumed handshakes */
+    uint32_t full_max_us;
+    uint32_t resumed_max_us;
+} https_stats_t;
+
+/**
+ * @brief Read the handshake counters, all zero unless CONFIG_METER_HTTPS_ENABLE is set
+ *
+ * @param stats Where to store the counters
+ */
+void https_get_stats(https_stats_t *stats);
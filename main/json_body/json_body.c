@@ -0,0 +1,345 @@
+#include "json_body.h"
+#include <string.h>
+
+/*
+ * Push parser for the flat JSON objects the REST API accepts. It keeps no copy of
+ * the body: every byte moves the state machine forward and values are written
+ * into the schema's destinations as they complete, so bodies can be parsed chunk
+ * by chunk straight from httpd_req_recv() without allocating.
+ */
+
+#define NUMBER_LIMIT 10000000000LL
+
+enum {
+    ST_OBJECT_START,
+    ST_FIRST_KEY,
+    ST_NEXT_KEY,
+    ST_KEY,
+    ST_COLON,
+    ST_VALUE,
+    ST_NUMBER_SIGN,
+    ST_NUMBER_INT,
+    ST_NUMBER_FRAC_START,
+    ST_NUMBER_FRAC,
+    ST_STRING,
+    ST_STRING_ESCAPE,
+    ST_STRING_UNICODE,
+    ST_MEMBER_END,
+    ST_DONE,
+    ST_ERROR,
+};
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static esp_err_t fail(json_body_t *p, const char *error) {
+    p->error = error;
+    p->state = ST_ERROR;
+    return ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t start_member(json_body_t *p) {
+    for (size_t i = 0; i < p->field_count; i++) {
+        if (strcmp(p->fields[i].key, p->key) == 0) {
+            if (p->seen & (1 << i)) {
+                return fail(p, "Duplicate member");
+            }
+            p->field = i;
+            p->state = ST_COLON;
+            return ESP_OK;
+        }
+    }
+    return fail(p, "Unknown member");
+}
+
+static esp_err_t finish_number(json_body_t *p) {
+    const json_field_t *field = &p->fields[p->field];
+    int64_t value = p->negative ? -p->number : p->number;
+    if (value < field->min || value > field->max) {
+        return fail(p, "Number out of range");
+    }
+    *(int32_t *)field->dest = value;
+    p->seen |= 1 << p->field;
+    p->state = ST_MEMBER_END;
+    return ESP_OK;
+}
+
+static esp_err_t append_char(json_body_t *p, char c) {
+    const json_field_t *field = &p->fields[p->field];
+    if (p->len + 1 >= field->size || p->len >= field->max) {
+        return fail(p, "String too long");
+    }
+    ((char *)field->dest)[p->len++] = c;
+    return ESP_OK;
+}
+
+/* Append a \uXXXX escape as UTF-8 */
+static esp_err_t append_unicode(json_body_t *p, uint16_t cp) {
+    if (cp == 0 || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return fail(p, "Unsupported escape");
+    }
+    esp_err_t err = ESP_OK;
+    if (cp < 0x80) {
+        err = append_char(p, cp);
+    } else if (cp < 0x800) {
+        if ((err = append_char(p, 0xC0 | (cp >> 6))) == ESP_OK) {
+            err = append_char(p, 0x80 | (cp & 0x3F));
+        }
+    } else {
+        if ((err = append_char(p, 0xE0 | (cp >> 12))) == ESP_OK &&
+            (err = append_char(p, 0x80 | ((cp >> 6) & 0x3F))) == ESP_OK) {
+            err = append_char(p, 0x80 | (cp & 0x3F));
+        }
+    }
+    return err;
+}
+
+static esp_err_t finish_string(json_body_t *p) {
+    const json_field_t *field = &p->fields[p->field];
+    ((char *)field->dest)[p->len] = '\0';
+    if (p->len < field->min) {
+        return fail(p, "String too short");
+    }
+    p->seen |= 1 << p->field;
+    p->state = ST_MEMBER_END;
+    return ESP_OK;
+}
+
+static esp_err_t start_value(json_body_t *p, char c) {
+    const json_field_t *field = &p->fields[p->field];
+    p->len = 0;
+    if (field->type == JSON_FIELD_STRING) {
+        if (c != '"') {
+            return fail(p, "Expected a string");
+        }
+        p->state = ST_STRING;
+        return ESP_OK;
+    }
+
+    p->number = 0;
+    p->negative = false;
+    if (c == '-') {
+        p->negative = true;
+        p->state = ST_NUMBER_SIGN;
+    } else if (is_digit(c)) {
+        p->number = c - '0';
+        p->state = ST_NUMBER_INT;
+    } else {
+        return fail(p, "Expected a number");
+    }
+    return ESP_OK;
+}
+
+/* Consume one byte. Returns false if the byte has to be looked at again in the new state */
+static bool step(json_body_t *p, char c, esp_err_t *err) {
+    *err = ESP_OK;
+    switch (p->state) {
+        case ST_OBJECT_START:
+            if (c == '{') {
+                p->state = ST_FIRST_KEY;
+            } else if (!is_space(c)) {
+                *err = fail(p, "Expected an object");
+            }
+            return true;
+
+        case ST_FIRST_KEY:
+        case ST_NEXT_KEY:
+            if (c == '"') {
+                p->len = 0;
+                p->state = ST_KEY;
+            } else if (c == '}' && p->state == ST_FIRST_KEY) {
+                p->state = ST_DONE;
+            } else if (!is_space(c)) {
+                *err = fail(p, "Expected a member name");
+            }
+            return true;
+
+        case ST_KEY:
+            if (c == '"') {
+                p->key[p->len] = '\0';
+                *err = start_member(p);
+            } else if (c == '\\' || (uint8_t)c < 0x20 || p->len + 1 >= sizeof(p->key)) {
+                *err = fail(p, "Unknown member");
+            } else {
+                p->key[p->len++] = c;
+            }
+            return true;
+
+        case ST_COLON:
+            if (c == ':') {
+                p->state = ST_VALUE;
+            } else if (!is_space(c)) {
+                *err = fail(p, "Expected ':'");
+            }
+            return true;
+
+        case ST_VALUE:
+            if (!is_space(c)) {
+                *err = start_value(p, c);
+            }
+            return true;
+
+        case ST_NUMBER_SIGN:
+            if (!is_digit(c)) {
+                *err = fail(p, "Expected a number");
+            } else {
+                p->number = c - '0';
+                p->state = ST_NUMBER_INT;
+            }
+            return true;
+
+        case ST_NUMBER_INT:
+            if (is_digit(c)) {
+                if (p->number == 0) {
+                    *err = fail(p, "Leading zero");
+                    return true;
+                }
+                p->number = p->number * 10 + (c - '0');
+                if (p->number > NUMBER_LIMIT) {
+                    *err = fail(p, "Number out of range");
+                }
+                return true;
+            }
+            if (c == '.') {
+                p->state = ST_NUMBER_FRAC_START;
+                return true;
+            }
+            if (c == 'e' || c == 'E') {
+                *err = fail(p, "Exponents are not supported");
+                return true;
+            }
+            *err = finish_number(p);
+            return false;
+
+        case ST_NUMBER_FRAC_START:
+            if (!is_digit(c)) {
+                *err = fail(p, "Expected a digit");
+            } else {
+                p->state = ST_NUMBER_FRAC;
+            }
+            return true;
+
+        case ST_NUMBER_FRAC:
+            if (is_digit(c)) {
+                return true;
+            }
+            if (c == 'e' || c == 'E') {
+                *err = fail(p, "Exponents are not supported");
+                return true;
+            }
+            *err = finish_number(p);
+            return false;
+
+        case ST_STRING:
+            if (c == '"') {
+                *err = finish_string(p);
+            } else if (c == '\\') {
+                p->state = ST_STRING_ESCAPE;
+            } else if ((uint8_t)c < 0x20) {
+                *err = fail(p, "Control character in string");
+            } else {
+                *err = append_char(p, c);
+            }
+            return true;
+
+        case ST_STRING_ESCAPE: {
+            static const char escapes[] = "\"\"\\\\//b\bf\fn\nr\rt\t";
+            p->state = ST_STRING;
+            if (c == 'u') {
+                p->unicode = 0;
+                p->unicode_left = 4;
+                p->state = ST_STRING_UNICODE;
+                return true;
+            }
+            for (const char *e = escapes; *e != '\0'; e += 2) {
+                if (*e == c) {
+                    *err = append_char(p, e[1]);
+                    return true;
+                }
+            }
+            *err = fail(p, "Invalid escape");
+            return true;
+        }
+
+        case ST_STRING_UNICODE: {
+            int digit = is_digit(c) ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+            if (digit < 0) {
+                *err = fail(p, "Invalid escape");
+                return true;
+            }
+            p->unicode = (p->unicode << 4) | digit;
+            if (--p->unicode_left == 0) {
+                p->state = ST_STRING;
+                *err = append_unicode(p, p->unicode);
+            }
+            return true;
+        }
+
+        case ST_MEMBER_END:
+            if (c == ',') {
+                p->state = ST_NEXT_KEY;
+            } else if (c == '}') {
+                p->state = ST_DONE;
+            } else if (!is_space(c)) {
+                *err = fail(p, "Expected ',' or '}'");
+            }
+            return true;
+
+        case ST_DONE:
+            if (!is_space(c)) {
+                *err = fail(p, "Unexpected data after the object");
+            }
+            return true;
+
+        default:
+            *err = ESP_ERR_INVALID_ARG;
+            return true;
+    }
+}
+
+void json_body_init(json_body_t *parser, const json_field_t *fields, size_t field_count) {
+    memset(parser, 0, sizeof(*parser));
+    parser->fields = fields;
+    parser->field_count = field_count < JSON_BODY_MAX_FIELDS ? field_count : JSON_BODY_MAX_FIELDS;
+    parser->state = ST_OBJECT_START;
+}
+
+esp_err_t json_body_feed(json_body_t *parser, const char *data, size_t len) {
+    esp_err_t err = parser->state == ST_ERROR ? ESP_ERR_INVALID_ARG : ESP_OK;
+    size_t i = 0;
+    while (err == ESP_OK && i < len) {
+        if (step(parser, data[i], &err)) {
+            i++;
+            parser->offset++;
+        }
+    }
+    return err;
+}
+
+esp_err_t json_body_finish(json_body_t *parser) {
+    if (parser->state == ST_ERROR) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (parser->state != ST_DONE) {
+        return fail(parser, "Truncated body");
+    }
+    for (size_t i = 0; i < parser->field_count; i++) {
+        if (parser->fields[i].required && !(parser->seen & (1 << i))) {
+            return fail(parser, "Missing member");
+        }
+    }
+    return ESP_OK;
+}
+
+bool json_body_has(const json_body_t *parser, size_t field) {
+    return field < parser->field_count && (parser->seen & (1 << field));
+}
+
+const char *json_body_error(const json_body_t *parser) {
+    return parser->error;
+}
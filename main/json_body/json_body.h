@@ -0,0 +1,94 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_BODY_MAX_FIELDS 16
+#define JSON_BODY_KEY_MAX    24
+
+typedef enum {
+    JSON_FIELD_INT,    /* int32_t, a fractional part is truncated like cJSON's valueint */
+    JSON_FIELD_STRING, /* NUL terminated char array of `size` bytes */
+} json_field_type_t;
+
+/**
+ * @brief One member of the flat JSON object a request body must contain
+ */
+typedef struct {
+    const char *key;
+    json_field_type_t type;
+    void *dest;
+    size_t size;  /* Size of the destination buffer, strings only */
+    int32_t min;  /* Smallest value, or shortest length for strings */
+    int32_t max;  /* Largest value, or longest length for strings */
+    bool required;
+} json_field_t;
+
+/**
+ * @brief State of an incremental parse, lives on the caller's stack
+ */
+typedef struct {
+    const json_field_t *fields;
+    size_t field_count;
+    uint32_t seen; /* Bit n set once fields[n] was parsed */
+    const char *error;
+    size_t offset; /* Bytes consumed so far, points at the error once one occurred */
+
+    uint8_t state;
+    int8_t field; /* Index of the member being parsed */
+    bool negative;
+    uint8_t unicode_left;
+    uint16_t unicode;
+    int64_t number;
+    size_t len;
+    char key[JSON_BODY_KEY_MAX];
+} json_body_t;
+
+/**
+ * @brief Prepare a parse of a flat JSON object against a schema
+ *
+ * Members are written straight into their destination as they are parsed, so a
+ * rejected body can leave some destinations modified. Unknown, duplicate or
+ * nested members are rejected.
+ *
+ * @param parser Parser state to initialize
+ * @param fields Schema, must outlive the parse
+ * @param field_count Number of entries in fields, at most JSON_BODY_MAX_FIELDS
+ */
+void json_body_init(json_body_t *parser, const json_field_t *fields, size_t field_count);
+
+/**
+ * @brief Parse the next chunk of the body
+ *
+ * @param parser Parser state
+ * @param data Chunk, does not need to be NUL terminated
+ * @param len Length of the chunk
+ * @return esp_err_t ESP_ERR_INVALID_ARG once the body is malformed, see json_body_error()
+ */
+esp_err_t json_body_feed(json_body_t *parser, const char *data, size_t len);
+
+/**
+ * @brief Check that the body was complete and all required fields were present
+ *
+ * @param parser Parser state
+ * @return esp_err_t ESP_ERR_INVALID_ARG if not, see json_body_error()
+ */
+esp_err_t json_body_finish(json_body_t *parser);
+
+/**
+ * @brief Whether a field was present in the body
+ *
+ * @param parser Parser state
+ * @param field Index of the field in the schema
+ */
+bool json_body_has(const json_body_t *parser, size_t field);
+
+/**
+ * @brief Describe why the body was rejected
+ *
+ * @param parser Parser state
+ * @return const char* Static message, or NULL if no error occurred
+ */
+const char *json_body_error(const json_body_t *parser);
@@ -0,0 +1,436 @@
+#include "log_ring.h"
+#include "mem.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+
+/*
+ * Every log call reserves one fixed-size slot with an atomic ticket and stores the
+ * format pointer (esp_log formats are string literals in flash) plus the raw
+ * arguments. %s arguments are copied since they may not outlive the call. A slot's
+ * seq is 0 while it is being written and ticket + 1 once complete, which lets
+ * readers detect entries that are in flight or were overwritten meanwhile.
+ *
+ * Errors, and warnings with CONFIG_METER_LOG_RING_DIRECT_WARN, are also printed by
+ * the previous vprintf in the calling task: the echo task may never get to run
+ * again if the line is the last thing before a panic or reset.
+ */
+
+#define LOG_RING_MAX_ARGS  8
+#define LOG_RING_STR_BYTES 64
+#define LOG_SPEC_MAX       24
+#define ECHO_PERIOD_MS     50
+#define ECHO_LINE_MAX      256
+
+typedef enum {
+    ARG_NONE,
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_DOUBLE,
+    ARG_PTR,
+    ARG_STR,
+} arg_type_t;
+
+typedef struct {
+    size_t len;      /* Length of the conversion spec including '%' */
+    char conv;       /* Conversion character */
+    arg_type_t type; /* Type of the argument it consumes */
+    int stars;       /* '*' width/precision arguments consumed before it */
+} spec_t;
+
+typedef struct {
+    _Atomic uint32_t seq;
+    const char *fmt;
+    uint8_t nargs;
+    bool truncated;
+    uint64_t args[LOG_RING_MAX_ARGS];
+    char strings[LOG_RING_STR_BYTES];
+} log_slot_t;
+
+static const char *TAG = "log_ring";
+
+#ifdef CONFIG_METER_LOG_RING_ENABLE
+
+#define LOG_RING_ENTRIES CONFIG_METER_LOG_RING_ENTRIES
+
+#ifdef CONFIG_METER_STATIC_ALLOC
+static log_slot_t s_ring_storage[LOG_RING_ENTRIES];
+static log_slot_t *const s_ring = s_ring_storage;
+#else
+/* Only read or written once log_ring_init() installed the hook, goes to PSRAM when present */
+static log_slot_t *s_ring;
+#endif
+static _Atomic uint32_t s_head;
+static vprintf_like_t s_direct_vprintf;
+
+/* Level letter of an esp_log line or format, behind the colour escape LOG_FORMAT() may start it with */
+static char line_level(const char *line) {
+    if (line[0] == '\033') {
+        const char *m = strchr(line, 'm');
+        line = m != NULL ? m + 1 : line;
+    }
+    return line[0] != '\0' && line[1] == ' ' && line[2] == '(' ? line[0] : '\0';
+}
+
+/* Whether lines of this level bypass the echo task */
+static bool is_direct(const char *line) {
+    char level = line_level(line);
+#ifdef CONFIG_METER_LOG_RING_DIRECT_WARN
+    return level == 'E' || level == 'W';
+#else
+    return level == 'E';
+#endif
+}
+
+/* Parse the conversion spec at fmt, which points at '%' */
+static void parse_spec(const char *fmt, spec_t *spec) {
+    const char *p = fmt + 1;
+    int longs = 0;
+    bool size = false;
+
+    spec->stars = 0;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL) {
+        p++;
+    }
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    } else {
+        while (isdigit((unsigned char)*p)) {
+            p++;
+        }
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            p++;
+        } else {
+            while (isdigit((unsigned char)*p)) {
+                p++;
+            }
+        }
+    }
+    while (*p != '\0' && strchr("hlLqjzt", *p) != NULL) {
+        if (*p == 'l' || *p == 'q') {
+            longs++;
+        } else if (*p == 'j') {
+            longs = 2;
+        } else if (*p == 'z' || *p == 't') {
+            size = true;
+        }
+        p++;
+    }
+
+    spec->conv = *p;
+    if (*p != '\0') {
+        p++;
+    }
+    spec->len = p - fmt;
+
+    switch (spec->conv) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+            spec->type = longs >= 2 ? ARG_LLONG : longs == 1 ? ARG_LONG : size ? ARG_SIZE : ARG_INT;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            spec->type = ARG_DOUBLE;
+            break;
+        case 'p':
+        case 'n':
+            spec->type = ARG_PTR;
+            break;
+        case 's':
+            spec->type = ARG_STR;
+            break;
+        default:
+            spec->type = ARG_NONE;
+            break;
+    }
+}
+
+static int log_ring_vprintf(const char *fmt, va_list ap) {
+    if (is_direct(fmt)) {
+        va_list direct;
+        va_copy(direct, ap);
+        s_direct_vprintf(fmt, direct);
+        va_end(direct);
+    }
+
+    uint32_t ticket = atomic_fetch_add_explicit(&s_head, 1, memory_order_relaxed);
+    log_slot_t *slot = &s_ring[ticket % LOG_RING_ENTRIES];
+
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->fmt = fmt;
+    slot->nargs = 0;
+    slot->truncated = false;
+    size_t str_used = 0;
+
+    for (const char *p = strchr(fmt, '%'); p != NULL; p = strchr(p, '%')) {
+        spec_t spec;
+        parse_spec(p, &spec);
+        p += spec.len;
+        if (spec.type == ARG_NONE && spec.stars == 0) {
+            continue;
+        }
+        if (slot->nargs + spec.stars + (spec.type != ARG_NONE) > LOG_RING_MAX_ARGS) {
+            slot->truncated = true;
+            break;
+        }
+        for (int i = 0; i < spec.stars; i++) {
+            slot->args[slot->nargs++] = (uint64_t)va_arg(ap, int);
+        }
+
+        uint64_t *arg = &slot->args[slot->nargs++];
+        switch (spec.type) {
+            case ARG_INT:
+                *arg = (uint64_t)va_arg(ap, int);
+                break;
+            case ARG_LONG:
+                *arg = (uint64_t)va_arg(ap, long);
+                break;
+            case ARG_LLONG:
+                *arg = (uint64_t)va_arg(ap, long long);
+                break;
+            case ARG_SIZE:
+                *arg = (uint64_t)va_arg(ap, size_t);
+                break;
+            case ARG_DOUBLE: {
+                double d = va_arg(ap, double);
+                memcpy(arg, &d, sizeof(d));
+                break;
+            }
+            case ARG_PTR:
+                *arg = (uintptr_t)va_arg(ap, void *);
+                break;
+            case ARG_STR: {
+                const char *s = va_arg(ap, const char *);
+                *arg = str_used;
+                if (str_used < LOG_RING_STR_BYTES) {
+                    size_t len = strlcpy(&slot->strings[str_used], s ? s : "(null)", LOG_RING_STR_BYTES - str_used);
+                    str_used += MIN(len, LOG_RING_STR_BYTES - str_used - 1) + 1;
+                }
+                break;
+            }
+            default:
+                slot->nargs--;
+                break;
+        }
+    }
+
+    atomic_store_explicit(&slot->seq, ticket + 1, memory_order_release);
+    return 0;
+}
+
+uint32_t log_ring_head(void) {
+    return atomic_load_explicit(&s_head, memory_order_acquire);
+}
+
+uint32_t log_ring_tail(void) {
+    uint32_t head = log_ring_head();
+    return head > LOG_RING_ENTRIES ? head - LOG_RING_ENTRIES : 0;
+}
+
+/* Append to a bounded buffer, keeping track of the length that would have been written */
+static void append(char *buf, size_t size, size_t *len, const char *src, size_t n) {
+    if (*len < size) {
+        memcpy(&buf[*len], src, MIN(n, size - *len - 1));
+    }
+    *len += n;
+}
+
+int log_ring_format(uint32_t seq, char *buf, size_t size) {
+    if (s_ring == NULL) {
+        return -1;
+    }
+    log_slot_t *ring_slot = &s_ring[seq % LOG_RING_ENTRIES];
+    uint32_t before = atomic_load_explicit(&ring_slot->seq, memory_order_acquire);
+    if (before != seq + 1) {
+        return -1;
+    }
+    log_slot_t slot;
+    memcpy(&slot, ring_slot, sizeof(slot));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&ring_slot->seq, memory_order_relaxed) != before) {
+        return -1;
+    }
+
+    size_t len = 0;
+    int next_arg = 0;
+    const char *p = slot.fmt;
+    while (*p != '\0') {
+        const char *pct = strchr(p, '%');
+        if (pct == NULL) {
+            append(buf, size, &len, p, strlen(p));
+            break;
+        }
+        append(buf, size, &len, p, pct - p);
+
+        spec_t spec;
+        parse_spec(pct, &spec);
+        p = pct + spec.len;
+        if (spec.conv == '%') {
+            append(buf, size, &len, "%", 1);
+            continue;
+        }
+        if (spec.type == ARG_NONE && spec.stars == 0) {
+            append(buf, size, &len, pct, spec.len);
+            continue;
+        }
+        if (next_arg + spec.stars + (spec.type != ARG_NONE) > slot.nargs) {
+            append(buf, size, &len, "...", 3);
+            break;
+        }
+
+        /* Rebuild the spec with '*' replaced by the stored width/precision */
+        char fmt_spec[LOG_SPEC_MAX];
+        size_t spec_len = 0;
+        for (size_t i = 0; i < spec.len && spec_len < sizeof(fmt_spec) - 12; i++) {
+            if (pct[i] == '*') {
+                spec_len += sprintf(&fmt_spec[spec_len], "%d", (int)slot.args[next_arg++]);
+            } else {
+                fmt_spec[spec_len++] = pct[i];
+            }
+        }
+        fmt_spec[spec_len] = '\0';
+
+        char out[64];
+        uint64_t arg = slot.args[next_arg++];
+        int n = 0;
+        switch (spec.type) {
+            case ARG_INT:
+                n = snprintf(out, sizeof(out), fmt_spec, (int)arg);
+                break;
+            case ARG_LONG:
+                n = snprintf(out, sizeof(out), fmt_spec, (long)arg);
+                break;
+            case ARG_LLONG:
+                n = snprintf(out, sizeof(out), fmt_spec, (long long)arg);
+                break;
+            case ARG_SIZE:
+                n = snprintf(out, sizeof(out), fmt_spec, (size_t)arg);
+                break;
+            case ARG_DOUBLE: {
+                double d;
+                memcpy(&d, &arg, sizeof(d));
+                n = snprintf(out, sizeof(out), fmt_spec, d);
+                break;
+            }
+            case ARG_PTR:
+                n = spec.conv == 'n' ? 0 : snprintf(out, sizeof(out), fmt_spec, (void *)(uintptr_t)arg);
+                break;
+            case ARG_STR:
+                n = snprintf(out, sizeof(out), fmt_spec, arg < LOG_RING_STR_BYTES ? &slot.strings[arg] : "");
+                break;
+            default:
+                break;
+        }
+        append(buf, size, &len, out, MIN(n, (int)sizeof(out) - 1));
+    }
+    if (slot.truncated) {
+        append(buf, size, &len, " [truncated]\n", 13);
+    }
+
+    len = MIN(len, size - 1);
+    buf[len] = '\0';
+    return len;
+}
+
+#ifdef CONFIG_METER_LOG_RING_ECHO
+
+/* Print new entries to the console, outside of the tasks that logged them, except those printed directly */
+static void echo_task(void *arg) {
+    char line[ECHO_LINE_MAX];
+    uint32_t next = 0;
+
+    for (;;) {
+        uint32_t head = log_ring_head();
+        if (head - next > LOG_RING_ENTRIES) {
+            printf("... %lu log lines lost\n", head - next - LOG_RING_ENTRIES);
+            next = head - LOG_RING_ENTRIES;
+        }
+        while (next != head) {
+            if (log_ring_format(next, line, sizeof(line)) < 0) {
+                if (next >= log_ring_tail()) {
+                    break; /* Still being written, retry on the next round */
+                }
+            } else if (!is_direct(line)) {
+                fputs(line, stdout);
+            }
+            next++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(ECHO_PERIOD_MS));
+    }
+}
+
+#endif
+
+void log_ring_init(void) {
+#ifndef CONFIG_METER_STATIC_ALLOC
+    s_ring = mem_alloc_cold(LOG_RING_ENTRIES * sizeof(log_slot_t));
+    if (s_ring == NULL) {
+        ESP_LOGE(TAG, "No memory for the log ring, keeping direct output");
+        return;
+    }
+#endif
+    s_direct_vprintf = esp_log_set_vprintf(log_ring_vprintf);
+#ifdef CONFIG_METER_LOG_RING_ECHO
+    MEM_TASK_CREATE(echo_task, "log_echo", 3072, NULL, 1, CONFIG_METER_NETWORK_CORE);
+#endif
+    ESP_LOGI(TAG, "Logging into %d entry ring (%d bytes)", LOG_RING_ENTRIES, LOG_RING_ENTRIES * sizeof(log_slot_t));
+}
+
+#else
+
+void log_ring_init(void) {
+}
+
+uint32_t log_ring_head(void) {
+    return 0;
+}
+
+uint32_t log_ring_tail(void) {
+    return 0;
+}
+
+int log_ring_format(uint32_t seq, char *buf, size_t size) {
+    return -1;
+}
+
+#endif
+
+esp_err_t log_ring_set_level(const char *tag, const char *level) {
+    static const char *names[] = {"none", "error", "warn", "info", "debug", "verbose"};
+    for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(level, names[i]) == 0) {
+            esp_log_level_set(tag, (esp_log_level_t)i);
+            ESP_LOGI(TAG, "Log level of '%s' set to %s", tag, names[i]);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
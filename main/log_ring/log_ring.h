@@ -0,0 +1,45 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Route esp_log output into the RAM ring
+ *
+ * Log calls only store the format pointer and raw arguments; text is produced when
+ * the ring is read. With CONFIG_METER_LOG_RING_ECHO a low-priority task prints new
+ * entries to the console. Errors, and warnings with CONFIG_METER_LOG_RING_DIRECT_WARN,
+ * are printed by the logging call itself as well, so they are not lost to a panic.
+ */
+void log_ring_init(void);
+
+/**
+ * @brief Sequence number the next log entry will get
+ */
+uint32_t log_ring_head(void);
+
+/**
+ * @brief Oldest sequence number that may still be in the ring
+ */
+uint32_t log_ring_tail(void);
+
+/**
+ * @brief Format one entry
+ *
+ * @param seq Sequence number of the entry
+ * @param buf Destination of the formatted line, always NUL terminated
+ * @param size Size of buf
+ * @return int Length of the line, or -1 if the entry was overwritten or is still being written
+ */
+int log_ring_format(uint32_t seq, char *buf, size_t size);
+
+/**
+ * @brief Set the runtime level of a tag, "*" for all tags
+ *
+ * @param tag Log tag
+ * @param level Level name: none, error, warn, info, debug or verbose
+ * @return esp_err_t ESP_ERR_INVALID_ARG for an unknown level name
+ */
+esp_err_t log_ring_set_level(const char *tag, const char *level);
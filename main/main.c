@@ -2,8 +2,19 @@
 #include "mdns.h"
 #include "lwip/apps/netbiosns.h"
 #include "esp_littlefs.h"
+#include "checkpoint/checkpoint.h"
 #include "console/console.h"
+#include "display/display.h"
+#include "log_ring/log_ring.h"
+#include "mem/mem.h"
+#include "power/power.h"
+#include "rest_server.h"
+#include "session/session.h"
+#include "ota/ota.h"
+#include "webui/webui.h"
 #include "settings/settings.h"
+#include "telemetry/telemetry.h"
+#include "temperature/temperature.h"
 #include "esp_wifi.h"
 #include "wifi/wifi.h"
 #include "wifi/wifi_soft_ap.h"
@@ -16,8 +27,6 @@ static const char *TAG = "main";
 #define FS_MOUNT_POINT "/www"
 #define MDNS_HOST_NAME "dashboard"
 
-esp_err_t start_rest_server(const char *base_path);
-
 static void initialise_mdns(void)
 {
     mdns_init();
@@ -29,13 +38,24 @@ static void initialise_mdns(void)
         {"path", "/"}
     };
 
+#if CONFIG_METER_HTTPS_ENABLE
+    ESP_ERROR_CHECK(mdns_service_add("ESP32-WebServer", "_https", "_tcp", 443, serviceTxtData,
+                                     sizeof(serviceTxtData) / sizeof(serviceTxtData[0])));
+#else
     ESP_ERROR_CHECK(mdns_service_add("ESP32-WebServer", "_http", "_tcp", 80, serviceTxtData,
                                      sizeof(serviceTxtData) / sizeof(serviceTxtData[0])));
+#endif
+
+    telemetry_mdns_advertise();
 }
 
 void app_main(void) {
+    mem_init();
+    log_ring_init();
+
     // Initialize NVS
     settings_nvs_init();
+    checkpoint_init();
 
     esp_vfs_littlefs_conf_t conf = {
         .base_path = "/www",
@@ -45,10 +65,19 @@ void app_main(void) {
     };
 
     esp_vfs_littlefs_register(&conf);
+    webui_init(FS_MOUNT_POINT);
 
     console_init();
 
+    session_init(FS_MOUNT_POINT);
+    temperature_sampler_start();
+
+    display_init();
+
+    power_init();
     wifi_init();
+    /* Opens its socket, so only once wifi_init() has brought up lwIP */
+    telemetry_init();
 
     if (settings_wifi_configured()) {
         wifi_init_sta();
@@ -64,4 +93,8 @@ void app_main(void) {
 
     ESP_ERROR_CHECK(start_rest_server(FS_MOUNT_POINT));
 
+    ota_confirm_health();
+
+    mem_report_boot();
+
 }
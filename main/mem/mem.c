@@ -0,0 +1,188 @@
+#include "mem.h"
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <sys/param.h>
+
+#define HEAP_HISTORY CONFIG_METER_HEAP_HISTORY
+
+static const char *TAG = "mem";
+
+static const char *s_tag_names[MEM_TAG_COUNT] = {
+    [MEM_TAG_REST] = "rest",
+    [MEM_TAG_WIFI_SCAN] = "wifi_scan",
+    [MEM_TAG_CONSOLE] = "console",
+};
+static mem_tag_stats_t s_tags[MEM_TAG_COUNT];
+static portMUX_TYPE s_tag_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#ifdef CONFIG_METER_STATIC_ALLOC
+static mem_heap_sample_t s_history_storage[HEAP_HISTORY];
+static mem_heap_sample_t *const s_history = s_history_storage;
+#else
+/* Goes to PSRAM when present, NULL if there was no room for it */
+static mem_heap_sample_t *s_history;
+#endif
+static uint32_t s_history_head;
+static portMUX_TYPE s_history_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Charge a block to a tag, size is what the allocator actually reserved */
+static void *account_alloc(mem_tag_t tag, void *ptr) {
+    size_t size = ptr != NULL ? heap_caps_get_allocated_size(ptr) : 0;
+    mem_tag_stats_t *stats = &s_tags[tag];
+    portENTER_CRITICAL(&s_tag_lock);
+    if (ptr != NULL) {
+        stats->allocs++;
+        stats->live_bytes += size;
+        stats->peak_bytes = MAX(stats->peak_bytes, stats->live_bytes);
+    } else {
+        stats->failures++;
+    }
+    portEXIT_CRITICAL(&s_tag_lock);
+    return ptr;
+}
+
+void *mem_tag_malloc(mem_tag_t tag, size_t size) {
+    return account_alloc(tag, malloc(size));
+}
+
+void *mem_tag_calloc(mem_tag_t tag, size_t count, size_t size) {
+    return account_alloc(tag, calloc(count, size));
+}
+
+void mem_tag_free(mem_tag_t tag, void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    size_t size = heap_caps_get_allocated_size(ptr);
+    mem_tag_stats_t *stats = &s_tags[tag];
+    portENTER_CRITICAL(&s_tag_lock);
+    stats->frees++;
+    stats->live_bytes -= MIN(size, stats->live_bytes);
+    portEXIT_CRITICAL(&s_tag_lock);
+    free(ptr);
+}
+
+void mem_get_tag_stats(mem_tag_t tag, mem_tag_stats_t *stats) {
+    portENTER_CRITICAL(&s_tag_lock);
+    *stats = s_tags[tag];
+    portEXIT_CRITICAL(&s_tag_lock);
+}
+
+const char *mem_tag_name(mem_tag_t tag) {
+    return tag < MEM_TAG_COUNT ? s_tag_names[tag] : "unknown";
+}
+
+static void *json_malloc(size_t size) {
+    return mem_tag_malloc(MEM_TAG_REST, size);
+}
+
+static void json_free(void *ptr) {
+    mem_tag_free(MEM_TAG_REST, ptr);
+}
+
+/* Runs in the esp_timer task */
+static void sample_heap(void *arg) {
+    mem_heap_sample_t sample = {
+        .uptime_s = esp_timer_get_time() / 1000000,
+        .free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+        .largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+        .min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+    };
+    portENTER_CRITICAL(&s_history_lock);
+    s_history[s_history_head % HEAP_HISTORY] = sample;
+    s_history_head++;
+    portEXIT_CRITICAL(&s_history_lock);
+}
+
+void mem_init(void) {
+    /* cJSON no longer reallocs when printing once its hooks are not malloc and free, which costs a copy */
+    cJSON_Hooks hooks = {
+        .malloc_fn = json_malloc,
+        .free_fn = json_free,
+    };
+    cJSON_InitHooks(&hooks);
+
+#ifndef CONFIG_METER_STATIC_ALLOC
+    s_history = mem_alloc_cold(HEAP_HISTORY * sizeof(mem_heap_sample_t));
+    if (s_history == NULL) {
+        ESP_LOGE(TAG, "No memory for the heap history");
+        return;
+    }
+#endif
+    sample_heap(NULL);
+    const esp_timer_create_args_t args = {
+        .callback = sample_heap,
+        .name = "heap_sample",
+        /* A sample missed while the timer task was busy is not worth a burst of catching up */
+        .skip_unhandled_events = true,
+    };
+    esp_timer_handle_t timer;
+    ESP_ERROR_CHECK(esp_timer_create(&args, &timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer, CONFIG_METER_HEAP_SAMPLE_S * 1000000ULL));
+}
+
+uint32_t mem_heap_history(uint32_t *oldest) {
+    portENTER_CRITICAL(&s_history_lock);
+    uint32_t head = s_history_head;
+    portEXIT_CRITICAL(&s_history_lock);
+    *oldest = head > HEAP_HISTORY ? head - HEAP_HISTORY : 0;
+    return head;
+}
+
+bool mem_heap_sample(uint32_t seq, mem_heap_sample_t *sample) {
+    bool kept;
+    portENTER_CRITICAL(&s_history_lock);
+    kept = seq < s_history_head && s_history_head - seq <= HEAP_HISTORY;
+    if (kept) {
+        *sample = s_history[seq % HEAP_HISTORY];
+    }
+    portEXIT_CRITICAL(&s_history_lock);
+    return kept;
+}
+
+void *mem_alloc_cold(size_t size) {
+    void *ptr = NULL;
+    if (mem_psram_available()) {
+        ptr = heap_caps_calloc(1, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (ptr == NULL) {
+        ptr = heap_caps_calloc(1, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return ptr;
+}
+
+void mem_free(void *ptr) {
+    heap_caps_free(ptr);
+}
+
+bool mem_psram_available(void) {
+    return heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0;
+}
+
+void mem_get_stats(mem_stats_t *stats) {
+    stats->internal_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    stats->internal_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    stats->internal_largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    stats->psram_total = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
+    stats->psram_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    stats->psram_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+}
+
+void mem_report_boot(void) {
+    mem_stats_t stats;
+    mem_get_stats(&stats);
+    ESP_LOGI(TAG, "Internal heap after init: %u free, %u low water, %u largest block", stats.internal_free,
+             stats.internal_min_free, stats.internal_largest);
+    if (stats.psram_total > 0) {
+        ESP_LOGI(TAG, "PSRAM heap after init: %u of %u free, %u low water", stats.psram_free, stats.psram_total,
+                 stats.psram_min_free);
+    } else {
+        ESP_LOGI(TAG, "No PSRAM, cold buffers are in internal RAM");
+    }
+#ifdef CONFIG_METER_STATIC_ALLOC
+    ESP_LOGI(TAG, "Static allocation: application tasks and buffers are reserved at link time");
+#endif
+}
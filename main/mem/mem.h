@@ -0,0 +1,151 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Placement policy: large buffers that are touched rarely or only by the CPU
+ * (rings, caches, framebuffers) go to PSRAM when the module has it, everything
+ * hot or DMA-bound stays in internal RAM.
+ */
+
+/**
+ * @brief Free and low-water figures of the internal and external heaps
+ */
+typedef struct {
+    size_t internal_free;
+    size_t internal_min_free; /* Lowest internal_free since boot */
+    size_t internal_largest;  /* Largest allocatable internal block */
+    size_t psram_total;       /* 0 when no PSRAM was found */
+    size_t psram_free;
+    size_t psram_min_free;
+} mem_stats_t;
+
+/**
+ * @brief Owners heap allocations are charged to
+ */
+typedef enum {
+    MEM_TAG_REST,      /* HTTP handlers, including every cJSON document */
+    MEM_TAG_WIFI_SCAN, /* Access point lists */
+    MEM_TAG_CONSOLE,   /* Console command output */
+    MEM_TAG_COUNT,
+} mem_tag_t;
+
+typedef struct {
+    size_t live_bytes; /* Allocated and not yet freed, including allocator rounding */
+    size_t peak_bytes; /* Highest live_bytes since boot */
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures; /* Allocations the heap could not satisfy */
+} mem_tag_stats_t;
+
+/**
+ * @brief Internal heap figures taken every CONFIG_METER_HEAP_SAMPLE_S
+ */
+typedef struct {
+    uint32_t uptime_s;
+    uint32_t free;
+    uint32_t largest;  /* Largest allocatable block, free - largest is lost to fragmentation */
+    uint32_t min_free; /* Lowest free since boot */
+} mem_heap_sample_t;
+
+/**
+ * @brief Route cJSON through the MEM_TAG_REST accounting and start the heap sampler
+ *
+ * Must be called first in app_main(), before anything allocates a cJSON document.
+ */
+void mem_init(void);
+
+/**
+ * @brief Allocate size bytes charged to a tag
+ *
+ * @return void* The buffer, or NULL if the heap has no room. Free with mem_tag_free() and the same tag
+ */
+void *mem_tag_malloc(mem_tag_t tag, size_t size);
+
+/**
+ * @brief Allocate a zeroed array charged to a tag
+ */
+void *mem_tag_calloc(mem_tag_t tag, size_t count, size_t size);
+
+/**
+ * @brief Free a buffer returned by mem_tag_malloc() or mem_tag_calloc(), NULL is ignored
+ */
+void mem_tag_free(mem_tag_t tag, void *ptr);
+
+void mem_get_tag_stats(mem_tag_t tag, mem_tag_stats_t *stats);
+
+/**
+ * @brief Name of a tag for logs, the console and the API
+ */
+const char *mem_tag_name(mem_tag_t tag);
+
+/**
+ * @brief Range of heap samples still held
+ *
+ * @param oldest Receives the sequence number of the oldest sample kept
+ * @return uint32_t Sequence number the next sample will get, equal to *oldest if there are none
+ */
+uint32_t mem_heap_history(uint32_t *oldest);
+
+/**
+ * @brief Read one heap sample
+ *
+ * @param seq Sequence number from the range mem_heap_history() returned
+ * @param sample Destination
+ * @return bool false once the sample was overwritten, or if it was never taken
+ */
+bool mem_heap_sample(uint32_t seq, mem_heap_sample_t *sample);
+
+/**
+ * @brief Allocate a zeroed buffer for large, cold data. Uses PSRAM if present, internal RAM otherwise
+ *
+ * @param size Size in bytes
+ * @return void* The buffer, or NULL if neither heap has room. Free with mem_free()
+ */
+void *mem_alloc_cold(size_t size);
+
+/**
+ * @brief Free a buffer returned by mem_alloc_cold()
+ */
+void mem_free(void *ptr);
+
+/**
+ * @brief Whether PSRAM was found and added to the heap at boot
+ */
+bool mem_psram_available(void);
+
+/**
+ * @brief Read the current heap figures
+ *
+ * @param stats Destination
+ */
+void mem_get_stats(mem_stats_t *stats);
+
+/**
+ * @brief Log the heap figures, called once all tasks and buffers are set up
+ */
+void mem_report_boot(void);
+
+/**
+ * @brief Create a task pinned to a core
+ *
+ * With CONFIG_METER_STATIC_ALLOC the stack and TCB are static arrays reserved
+ * per call site, so creating the task does not touch the heap. stack_size must
+ * then be a constant expression.
+ */
+#ifdef CONFIG_METER_STATIC_ALLOC
+#define MEM_TASK_CREATE(fn, name, stack_size, arg, priority, core)                                           \
+    do {                                                                                                     \
+        static StackType_t s_task_stack[(stack_size) / sizeof(StackType_t)];                                 \
+        static StaticTask_t s_task_tcb;                                                                      \
+        xTaskCreateStaticPinnedToCore(fn, name, (stack_size), arg, priority, s_task_stack, &s_task_tcb, core); \
+    } while (0)
+#else
+#define MEM_TASK_CREATE(fn, name, stack_size, arg, priority, core) \
+    xTaskCreatePinnedToCore(fn, name, stack_size, arg, priority, NULL, core)
+#endif
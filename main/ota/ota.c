@@ -0,0 +1,121 @@
+#include "ota.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "ota";
+
+static struct {
+    bool active;
+    esp_ota_handle_t handle;
+    const esp_partition_t *partition;
+    mbedtls_sha256_context sha;
+    size_t written;
+    int64_t start_us;
+} s_ota;
+
+esp_err_t ota_begin(size_t image_size) {
+    if (s_ota.active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_ota.partition = esp_ota_get_next_update_partition(NULL);
+    if (s_ota.partition == NULL) {
+        ESP_LOGE(TAG, "No OTA partition available");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (image_size > s_ota.partition->size) {
+        ESP_LOGE(TAG, "Image of %d bytes does not fit into %s (%lu bytes)", image_size, s_ota.partition->label,
+                 s_ota.partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* Sequential writes erase sector by sector instead of the whole slot up front */
+    esp_err_t err = esp_ota_begin(s_ota.partition, OTA_WITH_SEQUENTIAL_WRITES, &s_ota.handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    mbedtls_sha256_init(&s_ota.sha);
+    mbedtls_sha256_starts(&s_ota.sha, 0);
+    s_ota.written = 0;
+    s_ota.start_us = esp_timer_get_time();
+    s_ota.active = true;
+    ESP_LOGI(TAG, "Writing %d byte image to %s", image_size, s_ota.partition->label);
+    return ESP_OK;
+}
+
+esp_err_t ota_write(const void *data, size_t len) {
+    if (!s_ota.active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = esp_ota_write(s_ota.handle, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_write failed after %d bytes: %s", s_ota.written, esp_err_to_name(err));
+        return err;
+    }
+    mbedtls_sha256_update(&s_ota.sha, data, len);
+    s_ota.written += len;
+    return ESP_OK;
+}
+
+esp_err_t ota_end(const uint8_t *expected_sha256, ota_result_t *result) {
+    if (!s_ota.active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_ota.active = false;
+
+    mbedtls_sha256_finish(&s_ota.sha, result->sha256);
+    mbedtls_sha256_free(&s_ota.sha);
+    result->bytes = s_ota.written;
+    result->elapsed_us = esp_timer_get_time() - s_ota.start_us;
+    result->partition = s_ota.partition->label;
+
+    if (expected_sha256 != NULL && memcmp(expected_sha256, result->sha256, OTA_SHA256_LEN) != 0) {
+        ESP_LOGE(TAG, "Image hash mismatch");
+        esp_ota_abort(s_ota.handle);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    /* Verifies the image header, segments and appended checksum */
+    esp_err_t err = esp_ota_end(s_ota.handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image validation failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = esp_ota_set_boot_partition(s_ota.partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Wrote %d bytes to %s in %lld ms (%lld KB/s)", result->bytes, result->partition,
+             result->elapsed_us / 1000, result->elapsed_us > 0 ? (int64_t)result->bytes * 1000 / result->elapsed_us : 0);
+    return ESP_OK;
+}
+
+void ota_abort(void) {
+    if (!s_ota.active) {
+        return;
+    }
+    s_ota.active = false;
+    mbedtls_sha256_free(&s_ota.sha);
+    esp_ota_abort(s_ota.handle);
+    ESP_LOGW(TAG, "Update aborted after %d bytes", s_ota.written);
+}
+
+void ota_confirm_health(void) {
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(running, &state) != ESP_OK) {
+        return;
+    }
+    if (state == ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGI(TAG, "New image in %s is healthy, cancelling rollback", running->label);
+        esp_ota_mark_app_valid_cancel_rollback();
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_SHA256_LEN 32
+
+/**
+ * @brief Result of a finished firmware upload
+ */
+typedef struct {
+    size_t bytes;
+    int64_t elapsed_us;
+    uint8_t sha256[OTA_SHA256_LEN];
+    const char *partition;
+} ota_result_t;
+
+/**
+ * @brief Start writing a new image into the next OTA slot
+ *
+ * @param image_size Total size of the image in bytes
+ * @return esp_err_t ESP_ERR_INVALID_STATE if an update is already in progress
+ */
+esp_err_t ota_begin(size_t image_size);
+
+/**
+ * @brief Append a chunk of the image and feed it into the running hash
+ *
+ * @param data Chunk of the image
+ * @param len Length of the chunk
+ * @return esp_err_t
+ */
+esp_err_t ota_write(const void *data, size_t len);
+
+/**
+ * @brief Validate the written image and select it for the next boot
+ *
+ * @param expected_sha256 Digest the image must have, or NULL to skip the check
+ * @param result Filled with the upload statistics and image hash
+ * @return esp_err_t ESP_ERR_INVALID_CRC if the digest does not match
+ */
+esp_err_t ota_end(const uint8_t *expected_sha256, ota_result_t *result);
+
+/**
+ * @brief Abort the update in progress, leaving the boot partition untouched
+ */
+void ota_abort(void);
+
+/**
+ * @brief Mark the running image as healthy so the bootloader does not roll it back
+ *
+ * Call once the application is fully up. If the image never gets here the bootloader
+ * returns to the previous slot on the next reset.
+ */
+void ota_confirm_health(void);
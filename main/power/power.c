@@ -0,0 +1,32 @@
+#include "power.h"
+#include "sdkconfig.h"
+
+#if CONFIG_METER_POWER_SAVE
+#include "esp_log.h"
+#include "esp_pm.h"
+
+static const char *TAG = "power";
+
+void power_init(void) {
+    /* Drivers hold PM locks while they need the clocks, e.g. the ADC during a conversion
+     * and Wi-Fi while its modem is awake, so everything else may run slow or sleep */
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_METER_POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI(TAG, "CPU at %d-%d MHz, light sleep when idle", CONFIG_METER_POWER_MIN_FREQ_MHZ,
+             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+}
+
+#else
+
+void power_init(void) {
+}
+
+#endif
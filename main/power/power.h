@@ -0,0 +1,8 @@
+#pragma once
+
+/**
+ * @brief Let the CPU scale its frequency and enter light sleep whenever no task is ready to run
+ *
+ * Does nothing unless CONFIG_METER_POWER_SAVE is set. Call before starting Wi-Fi.
+ */
+void power_init(void);
@@ -0,0 +1,156 @@
+#include "probe.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+/*
+ * The active driver is only swapped while holding s_lock, which probe_read()
+ * also takes, so a read never runs against a driver that is being torn down.
+ */
+
+static const char *TAG = "probe";
+
+static const probe_driver_t *const s_drivers[] = {
+    &probe_adc_driver,
+    &probe_replay_driver,
+    &probe_sim_driver,
+};
+
+static const probe_driver_t *s_driver;
+static SemaphoreHandle_t s_lock;
+static StaticSemaphore_t s_lock_buf;
+
+/* Scaled time is s_base_us plus the real time since s_base_real_us, times s_scale */
+static portMUX_TYPE s_time_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_base_us;
+static int64_t s_base_real_us;
+static uint32_t s_scale = CONFIG_METER_PROBE_TIME_SCALE;
+
+int64_t probe_time_us(void) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_time_lock);
+    int64_t t = s_base_us + (now - s_base_real_us) * s_scale;
+    portEXIT_CRITICAL(&s_time_lock);
+    return t;
+}
+
+static void reset_time(void) {
+    portENTER_CRITICAL(&s_time_lock);
+    s_base_us = 0;
+    s_base_real_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_time_lock);
+}
+
+esp_err_t probe_set_time_scale(uint32_t scale) {
+    if (scale < 1 || scale > 1000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_time_lock);
+    s_base_us += (now - s_base_real_us) * s_scale;
+    s_base_real_us = now;
+    s_scale = scale;
+    portEXIT_CRITICAL(&s_time_lock);
+    ESP_LOGI(TAG, "Time scale %lux", scale);
+    return ESP_OK;
+}
+
+uint32_t probe_get_time_scale(void) {
+    return s_scale;
+}
+
+static const probe_driver_t *find_driver(const char *name) {
+    for (size_t i = 0; i < sizeof(s_drivers) / sizeof(s_drivers[0]); i++) {
+        if (strcmp(s_drivers[i]->name, name) == 0) {
+            return s_drivers[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t probe_select(const char *name) {
+    const probe_driver_t *driver = find_driver(name);
+    if (driver == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (driver == s_driver) {
+        xSemaphoreGive(s_lock);
+        return ESP_OK;
+    }
+    if (s_driver != NULL) {
+        s_driver->deinit();
+    }
+    reset_time();
+    esp_err_t err = driver->init();
+    if (err == ESP_OK) {
+        s_driver = driver;
+    } else {
+        ESP_LOGE(TAG, "Driver %s failed to start: %s", name, esp_err_to_name(err));
+        if (s_driver != NULL && s_driver->init() != ESP_OK) {
+            s_driver = NULL;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Reading probes from the %s driver", name);
+    }
+    return err;
+}
+
+const char *probe_driver_name(void) {
+    const probe_driver_t *driver = s_driver;
+    return driver ? driver->name : "none";
+}
+
+esp_err_t probe_read(probe_reading_t *readings) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = s_driver ? s_driver->read(readings) : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(s_lock);
+
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        if (err != ESP_OK) {
+            readings[i].fault = PROBE_FAULT_OPEN;
+        }
+        /* Whatever a driver left there, a faulty probe reads 0 everywhere the snapshot goes */
+        if (readings[i].fault != PROBE_FAULT_NONE) {
+            readings[i].temp = 0;
+        }
+    }
+    return err;
+}
+
+const char *probe_fault_name(probe_fault_t fault) {
+    switch (fault) {
+        case PROBE_FAULT_NONE:
+            return "ok";
+        case PROBE_FAULT_OPEN:
+            return "open";
+        case PROBE_FAULT_SHORT:
+            return "short";
+        case PROBE_FAULT_RANGE:
+            return "range";
+        default:
+            return "?";
+    }
+}
+
+void probe_init(void) {
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+#if defined(CONFIG_METER_PROBE_DRIVER_ADC)
+    const char *name = probe_adc_driver.name;
+#elif defined(CONFIG_METER_PROBE_DRIVER_REPLAY)
+    const char *name = probe_replay_driver.name;
+#else
+    const char *name = probe_sim_driver.name;
+#endif
+    if (probe_select(name) != ESP_OK && strcmp(name, probe_sim_driver.name) != 0) {
+        ESP_LOGW(TAG, "Falling back to the simulator");
+        probe_select(probe_sim_driver.name);
+    }
+}
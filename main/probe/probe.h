@@ -0,0 +1,83 @@
+#pragma once
+
+#include "esp_err.h"
+#include "temperature.h"
+#include <stdint.h>
+
+typedef enum {
+    PROBE_FAULT_NONE,
+    PROBE_FAULT_OPEN,  /* Probe unplugged or cable broken */
+    PROBE_FAULT_SHORT, /* Probe or cable shorted */
+    PROBE_FAULT_RANGE, /* Reading outside what the probe can measure */
+} probe_fault_t;
+
+/**
+ * @brief One reading of one probe. temp is 0 while there is a fault
+ */
+typedef struct {
+    int32_t temp;
+    probe_fault_t fault;
+} probe_reading_t;
+
+/**
+ * @brief A source of probe readings
+ */
+typedef struct {
+    const char *name;
+    esp_err_t (*init)(void);
+    void (*deinit)(void);
+    /* Read all TEMPERATURE_PROBE_COUNT probes at once */
+    esp_err_t (*read)(probe_reading_t *readings);
+} probe_driver_t;
+
+extern const probe_driver_t probe_adc_driver;
+extern const probe_driver_t probe_replay_driver;
+extern const probe_driver_t probe_sim_driver;
+
+/**
+ * @brief Start the driver selected by CONFIG_METER_PROBE_DRIVER
+ */
+void probe_init(void);
+
+/**
+ * @brief Read all probes through the active driver
+ *
+ * @param readings TEMPERATURE_PROBE_COUNT entries
+ * @return esp_err_t Error of the driver, readings are then all marked faulty
+ */
+esp_err_t probe_read(probe_reading_t *readings);
+
+/**
+ * @brief Switch to another driver, keeping the current one if the new one fails to start
+ *
+ * @param name "adc", "replay" or "sim"
+ * @return esp_err_t ESP_ERR_NOT_FOUND for an unknown name, or the error of the driver's init
+ */
+esp_err_t probe_select(const char *name);
+
+/**
+ * @brief Name of the active driver
+ */
+const char *probe_driver_name(void);
+
+/**
+ * @brief Set how many seconds of replayed or simulated time pass per real second
+ *
+ * @param scale 1 to 1000
+ * @return esp_err_t ESP_ERR_INVALID_ARG if out of range
+ */
+esp_err_t probe_set_time_scale(uint32_t scale);
+
+uint32_t probe_get_time_scale(void);
+
+/**
+ * @brief Time seen by the replay and simulator drivers, advancing at the time scale
+ *
+ * @return int64_t Microseconds since the driver was started
+ */
+int64_t probe_time_us(void);
+
+/**
+ * @brief Short name of a fault for logs and the console
+ */
+const char *probe_fault_name(probe_fault_t fault);
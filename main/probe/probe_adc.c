@@ -0,0 +1,137 @@
+#include "probe.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <math.h>
+
+/*
+ * Each probe is an NTC thermistor to ground below a series resistor to 3.3 V,
+ * read on consecutive ADC1 channels. The divider voltage gives the thermistor
+ * resistance and the beta equation the temperature.
+ */
+
+#define SUPPLY_MV      3300
+#define OVERSAMPLE     8
+#define OPEN_MARGIN_MV 40 /* Closer to the supply than this is an unplugged probe */
+#define SHORT_LIMIT_MV 20
+#define KELVIN         273.15f
+#define TEMP_MIN       -40
+#define TEMP_MAX       400
+
+/* ESP32-S3: ADC1 channel n is on GPIO n + 1 */
+#define PROBE_GPIO_FIRST (CONFIG_METER_PROBE_ADC_FIRST_CHANNEL + 1)
+#define PROBE_GPIO_LAST  (PROBE_GPIO_FIRST + TEMPERATURE_PROBE_COUNT - 1)
+#define ON_PROBE_PIN(gpio) ((gpio) >= PROBE_GPIO_FIRST && (gpio) <= PROBE_GPIO_LAST)
+
+/* The driver can be picked at runtime, so the panel must never share a pin with a probe */
+#if CONFIG_METER_DISPLAY_PANEL_ST7789
+_Static_assert(!ON_PROBE_PIN(CONFIG_METER_DISPLAY_PIN_SCLK) && !ON_PROBE_PIN(CONFIG_METER_DISPLAY_PIN_MOSI) &&
+                   !ON_PROBE_PIN(CONFIG_METER_DISPLAY_PIN_CS) && !ON_PROBE_PIN(CONFIG_METER_DISPLAY_PIN_DC) &&
+                   !ON_PROBE_PIN(CONFIG_METER_DISPLAY_PIN_RST) && !ON_PROBE_PIN(CONFIG_METER_DISPLAY_PIN_BL),
+               "a display pin is on one of the probe ADC channels");
+#endif
+
+static const char *TAG = "probe_adc";
+
+static adc_oneshot_unit_handle_t s_adc;
+static adc_cali_handle_t s_cali[TEMPERATURE_PROBE_COUNT];
+
+static adc_channel_t channel_of(int probe) {
+    return CONFIG_METER_PROBE_ADC_FIRST_CHANNEL + probe;
+}
+
+static void adc_deinit(void) {
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        if (s_cali[i] != NULL) {
+            adc_cali_delete_scheme_curve_fitting(s_cali[i]);
+            s_cali[i] = NULL;
+        }
+    }
+    if (s_adc != NULL) {
+        adc_oneshot_del_unit(s_adc);
+        s_adc = NULL;
+    }
+}
+
+static esp_err_t adc_init(void) {
+    adc_oneshot_unit_init_cfg_t unit_config = {
+        .unit_id = ADC_UNIT_1,
+    };
+    esp_err_t err = adc_oneshot_new_unit(&unit_config, &s_adc);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT && err == ESP_OK; i++) {
+        adc_oneshot_chan_cfg_t chan_config = {
+            .atten = ADC_ATTEN_DB_12,
+            .bitwidth = ADC_BITWIDTH_DEFAULT,
+        };
+        adc_cali_curve_fitting_config_t cali_config = {
+            .unit_id = ADC_UNIT_1,
+            .chan = channel_of(i),
+            .atten = ADC_ATTEN_DB_12,
+            .bitwidth = ADC_BITWIDTH_DEFAULT,
+        };
+        err = adc_oneshot_config_channel(s_adc, channel_of(i), &chan_config);
+        if (err == ESP_OK) {
+            err = adc_cali_create_scheme_curve_fitting(&cali_config, &s_cali[i]);
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ADC setup failed: %s", esp_err_to_name(err));
+        adc_deinit();
+        return err;
+    }
+    ESP_LOGI(TAG, "NTC probes on ADC1 channels %d-%d", channel_of(0), channel_of(TEMPERATURE_PROBE_COUNT - 1));
+    return ESP_OK;
+}
+
+static void read_probe(int probe, probe_reading_t *reading) {
+    int total_mv = 0;
+    for (int n = 0; n < OVERSAMPLE; n++) {
+        int raw;
+        int mv;
+        if (adc_oneshot_read(s_adc, channel_of(probe), &raw) != ESP_OK ||
+            adc_cali_raw_to_voltage(s_cali[probe], raw, &mv) != ESP_OK) {
+            reading->fault = PROBE_FAULT_RANGE;
+            return;
+        }
+        total_mv += mv;
+    }
+    int mv = total_mv / OVERSAMPLE;
+
+    if (mv >= SUPPLY_MV - OPEN_MARGIN_MV) {
+        reading->fault = PROBE_FAULT_OPEN;
+        return;
+    }
+    if (mv <= SHORT_LIMIT_MV) {
+        reading->fault = PROBE_FAULT_SHORT;
+        return;
+    }
+    float r = (float)CONFIG_METER_PROBE_SERIES_R * mv / (SUPPLY_MV - mv);
+    float t = 1.0f / (1.0f / (25.0f + KELVIN) + logf(r / CONFIG_METER_PROBE_NTC_R25) / CONFIG_METER_PROBE_NTC_BETA);
+    reading->temp = lroundf(t - KELVIN);
+    if (reading->temp < TEMP_MIN || reading->temp > TEMP_MAX) {
+        reading->fault = PROBE_FAULT_RANGE;
+        reading->temp = 0;
+    }
+}
+
+static esp_err_t adc_read(probe_reading_t *readings) {
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        readings[i].temp = 0;
+        readings[i].fault = PROBE_FAULT_NONE;
+        read_probe(i, &readings[i]);
+    }
+    return ESP_OK;
+}
+
+const probe_driver_t probe_adc_driver = {
+    .name = "adc",
+    .init = adc_init,
+    .deinit = adc_deinit,
+    .read = adc_read,
+};
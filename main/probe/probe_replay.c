@@ -0,0 +1,147 @@
+#include "probe.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Streams a recorded cook from a CSV file, keeping only the two rows around the
+ * current replay time and interpolating between them. When the recording ends
+ * it starts over, shifted so the timeline keeps moving forward.
+ */
+
+#define LINE_MAX    128
+#define LOOP_GAP_US 1000000 /* Between the last row and the first row of the next pass */
+
+typedef struct {
+    int64_t time_us;
+    float temp[TEMPERATURE_PROBE_COUNT];
+    bool open[TEMPERATURE_PROBE_COUNT];
+} replay_row_t;
+
+static const char *TAG = "probe_replay";
+
+static FILE *s_file;
+static replay_row_t s_prev;
+static replay_row_t s_next;
+static int64_t s_first_us;       /* Timestamp of the first row in the file */
+static int64_t s_loop_offset_us; /* Added to file timestamps to get replay time */
+static int64_t s_last_row_us;    /* Replay time of the last row consumed */
+
+/* Parse "seconds,t1,t2,t3,t4", returns false for headers, comments and malformed lines */
+static bool parse_row(char *line, replay_row_t *row) {
+    char *end;
+    double seconds = strtod(line, &end);
+    if (end == line || *end != ',') {
+        return false;
+    }
+    row->time_us = (int64_t)(seconds * 1000000);
+    char *field = end + 1;
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        float value = strtof(field, &end);
+        row->open[i] = end == field;
+        row->temp[i] = row->open[i] ? 0 : value;
+        field = strchr(end, ',');
+        if (field == NULL) {
+            /* Missing trailing fields are disconnected probes */
+            for (i++; i < TEMPERATURE_PROBE_COUNT; i++) {
+                row->open[i] = true;
+                row->temp[i] = 0;
+            }
+            break;
+        }
+        field++;
+    }
+    return true;
+}
+
+/* Read the next row, starting the recording over at its end */
+static bool next_row(replay_row_t *row) {
+    char line[LINE_MAX];
+    for (int pass = 0; pass < 2; pass++) {
+        while (fgets(line, sizeof(line), s_file) != NULL) {
+            if (parse_row(line, row)) {
+                row->time_us += s_loop_offset_us;
+                return true;
+            }
+        }
+        rewind(s_file);
+        s_loop_offset_us = s_last_row_us + LOOP_GAP_US - s_first_us;
+    }
+    return false;
+}
+
+static void replay_deinit(void) {
+    if (s_file != NULL) {
+        fclose(s_file);
+        s_file = NULL;
+    }
+}
+
+static esp_err_t replay_init(void) {
+    s_file = fopen(CONFIG_METER_PROBE_REPLAY_PATH, "r");
+    if (s_file == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s", CONFIG_METER_PROBE_REPLAY_PATH);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_first_us = 0;
+    s_loop_offset_us = 0;
+    s_last_row_us = 0;
+    if (!next_row(&s_prev)) {
+        ESP_LOGE(TAG, "No samples in %s", CONFIG_METER_PROBE_REPLAY_PATH);
+        replay_deinit();
+        return ESP_ERR_INVALID_SIZE;
+    }
+    /* The recording starts at replay time 0 whatever its first timestamp is */
+    s_first_us = s_prev.time_us;
+    s_loop_offset_us = -s_first_us;
+    s_prev.time_us = 0;
+    s_next = s_prev;
+    s_last_row_us = 0;
+    ESP_LOGI(TAG, "Replaying %s", CONFIG_METER_PROBE_REPLAY_PATH);
+    return ESP_OK;
+}
+
+static esp_err_t replay_read(probe_reading_t *readings) {
+    int64_t now = probe_time_us();
+    while (s_next.time_us <= now) {
+        s_prev = s_next;
+        s_last_row_us = s_prev.time_us;
+        if (!next_row(&s_next) || s_next.time_us <= s_prev.time_us) {
+            /* A single-row file or timestamps going backwards, hold the last row */
+            s_next = s_prev;
+            s_next.time_us = now + 1;
+            break;
+        }
+    }
+
+    int64_t span = s_next.time_us - s_prev.time_us;
+    float frac = span > 0 ? (float)(now - s_prev.time_us) / span : 0;
+    if (frac < 0) {
+        frac = 0;
+    }
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        if (s_prev.open[i]) {
+            readings[i].temp = 0;
+            readings[i].fault = PROBE_FAULT_OPEN;
+        } else if (s_next.open[i]) {
+            /* Unplugged at the next row, hold the last reading until then */
+            readings[i].temp = lroundf(s_prev.temp[i]);
+            readings[i].fault = PROBE_FAULT_NONE;
+        } else {
+            readings[i].temp = lroundf(s_prev.temp[i] + (s_next.temp[i] - s_prev.temp[i]) * frac);
+            readings[i].fault = PROBE_FAULT_NONE;
+        }
+    }
+    return ESP_OK;
+}
+
+const probe_driver_t probe_replay_driver = {
+    .name = "replay",
+    .init = replay_init,
+    .deinit = replay_deinit,
+    .read = replay_read,
+};
@@ -0,0 +1,130 @@
+#include "probe.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include <math.h>
+#include <stdbool.h>
+
+/*
+ * Simulated cook, integrated in one-second steps of probe time:
+ *
+ * - Probe 1 is the pit. It heats from ambient towards its set point with a
+ *   first-order lag and swings a few degrees as the fire breathes.
+ * - Probes 2-4 are cuts of meat heated by the pit (Newton's law of heating).
+ *   Around 65-75 C moisture evaporating from the surface cools them about as
+ *   fast as the pit heats them, which flattens the curve for hours: the stall.
+ *   The cooling fades as the surface dries out.
+ * - Every probe is unplugged now and then for a minute or two.
+ */
+
+#define STEP_S         1.0f
+#define MAX_STEPS      20000 /* Per read, the rest of a longer gap is skipped */
+#define AMBIENT_C      20.0f
+#define PIT_SET_C      115.0f
+#define PIT_TAU_S      900.0f
+#define PIT_SWING_C    4.0f
+#define PIT_SWING_S    1200.0f
+#define STALL_C        70.0f
+#define STALL_WIDTH_C  6.0f
+#define UNPLUG_EVERY_S (4 * 3600) /* Mean time between disconnects of one probe */
+#define UNPLUG_MIN_S   30
+#define UNPLUG_MAX_S   120
+
+static const char *TAG = "probe_sim";
+
+typedef struct {
+    float heat_tau_s; /* Time constant of heating by the pit */
+    float stall_s;    /* Approximate length of the stall */
+} cut_t;
+
+/* Probes 2-4: a pork tenderloin, a pork shoulder and a brisket */
+static const cut_t s_cuts[TEMPERATURE_PROBE_COUNT - 1] = {
+    {.heat_tau_s = 1.5f * 3600, .stall_s = 0.5f * 3600},
+    {.heat_tau_s = 4.0f * 3600, .stall_s = 3.0f * 3600},
+    {.heat_tau_s = 6.0f * 3600, .stall_s = 5.0f * 3600},
+};
+
+static struct {
+    int64_t step; /* Number of steps integrated so far */
+    float pit;
+    float meat[TEMPERATURE_PROBE_COUNT - 1];
+    float moisture[TEMPERATURE_PROBE_COUNT - 1];
+    uint32_t unplugged_left[TEMPERATURE_PROBE_COUNT]; /* Steps until the probe is back */
+    uint32_t rng;
+} s_sim;
+
+/* xorshift32, cheaper than esp_random() in the inner loop and reproducible from the seed */
+static uint32_t next_random(void) {
+    uint32_t x = s_sim.rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_sim.rng = x;
+    return x;
+}
+
+static void step(void) {
+    float t = s_sim.step * STEP_S;
+    float pit_target = PIT_SET_C + PIT_SWING_C * sinf(2 * (float)M_PI * t / PIT_SWING_S);
+    s_sim.pit += (pit_target - s_sim.pit) * STEP_S / PIT_TAU_S;
+
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT - 1; i++) {
+        const cut_t *cut = &s_cuts[i];
+        float heating = (s_sim.pit - s_sim.meat[i]) / cut->heat_tau_s;
+        /* Evaporation peaks in the stall band and at most cancels the heating it would get there */
+        float band = (s_sim.meat[i] - STALL_C) / STALL_WIDTH_C;
+        float evaporation = s_sim.moisture[i] * expf(-band * band) * (PIT_SET_C - STALL_C) / cut->heat_tau_s;
+        s_sim.meat[i] += (heating - evaporation) * STEP_S;
+        s_sim.moisture[i] -= s_sim.moisture[i] * expf(-band * band) * STEP_S / cut->stall_s;
+    }
+
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        if (s_sim.unplugged_left[i] > 0) {
+            s_sim.unplugged_left[i]--;
+        } else if (next_random() % UNPLUG_EVERY_S == 0) {
+            s_sim.unplugged_left[i] = UNPLUG_MIN_S + next_random() % (UNPLUG_MAX_S - UNPLUG_MIN_S);
+        }
+    }
+    s_sim.step++;
+}
+
+static esp_err_t sim_init(void) {
+    s_sim.step = 0;
+    s_sim.pit = AMBIENT_C;
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT - 1; i++) {
+        s_sim.meat[i] = AMBIENT_C / 4; /* Straight from the fridge */
+        s_sim.moisture[i] = 1.0f;
+    }
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        s_sim.unplugged_left[i] = 0;
+    }
+    s_sim.rng = esp_random() | 1;
+    return ESP_OK;
+}
+
+static void sim_deinit(void) {
+}
+
+static esp_err_t sim_read(probe_reading_t *readings) {
+    int64_t due = probe_time_us() / (int64_t)(STEP_S * 1000000);
+    if (due - s_sim.step > MAX_STEPS) {
+        ESP_LOGW(TAG, "Skipping %lld s of simulation", (due - s_sim.step - MAX_STEPS) * (int64_t)STEP_S);
+        s_sim.step = due - MAX_STEPS;
+    }
+    while (s_sim.step < due) {
+        step();
+    }
+
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        float temp = i == 0 ? s_sim.pit : s_sim.meat[i - 1];
+        readings[i].fault = s_sim.unplugged_left[i] > 0 ? PROBE_FAULT_OPEN : PROBE_FAULT_NONE;
+        readings[i].temp = readings[i].fault == PROBE_FAULT_NONE ? lroundf(temp) : 0;
+    }
+    return ESP_OK;
+}
+
+const probe_driver_t probe_sim_driver = {
+    .name = "sim",
+    .init = sim_init,
+    .deinit = sim_deinit,
+    .read = sim_read,
+};
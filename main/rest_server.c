@@ -1,14 +1,37 @@
+#include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <sys/param.h>
+#include "rest_server.h"
 #include "esp_http_server.h"
+#if CONFIG_METER_HTTPS_ENABLE
+#include "esp_https_server.h"
+#define REST_HTTPS_ENABLED true
+#else
+#define REST_HTTPS_ENABLED false
+#endif
 #include "esp_chip_info.h"
 #include "esp_log.h"
+#include "esp_ota_ops.h"
 #include "esp_vfs.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
+#include "cbor.h"
 #include "wifi_scan.h"
 #include "wifi_sta.h"
 #include "settings.h"
 #include "temperature.h"
+#include "ota.h"
+#include "webui.h"
+#include "log_ring.h"
+#include "json_body.h"
+#include "buf_pool.h"
+#include "mem.h"
+#include "session.h"
+#include "https.h"
+#include "router.h"
+#include "checkpoint.h"
 
 static const char *REST_TAG = "esp-rest";
 #define REST_CHECK(a, str, goto_tag, ...)                                              \
@@ -22,35 +45,185 @@ static const char *REST_TAG = "esp-rest";
     } while (0)
 
 #define FILE_PATH_MAX (ESP_VFS_PATH_MAX + 128)
-#define SCRATCH_BUFSIZE (10240)
 
 typedef struct rest_server_context {
     char base_path[ESP_VFS_PATH_MAX + 1];
-    char scratch[SCRATCH_BUFSIZE];
 } rest_server_context_t;
 
-#define CHECK_FILE_EXTENSION(filename, ext) (strcasecmp(&filename[strlen(filename) - strlen(ext)], ext) == 0)
+#define CBOR_CONTENT_TYPE "application/cbor"
+/* Receive timeouts in a row, of recv_wait_timeout seconds each, before a stalled upload is given up on */
+#define RECV_TIMEOUTS_MAX 3
+#define JSON_BODY_MAX     1024
+#define JSON_BODY_CHUNK   128
+#define TEMP_TARGET_MAX   300
+
+#define BATCH_TEMP    (1 << 0)
+#define BATCH_STATION (1 << 1)
+#define BATCH_SYSTEM  (1 << 2)
+#define BATCH_ALL     (BATCH_TEMP | BATCH_STATION | BATCH_SYSTEM)
+
+#define SESSION_LIST_MAX   16
+#define SESSION_LINE_MAX   96 /* Longest CSV or NDJSON line of one sample */
+#define SESSION_READ_BATCH 16
+
+/* Middleware a route runs through, bit n selects s_middleware[n] */
+#define REST_MW_TIMING (1 << 0)
+#define REST_MW_AUTH   (1 << 1)
+#define REST_MW_TOKEN  (1 << 2)
+#define REST_OPEN      REST_MW_TIMING
+#define REST_GUARDED   (REST_MW_TIMING | REST_MW_AUTH)
+/* Writes flash the device boots or serves from, so it is refused outright while no token is configured */
+#define REST_FLASHING  (REST_GUARDED | REST_MW_TOKEN)
+
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    uint32_t middleware;
+} rest_route_t;
+
+/* What the API dispatcher hands its handlers as req->user_ctx */
+typedef struct {
+    size_t index; /* Of the route in the table */
+    router_params_t params;
+    int64_t start_us;
+} rest_call_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t errors;
+    uint32_t max_us;
+    uint64_t total_us;
+} rest_route_stats_t;
+
+/* Counters for judging how much traffic the web UI causes */
+static uint32_t s_http_connections;
+static uint32_t s_api_responses;
+static uint64_t s_api_response_bytes;
+static uint32_t s_auth_failures;
+
+/* Route table of the API, built when the server starts */
+static router_t s_router;
+static rest_route_stats_t s_route_stats[ROUTER_MAX_ROUTES];
+
+/* Figures of the last session export */
+static uint32_t s_export_bytes;
+static uint32_t s_export_us;
+static uint32_t s_export_heap; /* Largest drop of free internal heap while it ran */
 
 /* Set HTTP response content type according to file extension */
 static esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filepath)
 {
+    static const struct {
+        const char *ext;
+        const char *type;
+    } types[] = {
+        {".html", "text/html"},
+        {".js", "application/javascript"},
+        {".css", "text/css"},
+        {".json", "application/json"},
+        {".txt", "text/plain"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".webp", "image/webp"},
+        {".ico", "image/x-icon"},
+        {".svg", "image/svg+xml"},
+        {".woff2", "font/woff2"},
+        {".woff", "font/woff"},
+        {".ttf", "font/ttf"},
+        {".webmanifest", "application/manifest+json"},
+        {".map", "application/json"},
+        {".wasm", "application/wasm"},
+    };
     const char *type = "text/plain";
-    if (CHECK_FILE_EXTENSION(filepath, ".html")) {
-        type = "text/html";
-    } else if (CHECK_FILE_EXTENSION(filepath, ".js")) {
-        type = "application/javascript";
-    } else if (CHECK_FILE_EXTENSION(filepath, ".css")) {
-        type = "text/css";
-    } else if (CHECK_FILE_EXTENSION(filepath, ".png")) {
-        type = "image/png";
-    } else if (CHECK_FILE_EXTENSION(filepath, ".ico")) {
-        type = "image/x-icon";
-    } else if (CHECK_FILE_EXTENSION(filepath, ".svg")) {
-        type = "text/xml";
+    size_t len = strlen(filepath);
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        size_t ext_len = strlen(types[i].ext);
+        if (len >= ext_len && strcasecmp(&filepath[len - ext_len], types[i].ext) == 0) {
+            type = types[i].type;
+            break;
+        }
     }
     return httpd_resp_set_type(req, type);
 }
 
+/* Check whether an Accept or Accept-Encoding value lists a media type or encoding without q=0 */
+static bool rest_accepts(const char *accept, const char *value)
+{
+    size_t len = strlen(value);
+    for (const char *token = accept; *token != '\0'; token += strcspn(token, ",")) {
+        token += strspn(token, ", ");
+        if (strncasecmp(token, value, len) != 0 || (token[len] != '\0' && strchr(",; ", token[len]) == NULL)) {
+            continue;
+        }
+        const char *params = token + len;
+        const char *q = strstr(params, "q=");
+        const char *next = strchr(params, ',');
+        return q == NULL || (next != NULL && q > next) || strtod(q + 2, NULL) > 0;
+    }
+    return false;
+}
+
+/*
+ * Swap filepath for a precompressed variant of uri_path the client accepts and
+ * return its encoding, or NULL to send the file as is. Responses for paths that
+ * have variants depend on Accept-Encoding, which caches have to know.
+ */
+static const char *rest_select_encoding(httpd_req_t *req, const char *uri_path, char *filepath, size_t filepath_size)
+{
+    static const struct {
+        const char *name;
+        const char *suffix;
+    } encodings[] = {
+#if CONFIG_METER_WEBUI_BROTLI
+        {"br", ".br"},
+#endif
+        {"gzip", ".gz"},
+    };
+    char accept[128];
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        accept[0] = '\0';
+    }
+
+    char variant[FILE_PATH_MAX];
+    bool has_variant = false;
+    for (size_t i = 0; i < sizeof(encodings) / sizeof(encodings[0]); i++) {
+        if (webui_resolve_encoded(uri_path, encodings[i].suffix, variant, sizeof(variant)) != ESP_OK) {
+            continue;
+        }
+        has_variant = true;
+        if (rest_accepts(accept, encodings[i].name)) {
+            strlcpy(filepath, variant, filepath_size);
+            httpd_resp_set_hdr(req, "Content-Encoding", encodings[i].name);
+            httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+            return encodings[i].name;
+        }
+    }
+    if (has_variant) {
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    }
+    return NULL;
+}
+
+/* Count new client connections, each of which costs a TCP (and with HTTPS a TLS) handshake */
+static esp_err_t rest_on_open(httpd_handle_t hd, int sockfd)
+{
+    s_http_connections++;
+    return ESP_OK;
+}
+
+/* Check out a request buffer, answering 503 if the pool stays exhausted */
+static void *rest_get_buffer(httpd_req_t *req, buf_pool_class_t cls)
+{
+    void *buf = buf_pool_get(cls);
+    if (buf == NULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_sendstr(req, "Server busy, retry later");
+    }
+    return buf;
+}
+
 /* Send HTTP response with the contents of the requested file */
 static esp_err_t rest_common_get_handler(httpd_req_t *req)
 {
@@ -58,7 +231,6 @@ static esp_err_t rest_common_get_handler(httpd_req_t *req)
     char uri_path[256];
 
     rest_server_context_t *rest_context = (rest_server_context_t *)req->user_ctx;
-    strlcpy(filepath, rest_context->base_path, sizeof(filepath));
     
     // Copy URI and strip query parameters
     strlcpy(uri_path, req->uri, sizeof(uri_path));
@@ -68,24 +240,16 @@ static esp_err_t rest_common_get_handler(httpd_req_t *req)
     }
     
     ESP_LOGI(REST_TAG, "URI: %s, base_path: %s", uri_path, rest_context->base_path);
-    
-    if (uri_path[strlen(uri_path) - 1] == '/') {
-        strlcat(filepath, "/index.html", sizeof(filepath));
-    } else {
-        strlcat(filepath, uri_path, sizeof(filepath));
-        
-        // Check if the file exists, if not try adding /index.html for SPA routing
-        int test_fd = open(filepath, O_RDONLY, 0);
-        if (test_fd == -1) {
-            // File doesn't exist, try with /index.html for directory routes
-            strlcat(filepath, "/index.html", sizeof(filepath));
-        } else {
-            close(test_fd);
-        }
+
+    if (webui_resolve(uri_path, sizeof(uri_path), filepath, sizeof(filepath)) != ESP_OK) {
+        ESP_LOGE(REST_TAG, "No file for URI: %s", uri_path);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_FAIL;
     }
-    
-    ESP_LOGI(REST_TAG, "Final filepath: %s", filepath);
-    
+
+    const char *encoding = rest_select_encoding(req, uri_path, filepath, sizeof(filepath));
+    ESP_LOGI(REST_TAG, "Final filepath: %s%s%s", filepath, encoding ? ", encoding: " : "", encoding ? encoding : "");
+
     int fd = open(filepath, O_RDONLY, 0);
     if (fd == -1) {
         ESP_LOGE(REST_TAG, "Failed to open file : %s", filepath);
@@ -93,20 +257,26 @@ static esp_err_t rest_common_get_handler(httpd_req_t *req)
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
         return ESP_FAIL;
     }
+    char *chunk = rest_get_buffer(req, BUF_POOL_LARGE);
+    if (chunk == NULL) {
+        close(fd);
+        return ESP_FAIL;
+    }
 
-    set_content_type_from_file(req, filepath);
+    /* Uploaded UI files are stored under their hash, so the type comes from the URI */
+    set_content_type_from_file(req, uri_path);
 
-    char *chunk = rest_context->scratch;
     ssize_t read_bytes;
     do {
-        /* Read file in chunks into the scratch buffer */
-        read_bytes = read(fd, chunk, SCRATCH_BUFSIZE);
+        /* Read file in chunks into the request buffer */
+        read_bytes = read(fd, chunk, buf_pool_size(BUF_POOL_LARGE));
         if (read_bytes == -1) {
             ESP_LOGE(REST_TAG, "Failed to read file : %s", filepath);
         } else if (read_bytes > 0) {
             /* Send the buffer contents as HTTP response chunk */
             if (httpd_resp_send_chunk(req, chunk, read_bytes) != ESP_OK) {
                 close(fd);
+                buf_pool_put(chunk);
                 ESP_LOGE(REST_TAG, "File sending failed!");
                 /* Abort sending file */
                 httpd_resp_sendstr_chunk(req, NULL);
@@ -118,104 +288,371 @@ static esp_err_t rest_common_get_handler(httpd_req_t *req)
     } while (read_bytes > 0);
     /* Close file after sending complete */
     close(fd);
+    buf_pool_put(chunk);
     ESP_LOGI(REST_TAG, "File sending complete: %s", filepath);
     /* Respond with an empty chunk to signal HTTP response completion */
     httpd_resp_send_chunk(req, NULL, 0);
     return ESP_OK;
 }
 
+/* Check whether the client asked for CBOR instead of the default JSON */
+static bool rest_accepts_cbor(httpd_req_t *req)
+{
+    char accept[128];
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    return rest_accepts(accept, CBOR_CONTENT_TYPE);
+}
+
+/* Send a JSON document and free it */
+static esp_err_t rest_send_json(httpd_req_t *req, cJSON *root, int64_t start_us)
+{
+    const char *response = cJSON_Print(root);
+    cJSON_Delete(root);
+    if (response == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to encode response");
+        return ESP_FAIL;
+    }
+    ESP_LOGD(REST_TAG, "%s: %d bytes JSON in %lld us", req->uri, strlen(response), esp_timer_get_time() - start_us);
+    s_api_responses++;
+    s_api_response_bytes += strlen(response);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_sendstr(req, response);
+    cJSON_free((void *)response);
+    return err;
+}
+
+/* Send a CBOR document encoded by root into buf and return buf to the pool */
+static esp_err_t rest_send_cbor(httpd_req_t *req, CborEncoder *root, uint8_t *buf, int64_t start_us)
+{
+    if (cbor_encoder_get_extra_bytes_needed(root) > 0) {
+        ESP_LOGE(REST_TAG, "%s: CBOR buffer too small by %d bytes", req->uri, cbor_encoder_get_extra_bytes_needed(root));
+        buf_pool_put(buf);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to encode response");
+        return ESP_FAIL;
+    }
+    size_t len = cbor_encoder_get_buffer_size(root, buf);
+    ESP_LOGD(REST_TAG, "%s: %d bytes CBOR in %lld us", req->uri, len, esp_timer_get_time() - start_us);
+    s_api_responses++;
+    s_api_response_bytes += len;
+    httpd_resp_set_type(req, CBOR_CONTENT_TYPE);
+    esp_err_t err = httpd_resp_send(req, (const char *)buf, len);
+    buf_pool_put(buf);
+    return err;
+}
+
+/* Stream a JSON request body through a schema parser, answering with 4xx if it does not match */
+static esp_err_t rest_parse_json_body(httpd_req_t *req, json_body_t *parser)
+{
+    char chunk[JSON_BODY_CHUNK];
+    int remaining = req->content_len;
+
+    if (remaining <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
+        return ESP_FAIL;
+    }
+    if (remaining > JSON_BODY_MAX) {
+        httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "content too long");
+        return ESP_FAIL;
+    }
+    int timeouts = 0;
+    while (remaining > 0) {
+        int received = httpd_req_recv(req, chunk, MIN(remaining, sizeof(chunk)));
+        if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+            if (++timeouts < RECV_TIMEOUTS_MAX) {
+                continue;
+            }
+            httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Timed out receiving data");
+            return ESP_FAIL;
+        }
+        timeouts = 0;
+        if (received <= 0) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive data");
+            return ESP_FAIL;
+        }
+        remaining -= received;
+        if (json_body_feed(parser, chunk, received) != ESP_OK) {
+            break;
+        }
+    }
+    if (json_body_finish(parser) != ESP_OK) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "%s at byte %u", json_body_error(parser), parser->offset);
+        ESP_LOGW(REST_TAG, "%s: %s", req->uri, msg);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, msg);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 /* Simple handler for getting system handler */
 static esp_err_t system_info_get_handler(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "application/json");
-    cJSON *root = cJSON_CreateObject();
+    int64_t start_us = esp_timer_get_time();
     esp_chip_info_t chip_info;
     esp_chip_info(&chip_info);
+
+    if (rest_accepts_cbor(req)) {
+        uint8_t *buf = rest_get_buffer(req, BUF_POOL_SMALL);
+        if (buf == NULL) {
+            return ESP_FAIL;
+        }
+        CborEncoder root, map;
+        cbor_encoder_init(&root, buf, buf_pool_size(BUF_POOL_SMALL), 0);
+        cbor_encoder_create_map(&root, &map, 2);
+        cbor_encode_text_stringz(&map, "version");
+        cbor_encode_text_stringz(&map, IDF_VER);
+        cbor_encode_text_stringz(&map, "cores");
+        cbor_encode_int(&map, chip_info.cores);
+        cbor_encoder_close_container(&root, &map);
+        return rest_send_cbor(req, &root, buf, start_us);
+    }
+
+    cJSON *root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "version", IDF_VER);
     cJSON_AddNumberToObject(root, "cores", chip_info.cores);
-    const char *sys_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, sys_info);
-    free((void *)sys_info);
-    cJSON_Delete(root);
-    return ESP_OK;
+    return rest_send_json(req, root, start_us);
+}
+
+static const char *temp_keys[TEMPERATURE_PROBE_COUNT] = {"temp_0", "temp_1", "temp_2", "temp_3"};
+static const char *target_keys[TEMPERATURE_PROBE_COUNT] = {"temp_0_target", "temp_1_target", "temp_2_target",
+                                                           "temp_3_target"};
+
+/*
+ * Add the probe readings and targets of a snapshot to a JSON object. seq and
+ * time_ms, the uptime the sample was taken at, tell a client polling faster than
+ * the sampler whether it got a new sample
+ */
+void rest_add_temp_json(cJSON *obj, const temperature_snapshot_t *snapshot)
+{
+    cJSON_AddNumberToObject(obj, "seq", snapshot->seq);
+    cJSON_AddNumberToObject(obj, "time_ms", snapshot->timestamp_us / 1000);
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        cJSON_AddNumberToObject(obj, temp_keys[i], snapshot->temp[i]);
+    }
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        cJSON_AddNumberToObject(obj, target_keys[i], snapshot->target[i]);
+    }
+    cJSON_AddNumberToObject(obj, "faults", snapshot->fault_mask);
+}
+
+/* Encode the probe readings and targets of a snapshot as a CBOR map */
+void rest_encode_temp_cbor(CborEncoder *parent, const temperature_snapshot_t *snapshot)
+{
+    CborEncoder map;
+    cbor_encoder_create_map(parent, &map, 2 * TEMPERATURE_PROBE_COUNT + 3);
+    cbor_encode_text_stringz(&map, "seq");
+    cbor_encode_uint(&map, snapshot->seq);
+    cbor_encode_text_stringz(&map, "time_ms");
+    cbor_encode_uint(&map, snapshot->timestamp_us / 1000);
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        cbor_encode_text_stringz(&map, temp_keys[i]);
+        cbor_encode_int(&map, snapshot->temp[i]);
+    }
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        cbor_encode_text_stringz(&map, target_keys[i]);
+        cbor_encode_int(&map, snapshot->target[i]);
+    }
+    cbor_encode_text_stringz(&map, "faults");
+    cbor_encode_uint(&map, snapshot->fault_mask);
+    cbor_encoder_close_container(parent, &map);
 }
 
-/* Simple handler for getting temperature data */
+/* Handler for the latest probe readings, as taken by the sampler */
 static esp_err_t temperature_data_get_handler(httpd_req_t *req)
 {
-    httpd_resp_set_type(req, "application/json");
+    int64_t start_us = esp_timer_get_time();
+    temperature_snapshot_t snapshot;
+    temperature_get_snapshot(&snapshot);
+
+    if (rest_accepts_cbor(req)) {
+        uint8_t *buf = rest_get_buffer(req, BUF_POOL_SMALL);
+        if (buf == NULL) {
+            return ESP_FAIL;
+        }
+        CborEncoder root;
+        cbor_encoder_init(&root, buf, buf_pool_size(BUF_POOL_SMALL), 0);
+        rest_encode_temp_cbor(&root, &snapshot);
+        return rest_send_cbor(req, &root, buf, start_us);
+    }
+
     cJSON *root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "temp_0", temperature_get_value(0));
-    cJSON_AddNumberToObject(root, "temp_1", temperature_get_value(1));
-    cJSON_AddNumberToObject(root, "temp_2", temperature_get_value(2));
-    cJSON_AddNumberToObject(root, "temp_3", temperature_get_value(3));
-
-    int32_t temp_0, temp_1, temp_2, temp_3;
-    settings_get_temp_target(&temp_0, &temp_1, &temp_2, &temp_3);
-    cJSON_AddNumberToObject(root, "temp_0_target", temp_0);
-    cJSON_AddNumberToObject(root, "temp_1_target", temp_1);
-    cJSON_AddNumberToObject(root, "temp_2_target", temp_2);
-    cJSON_AddNumberToObject(root, "temp_3_target", temp_3);
-
-    const char *sys_info = cJSON_Print(root);
-    httpd_resp_sendstr(req, sys_info);
-    free((void *)sys_info);
-    cJSON_Delete(root);
-    return ESP_OK;
+    rest_add_temp_json(root, &snapshot);
+    return rest_send_json(req, root, start_us);
 }
 
-/* Handler for setting target temperature */
-static esp_err_t temperature_set_target_handler(httpd_req_t *req) {
-    int total_len = req->content_len;
-    int cur_len = 0;
-    char *buf = ((rest_server_context_t *)(req->user_ctx))->scratch;
-    int received = 0;
-    if (total_len >= SCRATCH_BUFSIZE) {
-        /* Respond with 500 Internal Server Error */
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "content too long");
+/* Parse ?include=temp,station,system into BATCH_* bits, all resources if absent. 0 if a name is unknown */
+static uint32_t batch_parse_include(httpd_req_t *req)
+{
+    static const char *names[] = {"temp", "station", "system"};
+    char query[96], include[64];
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "include", include, sizeof(include)) != ESP_OK) {
+        return BATCH_ALL;
+    }
+    uint32_t mask = 0;
+    char *save;
+    for (char *name = strtok_r(include, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)) {
+        int i = 0;
+        while (i < 3 && strcmp(name, names[i]) != 0) {
+            i++;
+        }
+        if (i == 3) {
+            return 0;
+        }
+        mask |= 1 << i;
+    }
+    return mask;
+}
+
+/* Handler combining several resources in one response, so the dashboard needs one request per refresh */
+static esp_err_t batch_get_handler(httpd_req_t *req)
+{
+    int64_t start_us = esp_timer_get_time();
+    uint32_t include = batch_parse_include(req);
+    if (include == 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "include must list temp, station or system");
         return ESP_FAIL;
     }
-    while (cur_len < total_len) {
-        received = httpd_req_recv(req, buf + cur_len, total_len);
-        if (received <= 0) {
-            /* Respond with 500 Internal Server Error */
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to post control value");
+
+    /* All resources come from state kept in RAM, nothing here touches the radio or flash */
+    temperature_snapshot_t snapshot;
+    uint8_t ssid[33] = {0};
+    esp_chip_info_t chip_info;
+    if (include & BATCH_TEMP) {
+        temperature_get_snapshot(&snapshot);
+    }
+    if (include & BATCH_STATION) {
+        wifi_get_station_ssid(ssid, sizeof(ssid) - 1);
+    }
+    if (include & BATCH_SYSTEM) {
+        esp_chip_info(&chip_info);
+    }
+
+    if (rest_accepts_cbor(req)) {
+        uint8_t *buf = rest_get_buffer(req, BUF_POOL_SMALL);
+        if (buf == NULL) {
             return ESP_FAIL;
         }
-        cur_len += received;
+        CborEncoder root, map, resource;
+        cbor_encoder_init(&root, buf, buf_pool_size(BUF_POOL_SMALL), 0);
+        cbor_encoder_create_map(&root, &map, __builtin_popcount(include));
+        if (include & BATCH_TEMP) {
+            cbor_encode_text_stringz(&map, "temp");
+            rest_encode_temp_cbor(&map, &snapshot);
+        }
+        if (include & BATCH_STATION) {
+            cbor_encode_text_stringz(&map, "station");
+            cbor_encoder_create_map(&map, &resource, 1);
+            cbor_encode_text_stringz(&resource, "ssid");
+            cbor_encode_text_stringz(&resource, (char *)ssid);
+            cbor_encoder_close_container(&map, &resource);
+        }
+        if (include & BATCH_SYSTEM) {
+            cbor_encode_text_stringz(&map, "system");
+            cbor_encoder_create_map(&map, &resource, 2);
+            cbor_encode_text_stringz(&resource, "version");
+            cbor_encode_text_stringz(&resource, IDF_VER);
+            cbor_encode_text_stringz(&resource, "cores");
+            cbor_encode_int(&resource, chip_info.cores);
+            cbor_encoder_close_container(&map, &resource);
+        }
+        cbor_encoder_close_container(&root, &map);
+        return rest_send_cbor(req, &root, buf, start_us);
     }
-    buf[total_len] = '\0';
 
-    cJSON *root = cJSON_Parse(buf);
-    cJSON *temp_0 = cJSON_GetObjectItem(root, "temp_0");
-    cJSON *temp_1 = cJSON_GetObjectItem(root, "temp_1");
-    cJSON *temp_2 = cJSON_GetObjectItem(root, "temp_2");
-    cJSON *temp_3 = cJSON_GetObjectItem(root, "temp_3");
-    ESP_LOGI(REST_TAG, "Target temperature set to %d", temp_0->valueint);
-    ESP_LOGI(REST_TAG, "Target temperature set to %d", temp_1->valueint);
-    ESP_LOGI(REST_TAG, "Target temperature set to %d", temp_2->valueint);
-    ESP_LOGI(REST_TAG, "Target temperature set to %d", temp_3->valueint);
-    cJSON_Delete(root);
-    settings_set_temp_target(temp_0->valueint, temp_1->valueint, temp_2->valueint, temp_3->valueint);
-    httpd_resp_sendstr(req, "targets updated");
-    return ESP_OK;
+    cJSON *root = cJSON_CreateObject();
+    if (include & BATCH_TEMP) {
+        rest_add_temp_json(cJSON_AddObjectToObject(root, "temp"), &snapshot);
+    }
+    if (include & BATCH_STATION) {
+        cJSON *station = cJSON_AddObjectToObject(root, "station");
+        cJSON_AddStringToObject(station, "ssid", (char *)ssid);
+    }
+    if (include & BATCH_SYSTEM) {
+        cJSON *system = cJSON_AddObjectToObject(root, "system");
+        cJSON_AddStringToObject(system, "version", IDF_VER);
+        cJSON_AddNumberToObject(system, "cores", chip_info.cores);
+    }
+    return rest_send_json(req, root, start_us);
 }
 
-/* Handler for WiFi scan */
-static esp_err_t wifi_scan_get_handler(httpd_req_t *req)
+/* Handler for setting target temperatures. POST needs all probes, PATCH only the ones to change */
+static esp_err_t temperature_set_target_handler(httpd_req_t *req)
 {
+    static const char *keys[4] = {"temp_0", "temp_1", "temp_2", "temp_3"};
+    bool patch = req->method == HTTP_PATCH;
+    int32_t targets[4] = {0};
+    settings_get_temp_target(&targets[0], &targets[1], &targets[2], &targets[3]);
+
+    int32_t parsed[4];
+    json_field_t fields[4];
+    for (int i = 0; i < 4; i++) {
+        fields[i] = (json_field_t){keys[i], JSON_FIELD_INT, &parsed[i], 0, 0, TEMP_TARGET_MAX, !patch};
+    }
+    json_body_t parser;
+    json_body_init(&parser, fields, 4);
+    if (rest_parse_json_body(req, &parser) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    bool changed = false;
+    for (int i = 0; i < 4; i++) {
+        if (json_body_has(&parser, i)) {
+            ESP_LOGI(REST_TAG, "Target temperature of probe %d set to %ld", i, parsed[i]);
+            targets[i] = parsed[i];
+            changed = true;
+        }
+    }
+    if (!changed) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No target given");
+        return ESP_FAIL;
+    }
+    settings_set_temp_target(targets[0], targets[1], targets[2], targets[3]);
+    temperature_refresh_targets();
     httpd_resp_set_type(req, "application/json");
-    
-    // Maximum number of APs to scan
-    #define MAX_AP_SCAN 10
-    wifi_ap_record_t ap_info[MAX_AP_SCAN];
+    httpd_resp_sendstr(req, "{\"message\":\"targets updated\",\"success\":true}");
+    return ESP_OK;
+}
+
+// Maximum number of APs to scan
+#define MAX_AP_SCAN 10
+
+/* Send the networks a scan found */
+static esp_err_t wifi_scan_send(httpd_req_t *req, const wifi_ap_record_t *ap_info, int ap_count)
+{
+    int64_t start_us = esp_timer_get_time();
+    if (rest_accepts_cbor(req)) {
+        uint8_t *buf = rest_get_buffer(req, BUF_POOL_SMALL);
+        if (buf == NULL) {
+            return ESP_FAIL;
+        }
+        CborEncoder root, map, networks, network;
+        cbor_encoder_init(&root, buf, buf_pool_size(BUF_POOL_SMALL), 0);
+        cbor_encoder_create_map(&root, &map, 2);
+        cbor_encode_text_stringz(&map, "networks");
+        cbor_encoder_create_array(&map, &networks, ap_count);
+        for (int i = 0; i < ap_count; i++) {
+            cbor_encoder_create_map(&networks, &network, 3);
+            cbor_encode_text_stringz(&network, "ssid");
+            cbor_encode_text_stringz(&network, (char *)ap_info[i].ssid);
+            cbor_encode_text_stringz(&network, "rssi");
+            cbor_encode_int(&network, ap_info[i].rssi);
+            cbor_encode_text_stringz(&network, "authmode");
+            cbor_encode_int(&network, ap_info[i].authmode);
+            cbor_encoder_close_container(&networks, &network);
+        }
+        cbor_encoder_close_container(&map, &networks);
+        cbor_encode_text_stringz(&map, "count");
+        cbor_encode_int(&map, ap_count);
+        cbor_encoder_close_container(&root, &map);
+        return rest_send_cbor(req, &root, buf, start_us);
+    }
 
-    ESP_LOGI(REST_TAG, "Performing WiFi scan");
-    
-    // Perform WiFi scan
-    int ap_count = wifi_scan(ap_info, MAX_AP_SCAN);
-    ESP_LOGI(REST_TAG, "WiFi scan complete");
-    
     cJSON *root = cJSON_CreateObject();
     cJSON *networks = cJSON_CreateArray();
     ESP_LOGI(REST_TAG, "Creating JSON response");
@@ -233,215 +670,1077 @@ static esp_err_t wifi_scan_get_handler(httpd_req_t *req)
     ESP_LOGI(REST_TAG, "JSON response created");
     
     ESP_LOGI(REST_TAG, "Sending response");
-    const char *response = cJSON_Print(root);
-    httpd_resp_sendstr(req, response);
-    free((void *)response);
-    cJSON_Delete(root);
+    esp_err_t err = rest_send_json(req, root, start_us);
     ESP_LOGI(REST_TAG, "Response sent");
-    return ESP_OK;
-}
-
-/* Handler for SSID of current connected station */
-static esp_err_t wifi_station_get_handler(httpd_req_t *req) {
-    httpd_resp_set_type(req, "application/json");
-    cJSON *root = cJSON_CreateObject();
-    uint8_t ssid[32];
-    wifi_get_station_ssid(ssid, sizeof(ssid));
-    cJSON_AddStringToObject(root, "ssid", (char *)ssid);
-    const char *response = cJSON_Print(root);
-    httpd_resp_sendstr(req, response);
-    free((void *)response);
-    cJSON_Delete(root);
-    return ESP_OK;
+    return err;
 }
 
-/* Handler for setting wifi credentials */
-static esp_err_t wifi_credentials_set_handler(httpd_req_t *req) {
-    int total_len = req->content_len;
-    int cur_len = 0;
-    char *buf = ((rest_server_context_t *)(req->user_ctx))->scratch;
-    int received = 0;
-    
-    // Check for valid content length
-    if (total_len <= 0) {
-        ESP_LOGE(REST_TAG, "Invalid content length: %d", total_len);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
-        return ESP_FAIL;
-    }
-    
-    if (total_len >= SCRATCH_BUFSIZE) {
-        ESP_LOGE(REST_TAG, "Content too long: %d bytes", total_len);
-        httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "content too long");
+/* Handler for WiFi scan */
+static esp_err_t wifi_scan_get_handler(httpd_req_t *req)
+{
+    wifi_ap_record_t *ap_info = mem_tag_calloc(MEM_TAG_WIFI_SCAN, MAX_AP_SCAN, sizeof(wifi_ap_record_t));
+    if (ap_info == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No memory for scan results");
         return ESP_FAIL;
     }
+
+    ESP_LOGI(REST_TAG, "Performing WiFi scan");
     
-    // Receive the request body
-    while (cur_len < total_len) {
-        received = httpd_req_recv(req, buf + cur_len, total_len - cur_len);
-        if (received <= 0) {
-            ESP_LOGE(REST_TAG, "Failed to receive data, received: %d", received);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive data");
+    // Perform WiFi scan
+    int ap_count = wifi_scan(ap_info, MAX_AP_SCAN);
+    ESP_LOGI(REST_TAG, "WiFi scan complete");
+
+    esp_err_t err = wifi_scan_send(req, ap_info, ap_count);
+    mem_tag_free(MEM_TAG_WIFI_SCAN, ap_info);
+    return err;
+}
+
+/* Handler for SSID of current connected station */
+static esp_err_t wifi_station_get_handler(httpd_req_t *req) {
+    int64_t start_us = esp_timer_get_time();
+    uint8_t ssid[33] = {0};
+    wifi_get_station_ssid(ssid, sizeof(ssid) - 1);
+
+    if (rest_accepts_cbor(req)) {
+        uint8_t *buf = rest_get_buffer(req, BUF_POOL_SMALL);
+        if (buf == NULL) {
             return ESP_FAIL;
         }
-        cur_len += received;
+        CborEncoder root, map;
+        cbor_encoder_init(&root, buf, buf_pool_size(BUF_POOL_SMALL), 0);
+        cbor_encoder_create_map(&root, &map, 1);
+        cbor_encode_text_stringz(&map, "ssid");
+        cbor_encode_text_stringz(&map, (char *)ssid);
+        cbor_encoder_close_container(&root, &map);
+        return rest_send_cbor(req, &root, buf, start_us);
     }
-    buf[total_len] = '\0';
 
-    // Parse JSON
-    cJSON *root = cJSON_Parse(buf);
-    if (root == NULL) {
-        ESP_LOGE(REST_TAG, "Failed to parse JSON");
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
-        return ESP_FAIL;
-    }
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "ssid", (char *)ssid);
+    return rest_send_json(req, root, start_us);
+}
 
-    // Get SSID and password from JSON
-    cJSON *ssid = cJSON_GetObjectItem(root, "ssid");
-    cJSON *password = cJSON_GetObjectItem(root, "password");
-    
-    // Validate JSON objects
-    if (!cJSON_IsString(ssid) || !cJSON_IsString(password)) {
-        ESP_LOGE(REST_TAG, "Invalid JSON structure - ssid or password not found or not strings");
-        cJSON_Delete(root);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON structure");
-        return ESP_FAIL;
-    }
-    
-    // Validate string lengths
-    size_t ssid_len = strlen(ssid->valuestring);
-    size_t password_len = strlen(password->valuestring);
-    
-    if (ssid_len == 0 || ssid_len > 32) {
-        ESP_LOGE(REST_TAG, "Invalid SSID length: %d", ssid_len);
-        cJSON_Delete(root);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid SSID length");
-        return ESP_FAIL;
-    }
-    
-    if (password_len > 63) {
-        ESP_LOGE(REST_TAG, "Invalid password length: %d", password_len);
-        cJSON_Delete(root);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid password length");
+/* Handler for setting wifi credentials */
+static esp_err_t wifi_credentials_set_handler(httpd_req_t *req) {
+    char ssid[33];
+    char password[64];
+    const json_field_t fields[] = {
+        {"ssid", JSON_FIELD_STRING, ssid, sizeof(ssid), 1, 32, true},
+        {"password", JSON_FIELD_STRING, password, sizeof(password), 0, 63, true},
+    };
+    json_body_t parser;
+    json_body_init(&parser, fields, sizeof(fields) / sizeof(fields[0]));
+    if (rest_parse_json_body(req, &parser) != ESP_OK) {
         return ESP_FAIL;
     }
 
-    ESP_LOGI(REST_TAG, "Setting WiFi credentials - SSID: %s, Password length: %d", ssid->valuestring, password_len);
+    size_t ssid_len = strlen(ssid);
+    size_t password_len = strlen(password);
+    ESP_LOGI(REST_TAG, "Setting WiFi credentials - SSID: %s, Password length: %d", ssid, password_len);
     
-    settings_set_wifi_config((uint8_t *)ssid->valuestring, ssid_len + 1, (uint8_t *)password->valuestring, password_len + 1);
+    settings_set_wifi_config((uint8_t *)ssid, ssid_len + 1, (uint8_t *)password, password_len + 1);
     
     // Mark WiFi as configured
     settings_set_wifi_configured(true);
     
     ESP_LOGI(REST_TAG, "WiFi credentials successfully stored");
     
-    // Create response JSON
-    cJSON *response = cJSON_CreateObject();
-    cJSON_AddStringToObject(response, "message", "credentials updated");
-    cJSON_AddBoolToObject(response, "success", true);
-    
-    const char *response_str = cJSON_Print(response);
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, response_str);
-    
-    free((void *)response_str);
-    cJSON_Delete(response);
-    cJSON_Delete(root);
+    httpd_resp_sendstr(req, "{\"message\":\"credentials updated\",\"success\":true}");
     return ESP_OK;
 }
 
-/* Handler for restarting the device */
-static esp_err_t restart_device_handler(httpd_req_t *req) {
-    ESP_LOGI(REST_TAG, "Restart request received, restarting device in 1 second...");
-    
-    // Send response before restarting
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"message\":\"Device restarting...\",\"success\":true}");
-    
-    // Give time for response to be sent before restarting
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    
-    ESP_LOGI(REST_TAG, "Restarting device now");
-    esp_restart();
-    return ESP_OK;
+/* Parse a 64 character hex string into a SHA-256 digest */
+static bool parse_sha256_hex(const char *hex, uint8_t *digest)
+{
+    if (strlen(hex) != OTA_SHA256_LEN * 2) {
+        return false;
+    }
+    for (int i = 0; i < OTA_SHA256_LEN; i++) {
+        char byte[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+        char *end;
+        digest[i] = (uint8_t)strtoul(byte, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    return true;
 }
 
-esp_err_t start_rest_server(const char *base_path)
+/* Receive a new firmware image and stream it chunk by chunk into the next OTA slot */
+static esp_err_t ota_firmware_upload(httpd_req_t *req, char *buf, size_t buf_size)
 {
-    REST_CHECK(base_path, "wrong base path", err);
-    rest_server_context_t *rest_context = calloc(1, sizeof(rest_server_context_t));
-    REST_CHECK(rest_context, "No memory for rest context", err);
-    strlcpy(rest_context->base_path, base_path, sizeof(rest_context->base_path));
-
-    httpd_handle_t server = NULL;
-    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.uri_match_fn = httpd_uri_match_wildcard;
+    int remaining = req->content_len;
 
-    ESP_LOGI(REST_TAG, "Starting HTTP Server");
-    REST_CHECK(httpd_start(&server, &config) == ESP_OK, "Start server failed", err_start);
+    if (remaining <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty image");
+        return ESP_FAIL;
+    }
 
-    /* URI handler for fetching system info */
-    httpd_uri_t system_info_get_uri = {
-        .uri = "/api/v1/system/info",
-        .method = HTTP_GET,
-        .handler = system_info_get_handler,
-        .user_ctx = rest_context
-    };
-    httpd_register_uri_handler(server, &system_info_get_uri);
+    /* Optional digest the uploader expects the image to have */
+    char expected_hex[OTA_SHA256_LEN * 2 + 1];
+    uint8_t expected[OTA_SHA256_LEN];
+    bool check_hash = false;
+    if (httpd_req_get_hdr_value_str(req, "X-Image-SHA256", expected_hex, sizeof(expected_hex)) == ESP_OK) {
+        if (!parse_sha256_hex(expected_hex, expected)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid X-Image-SHA256");
+            return ESP_FAIL;
+        }
+        check_hash = true;
+    }
 
-    /* URI handler for fetching temperature data */
-    httpd_uri_t temperature_data_get_uri = {
-        .uri = "/api/v1/temp/current",
-        .method = HTTP_GET,
-        .handler = temperature_data_get_handler,
-        .user_ctx = rest_context
-    };
-    httpd_register_uri_handler(server, &temperature_data_get_uri);
+    esp_err_t err = ota_begin(remaining);
+    if (err == ESP_ERR_INVALID_SIZE) {
+        httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "Image too large");
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start update");
+        return ESP_FAIL;
+    }
+
+    int timeouts = 0;
+    while (remaining > 0) {
+        int received = httpd_req_recv(req, buf, MIN(remaining, buf_size));
+        if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+            if (++timeouts < RECV_TIMEOUTS_MAX) {
+                continue;
+            }
+            ESP_LOGE(REST_TAG, "Firmware upload stalled, %d bytes missing", remaining);
+            ota_abort();
+            httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Timed out receiving image");
+            return ESP_FAIL;
+        }
+        timeouts = 0;
+        if (received <= 0) {
+            ESP_LOGE(REST_TAG, "Firmware upload interrupted, %d bytes missing", remaining);
+            ota_abort();
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive image");
+            return ESP_FAIL;
+        }
+        if (ota_write(buf, received) != ESP_OK) {
+            ota_abort();
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to write image");
+            return ESP_FAIL;
+        }
+        remaining -= received;
+    }
 
+    ota_result_t result;
+    err = ota_end(check_hash ? expected : NULL, &result);
+    if (err == ESP_ERR_INVALID_CRC) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Image hash mismatch");
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid image");
+        return ESP_FAIL;
+    }
 
-    /* URI handler for setting target temperature */
-    httpd_uri_t temperature_set_uri = {
-        .uri = "/api/v1/temp/target",
-        .method = HTTP_POST,
-        .handler = temperature_set_target_handler,
-        .user_ctx = rest_context
+    char sha_hex[OTA_SHA256_LEN * 2 + 1];
+    for (int i = 0; i < OTA_SHA256_LEN; i++) {
+        sprintf(&sha_hex[2 * i], "%02x", result.sha256[i]);
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "success", true);
+    cJSON_AddStringToObject(root, "partition", result.partition);
+    cJSON_AddStringToObject(root, "sha256", sha_hex);
+    cJSON_AddNumberToObject(root, "bytes", result.bytes);
+    cJSON_AddNumberToObject(root, "elapsed_ms", result.elapsed_us / 1000);
+    cJSON_AddNumberToObject(root, "kbps", result.elapsed_us > 0 ? (double)result.bytes * 8000 / result.elapsed_us : 0);
+    rest_send_json(req, root, esp_timer_get_time());
+
+    /* Give time for response to be sent before booting the new image */
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    ESP_LOGI(REST_TAG, "Restarting into %s", result.partition);
+    esp_restart();
+    return ESP_OK;
+}
+
+/* Handler for uploading a new firmware image, streamed chunk by chunk into the next OTA slot */
+static esp_err_t ota_firmware_upload_handler(httpd_req_t *req)
+{
+    char *buf = rest_get_buffer(req, BUF_POOL_LARGE);
+    if (buf == NULL) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = ota_firmware_upload(req, buf, buf_pool_size(BUF_POOL_LARGE));
+    buf_pool_put(buf);
+    return err;
+}
+
+/* Receive a packed web UI bundle, applied as a delta and switched in atomically */
+static esp_err_t webui_bundle_upload(httpd_req_t *req, char *buf, size_t buf_size)
+{
+    int remaining = req->content_len;
+
+    if (remaining <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty bundle");
+        return ESP_FAIL;
+    }
+    if (webui_update_begin() != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to start update");
+        return ESP_FAIL;
+    }
+
+    int timeouts = 0;
+    while (remaining > 0) {
+        int received = httpd_req_recv(req, buf, MIN(remaining, buf_size));
+        if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+            if (++timeouts < RECV_TIMEOUTS_MAX) {
+                continue;
+            }
+            ESP_LOGE(REST_TAG, "Bundle upload stalled, %d bytes missing", remaining);
+            webui_update_abort();
+            httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Timed out receiving bundle");
+            return ESP_FAIL;
+        }
+        timeouts = 0;
+        if (received <= 0) {
+            ESP_LOGE(REST_TAG, "Bundle upload interrupted, %d bytes missing", remaining);
+            webui_update_abort();
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to receive bundle");
+            return ESP_FAIL;
+        }
+        esp_err_t err = webui_update_feed((const uint8_t *)buf, received);
+        if (err != ESP_OK) {
+            webui_update_abort();
+            httpd_resp_send_err(req, err == ESP_FAIL ? HTTPD_500_INTERNAL_SERVER_ERROR : HTTPD_400_BAD_REQUEST,
+                                "Bundle rejected");
+            return ESP_FAIL;
+        }
+        remaining -= received;
+    }
+
+    webui_update_stats_t stats;
+    esp_err_t err = webui_update_finish(&stats);
+    if (err == ESP_ERR_INVALID_SIZE) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Truncated bundle");
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to activate bundle");
+        return ESP_FAIL;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "success", true);
+    cJSON_AddNumberToObject(root, "files", stats.files);
+    cJSON_AddNumberToObject(root, "files_written", stats.files_written);
+    cJSON_AddNumberToObject(root, "files_unchanged", stats.files_skipped);
+    cJSON_AddNumberToObject(root, "bytes_received", stats.bytes_received);
+    cJSON_AddNumberToObject(root, "bytes_written", stats.bytes_written);
+    cJSON_AddNumberToObject(root, "elapsed_ms", stats.elapsed_us / 1000);
+    return rest_send_json(req, root, esp_timer_get_time());
+}
+
+/* Handler for uploading a packed web UI bundle, applied as a delta and switched in atomically */
+static esp_err_t webui_bundle_upload_handler(httpd_req_t *req)
+{
+    char *buf = rest_get_buffer(req, BUF_POOL_LARGE);
+    if (buf == NULL) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = webui_bundle_upload(req, buf, buf_pool_size(BUF_POOL_LARGE));
+    buf_pool_put(buf);
+    return err;
+}
+
+/* Handler for reverting to the web UI flashed with the firmware */
+static esp_err_t webui_bundle_delete_handler(httpd_req_t *req)
+{
+    if (webui_reset() != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Update in progress");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"message\":\"factory web UI restored\",\"success\":true}");
+    return ESP_OK;
+}
+
+/* Stream the log ring as text, oldest entry first */
+static esp_err_t logs_get(httpd_req_t *req, char *buf, size_t buf_size)
+{
+    uint32_t seq = log_ring_tail();
+    uint32_t head = log_ring_head();
+
+    /* ?since=<seq> returns only entries logged after a previous X-Log-Next */
+    char query[32], value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+        uint32_t since = strtoul(value, NULL, 10);
+        if (since - seq <= head - seq) {
+            seq = since;
+        }
+    }
+
+    char next[12];
+    snprintf(next, sizeof(next), "%lu", head);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "X-Log-Next", next);
+
+    size_t used = 0;
+    for (; seq != head; seq++) {
+        if (buf_size - used < 256) {
+            if (httpd_resp_send_chunk(req, buf, used) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            used = 0;
+        }
+        int len = log_ring_format(seq, &buf[used], 256);
+        if (len > 0) {
+            used += MIN(len, 255);
+        }
+    }
+    if (used > 0 && httpd_resp_send_chunk(req, buf, used) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* Handler for streaming the log ring as text, oldest entry first */
+static esp_err_t logs_get_handler(httpd_req_t *req)
+{
+    char *buf = rest_get_buffer(req, BUF_POOL_SMALL);
+    if (buf == NULL) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = logs_get(req, buf, buf_pool_size(BUF_POOL_SMALL));
+    buf_pool_put(buf);
+    return err;
+}
+
+/* Handler for changing the runtime log level of a tag */
+static esp_err_t logs_level_set_handler(httpd_req_t *req)
+{
+    char tag[32];
+    char level[8];
+    const json_field_t fields[] = {
+        {"tag", JSON_FIELD_STRING, tag, sizeof(tag), 1, sizeof(tag) - 1, true},
+        {"level", JSON_FIELD_STRING, level, sizeof(level), 1, sizeof(level) - 1, true},
     };
-    httpd_register_uri_handler(server, &temperature_set_uri);
-    
-    /* URI handler for WiFi scan */
-    httpd_uri_t wifi_scan_get_uri = {
-        .uri = "/api/v1/wifi/scan",
-        .method = HTTP_GET,
-        .handler = wifi_scan_get_handler,
-        .user_ctx = rest_context
+    json_body_t parser;
+    json_body_init(&parser, fields, sizeof(fields) / sizeof(fields[0]));
+    if (rest_parse_json_body(req, &parser) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (log_ring_set_level(tag, level) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected level none|error|warn|info|debug|verbose");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"message\":\"log level updated\",\"success\":true}");
+    return ESP_OK;
+}
+
+static void rest_add_session_json(cJSON *obj, const session_info_t *info)
+{
+    cJSON_AddNumberToObject(obj, "id", info->id);
+    cJSON_AddStringToObject(obj, "label", info->label);
+    cJSON_AddNumberToObject(obj, "samples", info->samples);
+    cJSON_AddNumberToObject(obj, "min_period_ms", info->min_period_ms);
+    cJSON_AddBoolToObject(obj, "active", info->active);
+}
+
+/* Handler for listing the newest recorded cook sessions */
+static esp_err_t sessions_list_get_handler(httpd_req_t *req)
+{
+    int64_t start_us = esp_timer_get_time();
+    session_info_t infos[SESSION_LIST_MAX];
+    size_t count = session_list(infos, SESSION_LIST_MAX);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *sessions = cJSON_AddArrayToObject(root, "sessions");
+    for (size_t i = 0; i < count; i++) {
+        cJSON *session = cJSON_CreateObject();
+        rest_add_session_json(session, &infos[i]);
+        cJSON_AddItemToArray(sessions, session);
+    }
+    return rest_send_json(req, root, start_us);
+}
+
+/* Handler for starting a new cook session, stopping the active one */
+static esp_err_t sessions_start_post_handler(httpd_req_t *req)
+{
+    char label[SESSION_LABEL_MAX] = "";
+    const json_field_t fields[] = {
+        {"label", JSON_FIELD_STRING, label, sizeof(label), 0, sizeof(label) - 1, false},
     };
-    httpd_register_uri_handler(server, &wifi_scan_get_uri);
+    json_body_t parser;
+    json_body_init(&parser, fields, sizeof(fields) / sizeof(fields[0]));
+    if (rest_parse_json_body(req, &parser) != ESP_OK) {
+        return ESP_FAIL;
+    }
 
-    /* URI handler for SSID of current connected station */
-    httpd_uri_t wifi_station_get_uri = {
-        .uri = "/api/v1/wifi/station",
-        .method = HTTP_GET,
-        .handler = wifi_station_get_handler,
-        .user_ctx = rest_context
+    uint32_t id;
+    esp_err_t err = session_start(label, &id);
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_sendstr(req, "Session storage unavailable");
+        return ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to create session");
+        return ESP_FAIL;
+    }
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "id", id);
+    return rest_send_json(req, root, esp_timer_get_time());
+}
+
+/* Parse the {id} of a /api/v1/sessions/{id} route, answering 404 unless it is a session number */
+static bool rest_session_id(httpd_req_t *req, uint32_t *id)
+{
+    const rest_call_t *call = req->user_ctx;
+    char text[12];
+    char *end;
+    if (!router_param(&call->params, "id", text, sizeof(text)) || (*id = strtoul(text, &end, 10)) == 0 ||
+        *end != '\0') {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown session");
+        return false;
+    }
+    return true;
+}
+
+/* Format one sample as a CSV line: seconds, then the probes with faulty ones left empty */
+static size_t session_format_csv(char *buf, const session_record_t *record)
+{
+    size_t len = sprintf(buf, "%lu.%03lu", record->t_ms / 1000, record->t_ms % 1000);
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        len += (record->fault_mask & (1 << i)) ? sprintf(&buf[len], ",") : sprintf(&buf[len], ",%d", record->temp[i]);
+    }
+    buf[len++] = '\n';
+    return len;
+}
+
+static size_t session_format_ndjson(char *buf, const session_record_t *record)
+{
+    size_t len = sprintf(buf, "{\"t\":%lu.%03lu,\"temp\":[", record->t_ms / 1000, record->t_ms % 1000);
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        const char *sep = i ? "," : "";
+        len += (record->fault_mask & (1 << i)) ? sprintf(&buf[len], "%snull", sep)
+                                                : sprintf(&buf[len], "%s%d", sep, record->temp[i]);
+    }
+    len += sprintf(&buf[len], "],\"alarms\":%u}\n", record->alarm_mask);
+    return len;
+}
+
+/*
+ * Stream a session as CSV or NDJSON. Records are read a few at a time and
+ * formatted into buf, which is sent whenever it fills up, so memory use does not
+ * depend on the length of the session. The CSV layout is the one the replay
+ * probe driver reads.
+ */
+static esp_err_t session_export(httpd_req_t *req, uint32_t id, char *buf, size_t buf_size)
+{
+    char query[32];
+    char format[8] = "csv";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "format", format, sizeof(format));
+    }
+    bool ndjson = strcmp(format, "ndjson") == 0;
+    if (!ndjson && strcmp(format, "csv") != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected format=csv|ndjson");
+        return ESP_FAIL;
+    }
+
+    session_info_t info;
+    int fd = session_open(id, &info);
+    if (fd < 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown session");
+        return ESP_FAIL;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    size_t free_min = free_before;
+    char disposition[48];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"session-%lu.%s\"", id, format);
+    httpd_resp_set_type(req, ndjson ? "application/x-ndjson" : "text/csv");
+    httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+
+    size_t len = ndjson ? 0 : sprintf(buf, "seconds,probe_1,probe_2,probe_3,probe_4\n");
+    uint32_t sent = 0;
+    uint32_t remaining = info.samples;
+    session_record_t records[SESSION_READ_BATCH];
+    esp_err_t err = ESP_OK;
+    while (remaining > 0 && err == ESP_OK) {
+        ssize_t n = read(fd, records, MIN(remaining, SESSION_READ_BATCH) * sizeof(records[0]));
+        /* A read error or a record cut short, both leave remaining above 0 */
+        if (n <= 0 || n % sizeof(records[0]) != 0) {
+            break;
+        }
+        size_t count = n / sizeof(records[0]);
+        remaining -= count;
+        for (size_t i = 0; i < count && err == ESP_OK; i++) {
+            if (buf_size - len < SESSION_LINE_MAX) {
+                err = httpd_resp_send_chunk(req, buf, len);
+                sent += len;
+                len = 0;
+                free_min = MIN(free_min, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+            }
+            len += ndjson ? session_format_ndjson(&buf[len], &records[i]) : session_format_csv(&buf[len], &records[i]);
+        }
+    }
+    close(fd);
+    if (err == ESP_OK && remaining > 0) {
+        /* Ending the chunked response would pass a truncated file off as complete, dropping the connection does not */
+        ESP_LOGE(REST_TAG, "Export of session %lu: read failed with %lu samples left", id, remaining);
+        return ESP_FAIL;
+    }
+    if (err == ESP_OK && len > 0) {
+        err = httpd_resp_send_chunk(req, buf, len);
+        sent += len;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(REST_TAG, "Export of session %lu aborted after %lu bytes", id, sent);
+        return ESP_FAIL;
+    }
+
+    s_export_bytes = sent;
+    s_export_us = esp_timer_get_time() - start_us;
+    s_export_heap = free_before - free_min;
+    ESP_LOGI(REST_TAG, "Exported session %lu: %lu samples, %lu bytes in %lu ms (%llu KB/s), heap drop %lu bytes", id,
+             info.samples, sent, s_export_us / 1000,
+             s_export_us ? (uint64_t)sent * 1000000 / s_export_us / 1024 : 0, s_export_heap);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* Handler for GET /api/v1/sessions/{id}/export */
+static esp_err_t sessions_export_get_handler(httpd_req_t *req)
+{
+    uint32_t id;
+    if (!rest_session_id(req, &id)) {
+        return ESP_FAIL;
+    }
+    char *buf = rest_get_buffer(req, BUF_POOL_LARGE);
+    if (buf == NULL) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = session_export(req, id, buf, buf_pool_size(BUF_POOL_LARGE));
+    buf_pool_put(buf);
+    return err;
+}
+
+/* Handler for GET /api/v1/sessions/{id} */
+static esp_err_t sessions_item_get_handler(httpd_req_t *req)
+{
+    uint32_t id;
+    if (!rest_session_id(req, &id)) {
+        return ESP_FAIL;
+    }
+
+    session_info_t info;
+    int fd = session_open(id, &info);
+    if (fd < 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown session");
+        return ESP_FAIL;
+    }
+    close(fd);
+    cJSON *root = cJSON_CreateObject();
+    rest_add_session_json(root, &info);
+    return rest_send_json(req, root, esp_timer_get_time());
+}
+
+/* Handler for POST /api/v1/sessions/{id}/stop */
+static esp_err_t sessions_stop_post_handler(httpd_req_t *req)
+{
+    uint32_t id;
+    if (!rest_session_id(req, &id)) {
+        return ESP_FAIL;
+    }
+
+    session_info_t info;
+    int fd = session_open(id, &info);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (fd < 0 || !info.active || session_stop() != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Session is not recording");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"message\":\"session stopped\",\"success\":true}");
+    return ESP_OK;
+}
+
+/* Handler for PATCH /api/v1/sessions/{id}, which changes the label */
+static esp_err_t sessions_item_patch_handler(httpd_req_t *req)
+{
+    uint32_t id;
+    if (!rest_session_id(req, &id)) {
+        return ESP_FAIL;
+    }
+
+    char label[SESSION_LABEL_MAX];
+    const json_field_t fields[] = {
+        {"label", JSON_FIELD_STRING, label, sizeof(label), 0, sizeof(label) - 1, true},
     };
-    httpd_register_uri_handler(server, &wifi_station_get_uri);
+    json_body_t parser;
+    json_body_init(&parser, fields, sizeof(fields) / sizeof(fields[0]));
+    if (rest_parse_json_body(req, &parser) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (session_set_label(id, label) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown session");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"message\":\"label updated\",\"success\":true}");
+    return ESP_OK;
+}
 
-    /* URI for setting wifi credentials */
-    httpd_uri_t wifi_credentials_set_uri = {
-        .uri = "/api/v1/wifi/credentials",
-        .method = HTTP_POST,
-        .handler = wifi_credentials_set_handler,
-        .user_ctx = rest_context
+/* Handler for DELETE /api/v1/sessions/{id} */
+static esp_err_t sessions_item_delete_handler(httpd_req_t *req)
+{
+    uint32_t id;
+    if (!rest_session_id(req, &id)) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = session_delete(id);
+    if (err == ESP_ERR_INVALID_STATE) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Session is recording or session storage is unavailable");
+        return ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown session");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"message\":\"session deleted\",\"success\":true}");
+    return ESP_OK;
+}
+
+/* Send buf once fewer than 128 bytes are left in it, the most one entry of the heap document takes */
+static esp_err_t heap_flush(httpd_req_t *req, char *buf, size_t buf_size, int *used)
+{
+    if (buf_size - *used >= 128) {
+        return ESP_OK;
+    }
+    esp_err_t err = httpd_resp_send_chunk(req, buf, *used);
+    *used = 0;
+    return err;
+}
+
+/* Stream the heap document in chunks, printed without cJSON so reading the heap does not churn it */
+static esp_err_t system_heap_get(httpd_req_t *req, char *buf, size_t buf_size)
+{
+    mem_stats_t mem;
+    mem_get_stats(&mem);
+    httpd_resp_set_type(req, "application/json");
+    int used = snprintf(buf, buf_size,
+                        "{\"free\":%u,\"largest_free_block\":%u,\"min_free\":%u,\"fragmentation_pct\":%u,"
+                        "\"psram_free\":%u,\"psram_min_free\":%u,\"tags\":[",
+                        mem.internal_free, mem.internal_largest, mem.internal_min_free,
+                        mem.internal_free ? 100 - mem.internal_largest * 100 / mem.internal_free : 0, mem.psram_free,
+                        mem.psram_min_free);
+
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        if (heap_flush(req, buf, buf_size, &used) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        mem_tag_stats_t tag;
+        mem_get_tag_stats(i, &tag);
+        used += snprintf(&buf[used], buf_size - used,
+                         "%s{\"name\":\"%s\",\"live_bytes\":%u,\"peak_bytes\":%u,\"allocs\":%lu,\"frees\":%lu,"
+                         "\"failures\":%lu}",
+                         i ? "," : "", mem_tag_name(i), tag.live_bytes, tag.peak_bytes, tag.allocs, tag.frees,
+                         tag.failures);
+    }
+    used += snprintf(&buf[used], buf_size - used,
+                     "],\"history\":{\"period_s\":%d,"
+                     "\"columns\":[\"uptime_s\",\"free\",\"largest_free_block\",\"min_free\"],\"samples\":[",
+                     CONFIG_METER_HEAP_SAMPLE_S);
+
+    /* Oldest first, samples taken meanwhile are left for the next request */
+    uint32_t seq;
+    uint32_t head = mem_heap_history(&seq);
+    bool first = true;
+    for (; seq != head; seq++) {
+        mem_heap_sample_t sample;
+        if (!mem_heap_sample(seq, &sample)) {
+            continue;
+        }
+        if (heap_flush(req, buf, buf_size, &used) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        used += snprintf(&buf[used], buf_size - used, "%s[%lu,%lu,%lu,%lu]", first ? "" : ",", sample.uptime_s,
+                         sample.free, sample.largest, sample.min_free);
+        first = false;
+    }
+    used += snprintf(&buf[used], buf_size - used, "]}}");
+    if (httpd_resp_send_chunk(req, buf, used) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* Handler for heap usage per owner and the free and largest block history */
+static esp_err_t system_heap_get_handler(httpd_req_t *req)
+{
+    char *buf = rest_get_buffer(req, BUF_POOL_SMALL);
+    if (buf == NULL) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = system_heap_get(req, buf, buf_pool_size(BUF_POOL_SMALL));
+    buf_pool_put(buf);
+    return err;
+}
+
+/* Handler for runtime metrics of the server itself */
+static esp_err_t system_metrics_get_handler(httpd_req_t *req)
+{
+    static const char *class_names[BUF_POOL_CLASS_COUNT] = {"small", "large"};
+    int64_t start_us = esp_timer_get_time();
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "uptime_ms", start_us / 1000);
+    cJSON *http = cJSON_AddObjectToObject(root, "http");
+    cJSON_AddNumberToObject(http, "connections", s_http_connections);
+    cJSON_AddNumberToObject(http, "api_responses", s_api_responses);
+    cJSON_AddNumberToObject(http, "api_response_bytes", s_api_response_bytes);
+    cJSON_AddNumberToObject(http, "auth_failures", s_auth_failures);
+    cJSON *routes = cJSON_AddArrayToObject(http, "routes");
+    for (size_t i = 0; i < s_router.count; i++) {
+        const rest_route_stats_t *stats = &s_route_stats[i];
+        if (stats->count == 0) {
+            continue;
+        }
+        cJSON *route = cJSON_CreateObject();
+        cJSON_AddStringToObject(route, "method", http_method_str(s_router.routes[i].method));
+        cJSON_AddStringToObject(route, "path", s_router.routes[i].path);
+        cJSON_AddNumberToObject(route, "count", stats->count);
+        cJSON_AddNumberToObject(route, "errors", stats->errors);
+        cJSON_AddNumberToObject(route, "mean_us", stats->total_us / stats->count);
+        cJSON_AddNumberToObject(route, "max_us", stats->max_us);
+        cJSON_AddItemToArray(routes, route);
+    }
+    cJSON *pools = cJSON_AddArrayToObject(root, "buf_pool");
+    for (int i = 0; i < BUF_POOL_CLASS_COUNT; i++) {
+        buf_pool_stats_t stats;
+        buf_pool_get_stats(i, &stats);
+        cJSON *pool = cJSON_CreateObject();
+        cJSON_AddStringToObject(pool, "class", class_names[i]);
+        cJSON_AddNumberToObject(pool, "size", stats.size);
+        cJSON_AddNumberToObject(pool, "count", stats.count);
+        cJSON_AddNumberToObject(pool, "in_use", stats.in_use);
+        cJSON_AddNumberToObject(pool, "high_water", stats.high_water);
+        cJSON_AddNumberToObject(pool, "checkouts", stats.checkouts);
+        cJSON_AddNumberToObject(pool, "timeouts", stats.timeouts);
+        cJSON_AddItemToArray(pools, pool);
+    }
+    session_stats_t session_stats;
+    session_get_stats(&session_stats);
+    cJSON *sessions = cJSON_AddObjectToObject(root, "sessions");
+    cJSON_AddNumberToObject(sessions, "recorded", session_stats.recorded);
+    cJSON_AddNumberToObject(sessions, "dropped", session_stats.dropped);
+    cJSON_AddNumberToObject(sessions, "write_errors", session_stats.write_errors);
+    cJSON_AddNumberToObject(sessions, "last_export_bytes", s_export_bytes);
+    cJSON_AddNumberToObject(sessions, "last_export_us", s_export_us);
+    cJSON_AddNumberToObject(sessions, "last_export_heap", s_export_heap);
+    https_stats_t tls_stats;
+    https_get_stats(&tls_stats);
+    cJSON *tls = cJSON_AddObjectToObject(root, "tls");
+    cJSON_AddBoolToObject(tls, "enabled", REST_HTTPS_ENABLED);
+    cJSON_AddNumberToObject(tls, "full_handshakes", tls_stats.full);
+    cJSON_AddNumberToObject(tls, "resumed_handshakes", tls_stats.resumed);
+    cJSON_AddNumberToObject(tls, "failed_handshakes", tls_stats.failed);
+    cJSON_AddNumberToObject(tls, "tickets_issued", tls_stats.tickets_issued);
+    cJSON_AddNumberToObject(tls, "full_mean_us", tls_stats.full ? tls_stats.full_us / tls_stats.full : 0);
+    cJSON_AddNumberToObject(tls, "full_max_us", tls_stats.full_max_us);
+    cJSON_AddNumberToObject(tls, "resumed_mean_us", tls_stats.resumed ? tls_stats.resumed_us / tls_stats.resumed : 0);
+    cJSON_AddNumberToObject(tls, "resumed_max_us", tls_stats.resumed_max_us);
+    checkpoint_stats_t ckpt;
+    checkpoint_get_stats(&ckpt);
+    cJSON *checkpoint = cJSON_AddObjectToObject(root, "checkpoint");
+    cJSON_AddStringToObject(checkpoint, "restored_from", checkpoint_source_name(ckpt.source));
+    cJSON_AddNumberToObject(checkpoint, "boot", ckpt.boot);
+    cJSON_AddNumberToObject(checkpoint, "stale_boots", ckpt.stale_boots);
+    cJSON_AddNumberToObject(checkpoint, "restore_us", ckpt.restore_us);
+    cJSON_AddNumberToObject(checkpoint, "restored_at_us", ckpt.restored_at_us);
+    cJSON_AddNumberToObject(checkpoint, "saves", ckpt.saves);
+    cJSON_AddNumberToObject(checkpoint, "save_mean_us", ckpt.saves ? (double)ckpt.save_total_us / ckpt.saves : 0);
+    cJSON_AddNumberToObject(checkpoint, "save_max_us", ckpt.save_max_us);
+    cJSON_AddNumberToObject(checkpoint, "nvs_writes", ckpt.nvs_writes);
+    cJSON_AddNumberToObject(checkpoint, "nvs_errors", ckpt.nvs_errors);
+    cJSON_AddNumberToObject(checkpoint, "nvs_write_mean_us",
+                            ckpt.nvs_writes ? (double)ckpt.nvs_write_total_us / ckpt.nvs_writes : 0);
+    cJSON_AddNumberToObject(checkpoint, "nvs_write_max_us", ckpt.nvs_write_max_us);
+    mem_stats_t mem;
+    mem_get_stats(&mem);
+    cJSON *heap = cJSON_AddObjectToObject(root, "heap");
+    cJSON_AddNumberToObject(heap, "internal_free", mem.internal_free);
+    cJSON_AddNumberToObject(heap, "internal_min_free", mem.internal_min_free);
+    cJSON_AddNumberToObject(heap, "internal_largest", mem.internal_largest);
+    cJSON_AddNumberToObject(heap, "psram_total", mem.psram_total);
+    cJSON_AddNumberToObject(heap, "psram_free", mem.psram_free);
+    cJSON_AddNumberToObject(heap, "psram_min_free", mem.psram_min_free);
+    return rest_send_json(req, root, start_us);
+}
+
+/* Handler for the histogram of sample lateness, to check sampling stays on schedule under load */
+static esp_err_t system_jitter_get_handler(httpd_req_t *req)
+{
+    int64_t start_us = esp_timer_get_time();
+    temperature_jitter_t jitter;
+    temperature_get_jitter(&jitter);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "period_us", jitter.period_us);
+    cJSON_AddStringToObject(root, "reason", sched_reason_name(jitter.reason));
+    cJSON_AddNumberToObject(root, "samples", jitter.samples);
+    cJSON_AddNumberToObject(root, "missed", jitter.missed);
+    cJSON_AddNumberToObject(root, "dropped", jitter.dropped);
+    cJSON_AddNumberToObject(root, "max_late_us", jitter.max_late_us);
+    cJSON_AddNumberToObject(root, "mean_late_us", jitter.samples ? jitter.total_late_us / jitter.samples : 0);
+    cJSON_AddNumberToObject(root, "max_work_us", jitter.max_work_us);
+    cJSON *buckets = cJSON_AddArrayToObject(root, "buckets");
+    for (int i = 0; i < TEMPERATURE_JITTER_BUCKETS; i++) {
+        cJSON *bucket = cJSON_CreateObject();
+        if (jitter.bucket_le_us[i] == UINT32_MAX) {
+            cJSON_AddNullToObject(bucket, "le_us");
+        } else {
+            cJSON_AddNumberToObject(bucket, "le_us", jitter.bucket_le_us[i]);
+        }
+        cJSON_AddNumberToObject(bucket, "count", jitter.buckets[i]);
+        cJSON_AddItemToArray(buckets, bucket);
+    }
+    return rest_send_json(req, root, start_us);
+}
+
+/* Handler for clearing the jitter histogram, e.g. before starting a load test */
+static esp_err_t system_jitter_reset_handler(httpd_req_t *req)
+{
+    temperature_reset_jitter();
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"message\":\"jitter histogram cleared\",\"success\":true}");
+    return ESP_OK;
+}
+
+/* Handler for restarting the device */
+static esp_err_t restart_device_handler(httpd_req_t *req) {
+    ESP_LOGI(REST_TAG, "Restart request received, restarting device in 1 second...");
+    
+    // Send response before restarting
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"message\":\"Device restarting...\",\"success\":true}");
+    
+    // Give time for response to be sent before restarting
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    
+    ESP_LOGI(REST_TAG, "Restarting device now");
+    esp_restart();
+    return ESP_OK;
+}
+
+#define REST_ROUTE(method, path, handler, middleware) \
+    {method, "/api/v1" path, &(const rest_route_t){handler, middleware}}
+
+/*
+ * Every API endpoint. router.h explains the order the table must be in: by
+ * path segment, a path that ends before a longer one, literals bytewise before
+ * {parameters}, then by method number (DELETE, GET, POST, PATCH). The order is
+ * checked when the server starts.
+ */
+static const router_route_t s_routes[] = {
+    REST_ROUTE(HTTP_GET, "/batch", batch_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_POST, "/device/restart", restart_device_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_GET, "/logs", logs_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_POST, "/logs/level", logs_level_set_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_POST, "/ota/firmware", ota_firmware_upload_handler, REST_FLASHING),
+    REST_ROUTE(HTTP_GET, "/sessions", sessions_list_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_POST, "/sessions", sessions_start_post_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_DELETE, "/sessions/{id}", sessions_item_delete_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_GET, "/sessions/{id}", sessions_item_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_PATCH, "/sessions/{id}", sessions_item_patch_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_GET, "/sessions/{id}/export", sessions_export_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_POST, "/sessions/{id}/stop", sessions_stop_post_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_GET, "/system/heap", system_heap_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_GET, "/system/info", system_info_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_DELETE, "/system/jitter", system_jitter_reset_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_GET, "/system/jitter", system_jitter_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_GET, "/system/metrics", system_metrics_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_GET, "/temp/current", temperature_data_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_POST, "/temp/target", temperature_set_target_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_PATCH, "/temp/target", temperature_set_target_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_DELETE, "/webui/bundle", webui_bundle_delete_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_POST, "/webui/bundle", webui_bundle_upload_handler, REST_FLASHING),
+    REST_ROUTE(HTTP_POST, "/wifi/credentials", wifi_credentials_set_handler, REST_GUARDED),
+    REST_ROUTE(HTTP_GET, "/wifi/scan", wifi_scan_get_handler, REST_OPEN),
+    REST_ROUTE(HTTP_GET, "/wifi/station", wifi_station_get_handler, REST_OPEN),
+};
+
+static bool rest_timing_before(httpd_req_t *req, rest_call_t *call)
+{
+    call->start_us = esp_timer_get_time();
+    return true;
+}
+
+static void rest_timing_after(httpd_req_t *req, rest_call_t *call, esp_err_t err)
+{
+    rest_route_stats_t *stats = &s_route_stats[call->index];
+    uint32_t us = esp_timer_get_time() - call->start_us;
+    stats->count++;
+    stats->errors += err != ESP_OK;
+    stats->total_us += us;
+    stats->max_us = MAX(stats->max_us, us);
+}
+
+/* Require "Authorization: Bearer <CONFIG_METER_API_TOKEN>" unless the token is empty */
+static bool rest_auth_before(httpd_req_t *req, rest_call_t *call)
+{
+    static const char expected[] = "Bearer " CONFIG_METER_API_TOKEN;
+    if (sizeof(CONFIG_METER_API_TOKEN) == 1) {
+        return true;
+    }
+    char given[sizeof(expected)];
+    uint8_t diff = 1;
+    if (httpd_req_get_hdr_value_len(req, "Authorization") == sizeof(expected) - 1 &&
+        httpd_req_get_hdr_value_str(req, "Authorization", given, sizeof(given)) == ESP_OK) {
+        /* Look at every byte, so the time taken does not tell how much of the token was right */
+        diff = 0;
+        for (size_t i = 0; i < sizeof(expected) - 1; i++) {
+            diff |= given[i] ^ expected[i];
+        }
+    }
+    if (diff != 0) {
+        s_auth_failures++;
+        httpd_resp_set_hdr(req, "WWW-Authenticate", "Bearer");
+        httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Missing or wrong API token");
+        return false;
+    }
+    return true;
+}
+
+/* Answer 403 while CONFIG_METER_API_TOKEN is empty, which would let anyone on the network through rest_auth_before() */
+static bool rest_token_before(httpd_req_t *req, rest_call_t *call)
+{
+    if (sizeof(CONFIG_METER_API_TOKEN) > 1) {
+        return true;
+    }
+    s_auth_failures++;
+    httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Set CONFIG_METER_API_TOKEN to enable this endpoint");
+    return false;
+}
+
+typedef struct {
+    /* Runs before the handler, false once it has answered the request itself */
+    bool (*before)(httpd_req_t *req, rest_call_t *call);
+    /* Runs after the handler, or after a later hook answered the request */
+    void (*after)(httpd_req_t *req, rest_call_t *call, esp_err_t err);
+} rest_middleware_t;
+
+/* In the order they run, timing first so it covers the others */
+static const rest_middleware_t s_middleware[] = {
+    [0] = {rest_timing_before, rest_timing_after}, /* REST_MW_TIMING */
+    [1] = {rest_auth_before, NULL},                 /* REST_MW_AUTH */
+    [2] = {rest_token_before, NULL},                /* REST_MW_TOKEN */
+};
+
+/* The one handler registered for the API, finds the route and runs it through its middleware */
+static esp_err_t rest_api_dispatch(httpd_req_t *req)
+{
+    router_match_t match;
+    if (!router_lookup(&s_router, req->method, req->uri, strcspn(req->uri, "?"), &match)) {
+        if (match.first == match.last) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown API endpoint");
+            return ESP_FAIL;
+        }
+        char allow[64];
+        size_t len = 0;
+        for (size_t i = match.first; i < match.last && len < sizeof(allow); i++) {
+            len += snprintf(&allow[len], sizeof(allow) - len, "%s%s", len ? ", " : "",
+                            http_method_str(s_router.routes[i].method));
+        }
+        httpd_resp_set_hdr(req, "Allow", allow);
+        httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, "Method not allowed on this endpoint");
+        return ESP_FAIL;
+    }
+
+    const rest_route_t *route = match.route->data;
+    rest_call_t call = {
+        .index = match.route - s_router.routes,
+        .params = match.params,
+        .start_us = esp_timer_get_time(),
     };
-    httpd_register_uri_handler(server, &wifi_credentials_set_uri);
+    req->user_ctx = &call;
+
+    const size_t hooks = sizeof(s_middleware) / sizeof(s_middleware[0]);
+    size_t ran = 0;
+    esp_err_t err = ESP_FAIL;
+    while (ran < hooks && (!(route->middleware & (1 << ran)) || s_middleware[ran].before(req, &call))) {
+        ran++;
+    }
+    if (ran == hooks) {
+        err = route->handler(req);
+    }
+    while (ran-- > 0) {
+        if ((route->middleware & (1 << ran)) && s_middleware[ran].after != NULL) {
+            s_middleware[ran].after(req, &call, err);
+        }
+    }
+    return err;
+}
+
+esp_err_t start_rest_server(const char *base_path)
+{
+    /* Lives as long as the server, no point in taking it from the heap */
+    static rest_server_context_t s_rest_context;
+    rest_server_context_t *rest_context = &s_rest_context;
+    REST_CHECK(base_path, "wrong base path", err);
+    strlcpy(rest_context->base_path, base_path, sizeof(rest_context->base_path));
+
+    httpd_handle_t server = NULL;
+#if CONFIG_METER_HTTPS_ENABLE
+    extern const unsigned char servercert_start[] asm("_binary_servercert_pem_start");
+    extern const unsigned char servercert_end[] asm("_binary_servercert_pem_end");
+    extern const unsigned char prvtkey_start[] asm("_binary_prvtkey_pem_start");
+    extern const unsigned char prvtkey_end[] asm("_binary_prvtkey_pem_end");
+
+    httpd_ssl_config_t ssl_config = HTTPD_SSL_CONFIG_DEFAULT();
+    ssl_config.servercert = servercert_start;
+    ssl_config.servercert_len = servercert_end - servercert_start;
+    ssl_config.prvtkey_pem = prvtkey_start;
+    ssl_config.prvtkey_len = prvtkey_end - prvtkey_start;
+#if CONFIG_METER_HTTPS_SESSION_TICKETS
+    ssl_config.session_tickets = true;
+#endif
+    httpd_config_t config = ssl_config.httpd;
+    /* A handshake costs far more than an idle connection, keep clients connected
+     * but make room for a new one by dropping the least recently used */
+    config.max_open_sockets = CONFIG_METER_HTTPS_MAX_SESSIONS;
+    config.lru_purge_enable = true;
+    config.keep_alive_enable = true;
+#else
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+#endif
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.open_fn = rest_on_open;
+    config.core_id = CONFIG_METER_NETWORK_CORE;
+    config.task_priority = CONFIG_METER_HTTPD_PRIORITY;
+
+    size_t bad;
+    REST_CHECK(router_init(&s_router, s_routes, sizeof(s_routes) / sizeof(s_routes[0]), &bad),
+               "Route %s is out of order or malformed", err, s_routes[bad].path);
+
+    buf_pool_init();
+#if CONFIG_METER_HTTPS_ENABLE
+    ESP_LOGI(REST_TAG, "Starting HTTPS Server");
+    ssl_config.httpd = config;
+    REST_CHECK(httpd_ssl_start(&server, &ssl_config) == ESP_OK, "Start server failed", err);
+#else
+    ESP_LOGI(REST_TAG, "Starting HTTP Server");
+    REST_CHECK(httpd_start(&server, &config) == ESP_OK, "Start server failed", err);
+#endif
 
-    /* URI handler for restarting the device */
-    httpd_uri_t restart_device_uri = {
-        .uri = "/api/v1/device/restart",
-        .method = HTTP_POST,
-        .handler = restart_device_handler,
+    /* Everything under /api goes to the route table, whatever the method */
+    httpd_uri_t api_uri = {
+        .uri = "/api/*",
+        .method = HTTP_ANY,
+        .handler = rest_api_dispatch,
         .user_ctx = rest_context
     };
-    httpd_register_uri_handler(server, &restart_device_uri);
+    REST_CHECK(httpd_register_uri_handler(server, &api_uri) == ESP_OK, "Register API dispatcher failed", err);
 
     /* URI handler for getting web server files */
     httpd_uri_t common_get_uri = {
@@ -450,11 +1749,9 @@ esp_err_t start_rest_server(const char *base_path)
         .handler = rest_common_get_handler,
         .user_ctx = rest_context
     };
-    httpd_register_uri_handler(server, &common_get_uri);
+    REST_CHECK(httpd_register_uri_handler(server, &common_get_uri) == ESP_OK, "Register file handler failed", err);
 
     return ESP_OK;
-err_start:
-    free(rest_context);
 err:
     return ESP_FAIL;
 }
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "cJSON.h"
+#include "cbor.h"
+#include "esp_err.h"
+#include "temperature.h"
+
+/**
+ * @brief Start the HTTP server and register the API and static file handlers
+ *
+ * @param base_path Mount point of the file system the web UI is served from
+ */
+esp_err_t start_rest_server(const char *base_path);
+
+/**
+ * @brief Add the probe readings and targets of a snapshot to a JSON object
+ */
+void rest_add_temp_json(cJSON *obj, const temperature_snapshot_t *snapshot);
+
+/**
+ * @brief Encode the probe readings and targets of a snapshot as a CBOR map
+ */
+void rest_encode_temp_cbor(CborEncoder *parent, const temperature_snapshot_t *snapshot);
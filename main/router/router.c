@@ -0,0 +1,263 @@
+#include "router.h"
+#include <string.h>
+
+/* Classes of a segment position, in sort order */
+enum {
+    SEG_END,
+    SEG_LITERAL,
+    SEG_PARAM,
+};
+
+/* Split a path into at most ROUTER_MAX_SEGMENTS non-empty segments; -1 if there are more */
+static int split(const char *path, size_t len, const char **seg, size_t *seg_len) {
+    int count = 0;
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && path[i] == '/') {
+            i++;
+        }
+        size_t start = i;
+        while (i < len && path[i] != '/') {
+            i++;
+        }
+        if (i == start) {
+            break;
+        }
+        if (count == ROUTER_MAX_SEGMENTS) {
+            return -1;
+        }
+        seg[count] = path + start;
+        seg_len[count++] = i - start;
+    }
+    return count;
+}
+
+/* Segment k of a route, which router_init has checked splits cleanly */
+static int route_segment(const router_route_t *route, size_t k, const char **text, size_t *len) {
+    const char *seg[ROUTER_MAX_SEGMENTS];
+    size_t seg_len[ROUTER_MAX_SEGMENTS];
+    int segments = split(route->path, strlen(route->path), seg, seg_len);
+    if ((int)k >= segments) {
+        return SEG_END;
+    }
+    *text = seg[k];
+    *len = seg_len[k];
+    return seg[k][0] == '{' ? SEG_PARAM : SEG_LITERAL;
+}
+
+/* Segments are a few bytes long, a loop beats a call to memcmp */
+static int compare_bytes(const char *a, size_t a_len, const char *b, size_t b_len) {
+    size_t len = a_len < b_len ? a_len : b_len;
+    for (size_t i = 0; i < len; i++) {
+        if (a[i] != b[i]) {
+            return (unsigned char)a[i] - (unsigned char)b[i];
+        }
+    }
+    return a_len < b_len ? -1 : a_len > b_len ? 1 : 0;
+}
+
+static int compare_routes(const router_route_t *a, const router_route_t *b) {
+    for (size_t k = 0;; k++) {
+        const char *a_text = NULL, *b_text = NULL;
+        size_t a_len = 0, b_len = 0;
+        int a_cls = route_segment(a, k, &a_text, &a_len);
+        int b_cls = route_segment(b, k, &b_text, &b_len);
+        if (a_cls != b_cls) {
+            return a_cls - b_cls;
+        }
+        if (a_cls == SEG_END) {
+            return a->method - b->method;
+        }
+        if (a_cls == SEG_LITERAL) {
+            int cmp = compare_bytes(a_text, a_len, b_text, b_len);
+            if (cmp != 0) {
+                return cmp;
+            }
+        }
+    }
+}
+
+static bool check_route(const router_route_t *route) {
+    const char *seg[ROUTER_MAX_SEGMENTS];
+    size_t seg_len[ROUTER_MAX_SEGMENTS];
+    int segments = split(route->path, strlen(route->path), seg, seg_len);
+    if (segments < 0) {
+        return false;
+    }
+    int params = 0;
+    for (int k = 0; k < segments; k++) {
+        if (seg_len[k] > UINT8_MAX) {
+            return false;
+        }
+        if (seg[k][0] == '{' && (seg_len[k] < 2 || seg[k][seg_len[k] - 1] != '}' || ++params > ROUTER_MAX_PARAMS)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool router_init(router_t *router, const router_route_t *routes, size_t count, size_t *bad) {
+    memset(router, 0, sizeof(*router));
+    router->routes = routes;
+    router->count = count;
+
+    for (size_t r = 0; r < count; r++) {
+        *bad = r;
+        if (r >= ROUTER_MAX_ROUTES || !check_route(&routes[r]) ||
+            (r > 0 && compare_routes(&routes[r - 1], &routes[r]) >= 0)) {
+            return false;
+        }
+    }
+
+    /*
+     * Build the tree breadth first, so the children of a node are created
+     * together and sit next to each other in sort order. Node i stands for the
+     * routes [lo[i], hi[i]) that share their first depth[i] segments.
+     */
+    uint8_t lo[ROUTER_MAX_NODES];
+    uint8_t hi[ROUTER_MAX_NODES];
+    uint8_t depth[ROUTER_MAX_NODES];
+    lo[0] = 0;
+    hi[0] = count;
+    depth[0] = 0;
+    router->node_count = 1;
+    for (size_t i = 0; i < router->node_count; i++) {
+        router_node_t *node = &router->nodes[i];
+        size_t r = lo[i];
+        const char *text;
+        size_t len;
+
+        /* Routes ending here sort first */
+        node->first_route = r;
+        while (r < hi[i] && route_segment(&routes[r], depth[i], &text, &len) == SEG_END) {
+            r++;
+        }
+        node->route_count = r - node->first_route;
+
+        node->first_child = router->node_count;
+        while (r < hi[i]) {
+            int cls = route_segment(&routes[r], depth[i], &text, &len);
+            size_t end = r + 1;
+            while (end < hi[i]) {
+                const char *next = NULL;
+                size_t next_len = 0;
+                if (route_segment(&routes[end], depth[i], &next, &next_len) != cls ||
+                    compare_bytes(text, len, next, next_len) != 0) {
+                    break;
+                }
+                end++;
+            }
+            /* One parameter child per node, so routes branching there must agree on its name */
+            if (cls == SEG_PARAM && end < hi[i]) {
+                *bad = end;
+                return false;
+            }
+            if (router->node_count == ROUTER_MAX_NODES) {
+                *bad = r;
+                return false;
+            }
+            size_t child = router->node_count++;
+            lo[child] = r;
+            hi[child] = end;
+            depth[child] = depth[i] + 1;
+            router->nodes[child].text = text;
+            router->nodes[child].len = len;
+            /* Parameters sort last, after the contiguous literal children */
+            if (cls == SEG_PARAM) {
+                node->param_child = child;
+            } else {
+                node->child_count++;
+            }
+            r = end;
+        }
+    }
+    return true;
+}
+
+bool router_lookup(const router_t *router, int method, const char *path, size_t path_len, router_match_t *match) {
+    match->route = NULL;
+    match->first = 0;
+    match->last = 0;
+    match->params.count = 0;
+    if (router->count == 0) {
+        return false;
+    }
+
+    /* Walk the tree while splitting the path, a segment at a time */
+    const router_node_t *node = &router->nodes[0];
+    size_t i = 0;
+    for (;;) {
+        while (i < path_len && path[i] == '/') {
+            i++;
+        }
+        if (i == path_len) {
+            break;
+        }
+        const char *seg = &path[i];
+        while (i < path_len && path[i] != '/') {
+            i++;
+        }
+        size_t seg_len = &path[i] - seg;
+
+        size_t lo = node->first_child;
+        size_t hi = lo + node->child_count;
+        const router_node_t *next = NULL;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            int cmp = compare_bytes(router->nodes[mid].text, router->nodes[mid].len, seg, seg_len);
+            if (cmp < 0) {
+                lo = mid + 1;
+            } else if (cmp > 0) {
+                hi = mid;
+            } else {
+                next = &router->nodes[mid];
+                break;
+            }
+        }
+        if (next == NULL) {
+            if (node->param_child == 0 || match->params.count == ROUTER_MAX_PARAMS) {
+                return false;
+            }
+            next = &router->nodes[node->param_child];
+            size_t n = match->params.count++;
+            match->params.param[n].name = next->text + 1;
+            match->params.param[n].name_len = next->len - 2;
+            match->params.param[n].value = seg;
+            match->params.param[n].value_len = seg_len;
+        }
+        node = next;
+    }
+    match->first = node->first_route;
+    match->last = node->first_route + node->route_count;
+
+    size_t lo = match->first;
+    size_t hi = match->last;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (router->routes[mid].method < method) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == match->last || router->routes[lo].method != method) {
+        return false;
+    }
+    match->route = &router->routes[lo];
+    return true;
+}
+
+bool router_param(const router_params_t *params, const char *name, char *buf, size_t size) {
+    size_t name_len = strlen(name);
+    for (size_t i = 0; i < params->count; i++) {
+        if (params->param[i].name_len == name_len && memcmp(params->param[i].name, name, name_len) == 0) {
+            if (params->param[i].value_len >= size) {
+                return false;
+            }
+            memcpy(buf, params->param[i].value, params->param[i].value_len);
+            buf[params->param[i].value_len] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Route lookup over a static table sorted by path, then method. Paths are
+ * split into segments at '/', and a segment written as "{name}" matches any
+ * one segment of a request and captures it as a parameter. Plain C without any
+ * ESP-IDF dependency, so tools/route_bench.py can run it on the host.
+ *
+ * Sort order of a segment position: a path that has ended sorts first, then
+ * literal segments bytewise, then parameters. router_init checks the order and
+ * builds a prefix tree of segments over the table, in which the literal
+ * children of a node are contiguous and sorted, so lookup takes one binary
+ * search per segment of the request. Literal segments win over parameters at
+ * the same position, without backtracking, and routes that share a parameter
+ * position must give it the same name.
+ */
+
+#define ROUTER_MAX_ROUTES   64
+#define ROUTER_MAX_SEGMENTS 8
+#define ROUTER_MAX_PARAMS   4
+#define ROUTER_MAX_NODES    128
+
+typedef struct {
+    int method;       /* Method number of the HTTP server, e.g. HTTP_GET */
+    const char *path; /* e.g. "/api/v1/sessions/{id}/export" */
+    const void *data; /* Handler and whatever else the caller dispatches on */
+} router_route_t;
+
+typedef struct {
+    size_t count;
+    struct {
+        const char *name; /* Points into the route's path, name_len bytes without the braces */
+        size_t name_len;
+        const char *value; /* Points into the request path, value_len bytes */
+        size_t value_len;
+    } param[ROUTER_MAX_PARAMS];
+} router_params_t;
+
+typedef struct {
+    const char *text;     /* Segment leading here, "{name}" for a parameter, points into a route's path */
+    uint8_t len;
+    uint8_t child_count;  /* Literal children, sorted */
+    uint16_t first_child;
+    uint16_t param_child; /* Child for a parameter segment, 0 for none */
+    uint8_t first_route;  /* Routes whose path ends here, sorted by method */
+    uint8_t route_count;
+} router_node_t;
+
+typedef struct {
+    const router_route_t *routes;
+    size_t count;
+    size_t node_count;
+    router_node_t nodes[ROUTER_MAX_NODES]; /* The root comes first */
+} router_t;
+
+typedef struct {
+    const router_route_t *route; /* Route matching path and method, NULL if none */
+    size_t first;                /* Routes [first, last) match the path, whatever their method */
+    size_t last;
+    router_params_t params;
+} router_match_t;
+
+/**
+ * @brief Index a route table
+ *
+ * @param router Router to initialize, keeps a pointer to routes
+ * @param routes Table sorted as described above, must outlive the router
+ * @param count Number of routes, at most ROUTER_MAX_ROUTES
+ * @param bad Set to the index of the first route that is out of order, a
+ *            duplicate, has too many segments or parameters, names a
+ *            parameter differently from its neighbours, or needs more than
+ *            ROUTER_MAX_NODES nodes
+ * @return bool false if the table cannot be used
+ */
+bool router_init(router_t *router, const router_route_t *routes, size_t count, size_t *bad);
+
+/**
+ * @brief Find the route for a request
+ *
+ * @param router Router
+ * @param method Method of the request
+ * @param path Request path without the query string, need not be NUL terminated
+ * @param path_len Length of the path
+ * @param match Filled with the route, the range of routes with a matching path and the parameters
+ * @return bool Whether a route matched both path and method. If only the path
+ *              matched, match->first < match->last and the response is 405.
+ */
+bool router_lookup(const router_t *router, int method, const char *path, size_t path_len, router_match_t *match);
+
+/**
+ * @brief Copy a parameter of a match as a NUL terminated string
+ *
+ * @param params Parameters of a match
+ * @param name Name of the parameter, without braces
+ * @param buf Destination
+ * @param size Size of buf
+ * @return bool false if there is no such parameter or it does not fit
+ */
+bool router_param(const router_params_t *params, const char *name, char *buf, size_t size);
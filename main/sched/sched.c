@@ -0,0 +1,125 @@
+#include "sched.h"
+#include <string.h>
+
+#define SLOPE_TAU_MIN    2.0f /* Time constant of the rate of change filter, in minutes */
+#define SPIKE_MIN_STEP_C 2    /* A one degree step is quantisation, however short the period */
+
+static const char *s_reason_names[] = {
+    [SCHED_REASON_START] = "start",
+    [SCHED_REASON_STEADY] = "steady",
+    [SCHED_REASON_APPROACH] = "approach",
+    [SCHED_REASON_NEAR_TARGET] = "near_target",
+    [SCHED_REASON_SPIKE] = "spike",
+    [SCHED_REASON_FAULT] = "fault",
+};
+
+void sched_init(sched_t *sched, const sched_config_t *config) {
+    memset(sched, 0, sizeof(*sched));
+    sched->config = *config;
+    if (sched->config.max_period_ms < sched->config.min_period_ms) {
+        sched->config.max_period_ms = sched->config.min_period_ms;
+    }
+    if (sched->config.samples_to_target == 0) {
+        sched->config.samples_to_target = 1;
+    }
+    sched->period_ms = sched->config.min_period_ms;
+    sched->reason = SCHED_REASON_START;
+}
+
+void sched_resume(sched_t *sched, uint32_t period_ms, sched_reason_t reason, const int32_t *temp, const float *slope,
+                  uint32_t fault_mask, int64_t now_us) {
+    const sched_config_t *config = &sched->config;
+    sched->period_ms = period_ms < config->min_period_ms   ? config->min_period_ms
+                       : period_ms > config->max_period_ms ? config->max_period_ms
+                                                           : period_ms;
+    sched->reason = reason;
+    sched->primed = true;
+    sched->last_us = now_us - sched->period_ms * 1000LL;
+    sched->fault_mask = fault_mask;
+    memcpy(sched->temp, temp, sizeof(sched->temp));
+    memcpy(sched->slope, slope, sizeof(sched->slope));
+}
+
+/* Reasons are ordered by urgency, the most urgent one is reported */
+static void raise_reason(sched_reason_t *reason, sched_reason_t candidate) {
+    if (candidate > *reason) {
+        *reason = candidate;
+    }
+}
+
+uint32_t sched_update(sched_t *sched, const int32_t *temp, const int32_t *target, uint32_t fault_mask,
+                      int64_t now_us) {
+    const sched_config_t *config = &sched->config;
+    float want_ms = config->max_period_ms;
+    sched_reason_t reason = SCHED_REASON_STEADY;
+    float dt_min = sched->primed ? (now_us - sched->last_us) / 60e6f : 0;
+
+    if (sched->primed && fault_mask != sched->fault_mask) {
+        want_ms = config->min_period_ms;
+        raise_reason(&reason, SCHED_REASON_FAULT);
+    }
+
+    for (int i = 0; i < SCHED_PROBE_COUNT; i++) {
+        uint32_t bit = 1 << i;
+        if (fault_mask & bit) {
+            continue;
+        }
+
+        if (sched->primed && !(sched->fault_mask & bit) && dt_min > 0) {
+            int32_t step = temp[i] - sched->temp[i];
+            float rate = step / dt_min;
+            sched->slope[i] += dt_min / (SLOPE_TAU_MIN + dt_min) * (rate - sched->slope[i]);
+            if ((step >= SPIKE_MIN_STEP_C || step <= -SPIKE_MIN_STEP_C) &&
+                (rate >= config->spike_c_per_min || rate <= -config->spike_c_per_min)) {
+                want_ms = config->min_period_ms;
+                raise_reason(&reason, SCHED_REASON_SPIKE);
+            }
+        } else {
+            /* First reading, or first since the probe was plugged back in */
+            sched->slope[i] = 0;
+        }
+        sched->temp[i] = temp[i];
+
+        if (target[i] <= 0) {
+            continue;
+        }
+        int32_t distance = target[i] - temp[i];
+        if (distance < -config->near_c) {
+            /* Well past the target, the alarm has long been raised */
+        } else if (distance <= config->near_c) {
+            want_ms = config->min_period_ms;
+            raise_reason(&reason, SCHED_REASON_NEAR_TARGET);
+        } else if (sched->slope[i] > 0) {
+            /* Spread samples_to_target samples over the time left at the current rate */
+            float approach_ms = distance / sched->slope[i] * 60000.0f / config->samples_to_target;
+            if (approach_ms < want_ms) {
+                want_ms = approach_ms;
+                raise_reason(&reason, SCHED_REASON_APPROACH);
+            }
+        }
+    }
+
+    if (!sched->primed) {
+        want_ms = config->min_period_ms;
+        reason = SCHED_REASON_START;
+        sched->primed = true;
+    }
+
+    uint32_t want = want_ms < config->min_period_ms   ? config->min_period_ms
+                    : want_ms > config->max_period_ms ? config->max_period_ms
+                                                      : (uint32_t)want_ms;
+    if (want < sched->period_ms) {
+        sched->period_ms = want;
+    } else {
+        uint32_t grown = sched->period_ms + sched->period_ms / 2;
+        sched->period_ms = grown < want ? grown : want;
+    }
+    sched->reason = reason;
+    sched->fault_mask = fault_mask;
+    sched->last_us = now_us;
+    return sched->period_ms;
+}
+
+const char *sched_reason_name(sched_reason_t reason) {
+    return reason < sizeof(s_reason_names) / sizeof(s_reason_names[0]) ? s_reason_names[reason] : "unknown";
+}
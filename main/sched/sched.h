@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Picks the next sampling period from the latest readings. Plain C without any
+ * ESP-IDF dependency, so tools/sampling_sim.py can run it on the host.
+ */
+
+#define SCHED_PROBE_COUNT 4
+
+typedef enum {
+    SCHED_REASON_START,       /* No readings to judge yet */
+    SCHED_REASON_STEADY,      /* Nothing is happening, backing off */
+    SCHED_REASON_APPROACH,    /* A probe will reach its target within a few of the current periods */
+    SCHED_REASON_NEAR_TARGET, /* A probe is within near_c of its target */
+    SCHED_REASON_SPIKE,       /* A reading changed much faster than a cook does, e.g. the lid was opened */
+    SCHED_REASON_FAULT,       /* A probe was plugged in or pulled out */
+} sched_reason_t;
+
+typedef struct {
+    uint32_t min_period_ms;      /* Period near a target and while readings move fast */
+    uint32_t max_period_ms;      /* Period during steady phases, equal to min_period_ms for a fixed rate */
+    int32_t near_c;              /* Distance to a target, either side, within which min_period_ms is used */
+    int32_t spike_c_per_min;     /* Rate of change that counts as a spike */
+    uint32_t samples_to_target;  /* Samples wanted before a probe reaches its target at its current rate */
+} sched_config_t;
+
+typedef struct {
+    sched_config_t config;
+    uint32_t period_ms;
+    sched_reason_t reason;
+    bool primed;
+    int64_t last_us;
+    uint32_t fault_mask;
+    int32_t temp[SCHED_PROBE_COUNT];
+    float slope[SCHED_PROBE_COUNT]; /* Smoothed rate of change in C per minute */
+} sched_t;
+
+/**
+ * @brief Start a schedule at the shortest period
+ *
+ * @param sched Schedule to initialize
+ * @param config Limits and thresholds, copied
+ */
+void sched_init(sched_t *sched, const sched_config_t *config);
+
+/**
+ * @brief Carry on a schedule saved before a reset
+ *
+ * The saved readings count as taken one period before now_us, the time the
+ * device was down is unknown.
+ *
+ * @param sched Schedule initialized with sched_init()
+ * @param period_ms Period it had picked
+ * @param reason Why
+ * @param temp Readings it had seen, in C
+ * @param slope Its rate of change estimates, in C per minute
+ * @param fault_mask Probes that were faulty
+ * @param now_us Current time
+ */
+void sched_resume(sched_t *sched, uint32_t period_ms, sched_reason_t reason, const int32_t *temp, const float *slope,
+                  uint32_t fault_mask, int64_t now_us);
+
+/**
+ * @brief Account for a new sample and pick the period until the next one
+ *
+ * The period drops to what the readings call for at once and grows back by
+ * half per sample, so a short quiet spell does not stretch it right away.
+ *
+ * @param sched Schedule
+ * @param temp Reading of every probe in C
+ * @param target Target of every probe in C, 0 for none
+ * @param fault_mask Bit n set while probe n is faulty, its reading is then ignored
+ * @param now_us Time the sample was taken
+ * @return uint32_t Milliseconds until the next sample
+ */
+uint32_t sched_update(sched_t *sched, const int32_t *temp, const int32_t *target, uint32_t fault_mask,
+                      int64_t now_us);
+
+/**
+ * @brief Name of a reason for logs and metrics
+ */
+const char *sched_reason_name(sched_reason_t reason);
@@ -0,0 +1,450 @@
+#include "session.h"
+#include "checkpoint.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mem.h"
+#include "sdkconfig.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Every session is one file, <base>/sessions/<id>.ses: a fixed header followed
+ * by one session_record_t per sample. The listener only pushes records into a
+ * queue; the recorder task batches them and appends to the file, syncing every
+ * few seconds so a reboot loses at most that much of the cook.
+ *
+ * s_lock guards the open file, the active session and the batch. Records are
+ * tagged with their session so one that is still queued when a session stops
+ * never ends up in the next one.
+ */
+
+#define SESSION_MAGIC    0x31534553 /* "SES1" */
+#define SESSION_VERSION  1
+#define SESSION_PATH_MAX 64
+#define QUEUE_LEN        16
+#define BATCH_RECORDS    32
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t id;
+    uint32_t min_period_ms; /* Shortest sampling period, samples are further apart while nothing changes */
+    uint32_t stopped;
+    char label[SESSION_LABEL_MAX];
+} session_header_t;
+
+static const char *TAG = "session";
+
+static char s_dir[SESSION_PATH_MAX];
+/* Set once s_dir exists, the API refuses to work on sessions before */
+static bool s_ready;
+static SemaphoreHandle_t s_lock;
+static StaticSemaphore_t s_lock_buf;
+static QueueHandle_t s_queue;
+static StaticQueue_t s_queue_buf;
+static uint8_t s_queue_storage[QUEUE_LEN * sizeof(session_record_t)];
+
+static FILE *s_file;              /* Open while a session is active */
+static session_header_t s_header; /* Header of the active session */
+static session_record_t s_batch[BATCH_RECORDS];
+static size_t s_batch_count;
+static uint32_t s_next_id = 1;
+static session_stats_t s_stats;
+
+/* Read by the listener without the lock */
+static volatile bool s_active;
+static volatile uint16_t s_active_tag;
+static volatile uint32_t s_active_id;
+static volatile int64_t s_start_us;
+
+static void session_path(uint32_t id, char *path, size_t size) {
+    snprintf(path, size, "%s/%lu.ses", s_dir, id);
+}
+
+/* Parse "<id>.ses", returning 0 for anything else */
+static uint32_t parse_file_name(const char *name) {
+    char *end;
+    unsigned long id = strtoul(name, &end, 10);
+    return end != name && strcmp(end, ".ses") == 0 ? id : 0;
+}
+
+static bool read_header(FILE *file, session_header_t *header) {
+    return fseek(file, 0, SEEK_SET) == 0 && fread(header, sizeof(*header), 1, file) == 1 &&
+           header->magic == SESSION_MAGIC && header->record_size == sizeof(session_record_t);
+}
+
+static bool write_header(FILE *file, const session_header_t *header) {
+    return fseek(file, 0, SEEK_SET) == 0 && fwrite(header, sizeof(*header), 1, file) == 1 && fflush(file) == 0;
+}
+
+/* Called from the publisher task, must not block the listeners after it */
+static void session_sample(const temperature_snapshot_t *snapshot) {
+    if (!s_active) {
+        return;
+    }
+    session_record_t record = {
+        .t_ms = (snapshot->timestamp_us - s_start_us) / 1000,
+        .fault_mask = snapshot->fault_mask,
+        .alarm_mask = snapshot->alarm_mask,
+        .session = s_active_tag,
+    };
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        record.temp[i] = snapshot->temp[i];
+    }
+    if (xQueueSend(s_queue, &record, 0) != pdTRUE) {
+        s_stats.dropped++;
+    }
+}
+
+/* Add a record to the batch of the active session, dropping it if it belongs to another. Called with s_lock held */
+static void add_record(const session_record_t *record) {
+    if (s_file == NULL || record->session != (uint16_t)s_header.id) {
+        return;
+    }
+    s_batch[s_batch_count++] = *record;
+}
+
+/* Append the batch to the active session. Called with s_lock held */
+static void flush_batch(bool sync) {
+    if (s_file == NULL) {
+        s_batch_count = 0;
+        return;
+    }
+    if (s_batch_count > 0) {
+        if (fwrite(s_batch, sizeof(s_batch[0]), s_batch_count, s_file) != s_batch_count) {
+            s_stats.write_errors++;
+        } else {
+            s_stats.recorded += s_batch_count;
+        }
+        s_batch_count = 0;
+    }
+    if (sync) {
+        fflush(s_file);
+        fsync(fileno(s_file));
+    }
+}
+
+static void recorder_task(void *arg) {
+    const TickType_t sync_period = pdMS_TO_TICKS(CONFIG_METER_SESSION_FLUSH_S * 1000);
+    TickType_t last_sync = xTaskGetTickCount();
+
+    for (;;) {
+        session_record_t record;
+        bool received = xQueueReceive(s_queue, &record, pdMS_TO_TICKS(1000)) == pdTRUE;
+        bool sync = xTaskGetTickCount() - last_sync >= sync_period;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (received) {
+            add_record(&record);
+        }
+        if (s_batch_count == BATCH_RECORDS || sync) {
+            flush_batch(sync);
+        }
+        xSemaphoreGive(s_lock);
+
+        if (sync) {
+            last_sync = xTaskGetTickCount();
+        }
+    }
+}
+
+/* Write out and close the active session. Called with s_lock held */
+static void close_active(void) {
+    if (s_file == NULL) {
+        return;
+    }
+    s_active = false;
+    session_record_t record;
+    while (xQueueReceive(s_queue, &record, 0) == pdTRUE) {
+        add_record(&record);
+        if (s_batch_count == BATCH_RECORDS) {
+            flush_batch(false);
+        }
+    }
+    flush_batch(false);
+
+    s_header.stopped = 1;
+    if (!write_header(s_file, &s_header)) {
+        ESP_LOGE(TAG, "Failed to finalize session %lu", s_header.id);
+    }
+    fclose(s_file);
+    s_file = NULL;
+    ESP_LOGI(TAG, "Stopped session %lu", s_header.id);
+}
+
+esp_err_t session_start(const char *label, uint32_t *id) {
+    char path[SESSION_PATH_MAX];
+    if (!s_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    close_active();
+
+    memset(&s_header, 0, sizeof(s_header));
+    s_header.magic = SESSION_MAGIC;
+    s_header.version = SESSION_VERSION;
+    s_header.record_size = sizeof(session_record_t);
+    s_header.id = s_next_id;
+    s_header.min_period_ms = CONFIG_METER_SAMPLE_PERIOD_MS;
+    strlcpy(s_header.label, label, sizeof(s_header.label));
+
+    session_path(s_header.id, path, sizeof(path));
+    s_file = fopen(path, "w+b");
+    if (s_file == NULL || !write_header(s_file, &s_header)) {
+        ESP_LOGE(TAG, "Cannot create %s", path);
+        if (s_file != NULL) {
+            fclose(s_file);
+            s_file = NULL;
+            unlink(path);
+        }
+        xSemaphoreGive(s_lock);
+        return ESP_FAIL;
+    }
+    fseek(s_file, 0, SEEK_END);
+    s_next_id++;
+    s_start_us = esp_timer_get_time();
+    s_active_tag = s_header.id;
+    s_active_id = s_header.id;
+    s_active = true;
+    *id = s_header.id;
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGI(TAG, "Recording session %lu \"%s\"", *id, s_header.label);
+    return ESP_OK;
+}
+
+esp_err_t session_stop(void) {
+    if (!s_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = s_file != NULL ? ESP_OK : ESP_ERR_INVALID_STATE;
+    close_active();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t session_set_label(uint32_t id, const char *label) {
+    if (!s_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    if (s_file != NULL && id == s_header.id) {
+        strlcpy(s_header.label, label, sizeof(s_header.label));
+        if (!write_header(s_file, &s_header)) {
+            err = ESP_FAIL;
+        }
+        fseek(s_file, 0, SEEK_END);
+    } else {
+        char path[SESSION_PATH_MAX];
+        session_header_t header;
+        session_path(id, path, sizeof(path));
+        FILE *file = fopen(path, "r+b");
+        if (file == NULL || !read_header(file, &header)) {
+            err = ESP_ERR_NOT_FOUND;
+        } else {
+            strlcpy(header.label, label, sizeof(header.label));
+            err = write_header(file, &header) ? ESP_OK : ESP_FAIL;
+        }
+        if (file != NULL) {
+            fclose(file);
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t session_delete(uint32_t id) {
+    char path[SESSION_PATH_MAX];
+    if (!s_ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    session_path(id, path, sizeof(path));
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    if (s_file != NULL && id == s_header.id) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (unlink(path) != 0) {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+/* Fill info from an open session file, whose size gives the number of samples */
+static bool get_info(int fd, session_info_t *info) {
+    session_header_t header;
+    struct stat st;
+    if (lseek(fd, 0, SEEK_SET) != 0 || read(fd, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != SESSION_MAGIC || header.record_size != sizeof(session_record_t) || fstat(fd, &st) != 0) {
+        return false;
+    }
+    info->id = header.id;
+    strlcpy(info->label, header.label, sizeof(info->label));
+    info->min_period_ms = header.min_period_ms;
+    info->samples = st.st_size > sizeof(header) ? (st.st_size - sizeof(header)) / sizeof(session_record_t) : 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    info->active = s_file != NULL && header.id == s_header.id;
+    xSemaphoreGive(s_lock);
+    return true;
+}
+
+int session_open(uint32_t id, session_info_t *info) {
+    char path[SESSION_PATH_MAX];
+    if (!s_ready) {
+        return -1;
+    }
+    session_path(id, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (!get_info(fd, info)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+size_t session_list(session_info_t *infos, size_t max) {
+    if (!s_ready) {
+        return 0;
+    }
+    DIR *dir = opendir(s_dir);
+    if (dir == NULL) {
+        return 0;
+    }
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && max > 0) {
+        uint32_t id = parse_file_name(entry->d_name);
+        session_info_t info;
+        if (id == 0 || (count == max && id < infos[0].id)) {
+            continue;
+        }
+        int fd = session_open(id, &info);
+        if (fd < 0) {
+            continue;
+        }
+        close(fd);
+        /* Insertion sort, directories are listed in no particular order. Once full the oldest makes room */
+        if (count == max) {
+            memmove(&infos[0], &infos[1], (max - 1) * sizeof(infos[0]));
+            count--;
+        }
+        size_t i = count++;
+        while (i > 0 && infos[i - 1].id > info.id) {
+            infos[i] = infos[i - 1];
+            i--;
+        }
+        infos[i] = info;
+    }
+    closedir(dir);
+    return count;
+}
+
+void session_get_stats(session_stats_t *stats) {
+    *stats = s_stats;
+}
+
+bool session_get_active(int64_t timestamp_us, uint32_t *id, uint32_t *t_ms) {
+    if (!s_active) {
+        return false;
+    }
+    *id = s_active_id;
+    *t_ms = (timestamp_us - s_start_us) / 1000;
+    return true;
+}
+
+/*
+ * Find the next free id and mark sessions that were recording when the device
+ * went down as stopped, except resume_id, which is to carry on recording
+ */
+static void scan_sessions(uint32_t resume_id) {
+    DIR *dir = opendir(s_dir);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        uint32_t id = parse_file_name(entry->d_name);
+        if (id == 0) {
+            continue;
+        }
+        if (id >= s_next_id) {
+            s_next_id = id + 1;
+        }
+        char path[SESSION_PATH_MAX];
+        session_header_t header;
+        session_path(id, path, sizeof(path));
+        FILE *file = fopen(path, "r+b");
+        if (file != NULL && read_header(file, &header) && !header.stopped && id != resume_id) {
+            header.stopped = 1;
+            write_header(file, &header);
+            ESP_LOGW(TAG, "Session %lu was interrupted by a reboot", id);
+        }
+        if (file != NULL) {
+            fclose(file);
+        }
+    }
+    closedir(dir);
+}
+
+/* Carry on recording a session from its length at the last checkpoint */
+static bool resume_session(uint32_t id, uint32_t t_ms) {
+    char path[SESSION_PATH_MAX];
+    session_path(id, path, sizeof(path));
+    FILE *file = fopen(path, "r+b");
+    if (file == NULL || !read_header(file, &s_header) || s_header.stopped || fseek(file, 0, SEEK_END) != 0) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        memset(&s_header, 0, sizeof(s_header));
+        return false;
+    }
+    /* A record cut short by the reset is overwritten by the next one */
+    long size = ftell(file);
+    long records = size > (long)sizeof(s_header) ? (size - sizeof(s_header)) / sizeof(session_record_t) : 0;
+    fseek(file, sizeof(s_header) + records * sizeof(session_record_t), SEEK_SET);
+
+    s_file = file;
+    s_start_us = esp_timer_get_time() - t_ms * 1000LL;
+    s_active_tag = id;
+    s_active_id = id;
+    s_active = true;
+    ESP_LOGW(TAG, "Resumed session %lu \"%s\" at %lu s, %ld samples", id, s_header.label, t_ms / 1000, records);
+    return true;
+}
+
+void session_init(const char *base_path) {
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+    s_queue = xQueueCreateStatic(QUEUE_LEN, sizeof(session_record_t), s_queue_storage, &s_queue_buf);
+    snprintf(s_dir, sizeof(s_dir), "%s" SESSION_DIR, base_path);
+    if (mkdir(s_dir, 0755) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG, "Cannot create %s, sessions are unavailable", s_dir);
+        return;
+    }
+    s_ready = true;
+    const checkpoint_state_t *restored = checkpoint_restored();
+    uint32_t resume_id = restored != NULL ? restored->session_id : 0;
+    scan_sessions(resume_id);
+    if (resume_id != 0 && !resume_session(resume_id, restored->session_ms)) {
+        ESP_LOGW(TAG, "Session %lu of the checkpoint cannot be resumed", resume_id);
+    }
+
+    ESP_ERROR_CHECK(temperature_add_listener(session_sample));
+    MEM_TASK_CREATE(recorder_task, "recorder", 4096, NULL, 2, CONFIG_METER_NETWORK_CORE);
+    ESP_LOGI(TAG, "Sessions in %s, next id %lu", s_dir, s_next_id);
+}
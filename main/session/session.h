@@ -0,0 +1,114 @@
+#pragma once
+
+#include "esp_err.h"
+#include "temperature.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SESSION_LABEL_MAX 32
+/* Directory below the file system's mount point that holds the sessions, not to be served as web UI files */
+#define SESSION_DIR "/sessions"
+
+/**
+ * @brief One stored sample of a session. Temperatures of faulty probes are 0
+ */
+typedef struct {
+    uint32_t t_ms; /* Since the session started */
+    int16_t temp[TEMPERATURE_PROBE_COUNT];
+    uint8_t fault_mask;
+    uint8_t alarm_mask;
+    uint16_t session; /* Low 16 bits of the id of the session the sample was taken for */
+} session_record_t;
+
+typedef struct {
+    uint32_t id;
+    char label[SESSION_LABEL_MAX];
+    uint32_t samples;
+    uint32_t min_period_ms; /* Sampling period while probes change, see t_ms of the records for the actual times */
+    bool active;
+} session_info_t;
+
+typedef struct {
+    uint32_t recorded; /* Samples written since boot */
+    uint32_t dropped;  /* Samples lost because the recorder fell behind */
+    uint32_t write_errors;
+} session_stats_t;
+
+/**
+ * @brief Prepare <base_path>/sessions, close sessions interrupted by a reboot and start the recorder
+ *
+ * If the directory cannot be created, sessions are unavailable until the next
+ * boot: the list is empty and the other calls fail.
+ *
+ * The session checkpoint_restored() names keeps recording instead, its samples
+ * continuing from its length at the checkpoint. Must be called after
+ * checkpoint_init() and before temperature_sampler_start().
+ *
+ * @param base_path Mount point of the file system sessions are stored on
+ */
+void session_init(const char *base_path);
+
+/**
+ * @brief Start recording every sample into a new session, stopping the active one
+ *
+ * @param label Free text, truncated to SESSION_LABEL_MAX - 1 bytes
+ * @param id Receives the id of the new session
+ * @return esp_err_t ESP_ERR_INVALID_STATE if the sessions directory could not be created
+ */
+esp_err_t session_start(const char *label, uint32_t *id);
+
+/**
+ * @brief Stop the active session
+ *
+ * @return esp_err_t ESP_ERR_INVALID_STATE if no session is active or sessions are unavailable
+ */
+esp_err_t session_stop(void);
+
+/**
+ * @brief Change the label of a session
+ *
+ * @return esp_err_t ESP_ERR_NOT_FOUND for an unknown id, ESP_ERR_INVALID_STATE if sessions are unavailable
+ */
+esp_err_t session_set_label(uint32_t id, const char *label);
+
+/**
+ * @brief Delete a stopped session
+ *
+ * @return esp_err_t ESP_ERR_INVALID_STATE for the active session or if sessions are unavailable, ESP_ERR_NOT_FOUND
+ * for an unknown id
+ */
+esp_err_t session_delete(uint32_t id);
+
+/**
+ * @brief List the newest stored sessions in ascending id order
+ *
+ * @param infos Destination
+ * @param max Number of entries in infos, older sessions beyond that are left out
+ * @return size_t Number of sessions written
+ */
+size_t session_list(session_info_t *infos, size_t max);
+
+/**
+ * @brief Open a session for reading its records
+ *
+ * Samples of the active session become readable once the recorder flushed them,
+ * at most CONFIG_METER_SESSION_FLUSH_S seconds after they were taken.
+ *
+ * @param id Session id
+ * @param info Receives the session's details
+ * @return int File descriptor positioned at the first record, -1 for an unknown id. Close with close()
+ */
+int session_open(uint32_t id, session_info_t *info);
+
+void session_get_stats(session_stats_t *stats);
+
+/**
+ * @brief Which session a sample belongs to. Called from the sampler task, does not block
+ *
+ * @param timestamp_us Time the sample was taken
+ * @param id Receives the id of the active session
+ * @param t_ms Receives the sample's time within that session
+ * @return bool false if no session is active
+ */
+bool session_get_active(int64_t timestamp_us, uint32_t *id, uint32_t *t_ms);
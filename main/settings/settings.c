@@ -5,6 +5,7 @@
 #include "esp_log.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 static const char *TAG = "settings";
 
@@ -95,4 +96,22 @@ void settings_get_temp_target(int32_t *temp_0, int32_t *temp_1, int32_t *temp_2,
     nvs_get_i32(settings_nvs_handle, "temp_1", temp_1);
     nvs_get_i32(settings_nvs_handle, "temp_2", temp_2);
     nvs_get_i32(settings_nvs_handle, "temp_3", temp_3);
+}
+
+void settings_set_scratch(const int32_t *values, size_t count) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "scratch_%u", (unsigned)i);
+        nvs_set_i32(settings_nvs_handle, key, values[i]);
+    }
+    nvs_commit(settings_nvs_handle);
+}
+
+void settings_erase_scratch(size_t count) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "scratch_%u", (unsigned)i);
+        nvs_erase_key(settings_nvs_handle, key);
+    }
+    nvs_commit(settings_nvs_handle);
 }
\ No newline at end of file
@@ -16,4 +16,9 @@ void settings_set_wifi_config(const uint8_t *ssid, size_t ssid_len, const uint8_
 
 void settings_set_temp_target(int32_t temp_0, int32_t temp_1, int32_t temp_2, int32_t temp_3); 
 
-void settings_get_temp_target(int32_t *temp_0, int32_t *temp_1, int32_t *temp_2, int32_t *temp_3);
\ No newline at end of file
+void settings_get_temp_target(int32_t *temp_0, int32_t *temp_1, int32_t *temp_2, int32_t *temp_3);
+
+/* Scratch keys next to the settings for benchmarking NVS writes, nothing reads them */
+void settings_set_scratch(const int32_t *values, size_t count);
+
+void settings_erase_scratch(size_t count);
\ No newline at end of file
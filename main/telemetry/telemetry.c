@@ -0,0 +1,121 @@
+#include "telemetry.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "mdns.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+static const char *TAG = "telemetry";
+
+/* Wire format of one datagram, all fields little-endian. Temperatures are in 0.1 degC. */
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t probe_count;
+    uint32_t seq;
+    uint32_t uptime_ms;
+    struct __attribute__((packed)) {
+        int16_t temp;
+        int16_t target;
+    } probes[TEMPERATURE_PROBE_COUNT];
+} telemetry_datagram_t;
+
+_Static_assert(sizeof(telemetry_datagram_t) == 12 + 4 * TEMPERATURE_PROBE_COUNT, "unexpected datagram layout");
+
+#ifdef CONFIG_METER_TELEMETRY_ENABLE
+
+static int s_sock = -1;
+static struct sockaddr_in s_group_addr;
+static uint32_t s_send_errors = 0;
+
+static int16_t to_decidegrees(int32_t degrees) {
+    int32_t value = degrees * 10;
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)value;
+}
+
+static void telemetry_publish(const temperature_snapshot_t *snapshot) {
+    telemetry_datagram_t datagram = {
+        .magic = TELEMETRY_MAGIC,
+        .version = TELEMETRY_VERSION,
+        .probe_count = TEMPERATURE_PROBE_COUNT,
+        .seq = snapshot->seq,
+        .uptime_ms = (uint32_t)(snapshot->timestamp_us / 1000),
+    };
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        datagram.probes[i].temp = to_decidegrees(snapshot->temp[i]);
+        datagram.probes[i].target = to_decidegrees(snapshot->target[i]);
+    }
+
+    /* Never block the publisher: drop the datagram if the stack cannot take it right now */
+    int err = sendto(s_sock, &datagram, sizeof(datagram), MSG_DONTWAIT, (struct sockaddr *)&s_group_addr,
+                     sizeof(s_group_addr));
+    if (err < 0 && (s_send_errors++ % 100) == 0) {
+        ESP_LOGW(TAG, "sendto failed: errno %d (%lu errors)", errno, s_send_errors);
+    }
+}
+
+void telemetry_init(void) {
+    s_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (s_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        return;
+    }
+
+    uint8_t ttl = CONFIG_METER_TELEMETRY_TTL;
+    setsockopt(s_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+    memset(&s_group_addr, 0, sizeof(s_group_addr));
+    s_group_addr.sin_family = AF_INET;
+    s_group_addr.sin_port = htons(CONFIG_METER_TELEMETRY_PORT);
+    if (inet_aton(CONFIG_METER_TELEMETRY_GROUP, &s_group_addr.sin_addr) == 0) {
+        ESP_LOGE(TAG, "Invalid multicast group: %s", CONFIG_METER_TELEMETRY_GROUP);
+        close(s_sock);
+        s_sock = -1;
+        return;
+    }
+
+    ESP_ERROR_CHECK(temperature_add_listener(telemetry_publish));
+    ESP_LOGI(TAG, "Publishing %d byte datagrams to %s:%d", sizeof(telemetry_datagram_t), CONFIG_METER_TELEMETRY_GROUP,
+             CONFIG_METER_TELEMETRY_PORT);
+}
+
+void telemetry_mdns_advertise(void) {
+    if (s_sock < 0) {
+        return;
+    }
+
+    char interval[12];
+    char max_interval[12];
+    snprintf(interval, sizeof(interval), "%d", CONFIG_METER_SAMPLE_PERIOD_MS);
+#if CONFIG_METER_SAMPLE_ADAPTIVE
+    snprintf(max_interval, sizeof(max_interval), "%d", CONFIG_METER_SAMPLE_MAX_PERIOD_MS);
+#else
+    strlcpy(max_interval, interval, sizeof(max_interval));
+#endif
+    /* Datagrams follow the adaptive sampling rate, between these two intervals */
+    mdns_txt_item_t txt_data[] = {
+        {"group", CONFIG_METER_TELEMETRY_GROUP},
+        {"format", "mt1"},
+        {"interval_ms", interval},
+        {"max_interval_ms", max_interval},
+    };
+
+    ESP_ERROR_CHECK(mdns_service_add("ESP32-Telemetry", "_meattemp", "_udp", CONFIG_METER_TELEMETRY_PORT, txt_data,
+                                     sizeof(txt_data) / sizeof(txt_data[0])));
+}
+
+#else
+
+void telemetry_init(void) {
+}
+
+void telemetry_mdns_advertise(void) {
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "temperature.h"
+
+#define TELEMETRY_MAGIC   0x544D /* "MT" little-endian */
+#define TELEMETRY_VERSION 1
+
+/**
+ * @brief Open the multicast socket and subscribe to new samples
+ *
+ * Does nothing unless CONFIG_METER_TELEMETRY_ENABLE is set.
+ */
+void telemetry_init(void);
+
+/**
+ * @brief Advertise the telemetry stream as a `_meattemp._udp` mDNS service
+ *
+ * Must be called after mdns_init().
+ */
+void telemetry_mdns_advertise(void);
@@ -1,6 +1,281 @@
 #include "temperature.h"
-#include "esp_random.h"
+#include "checkpoint.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mem.h"
+#include "probe.h"
+#include "sched.h"
+#include "settings.h"
+#include <string.h>
+#include <sys/param.h>
+
+#define MAX_LISTENERS 4
+/* Snapshots waiting for the publisher */
+#define PUBLISH_QUEUE_LEN 4
+#define SAMPLE_PERIOD_US (CONFIG_METER_SAMPLE_PERIOD_MS * 1000LL)
+
+#if CONFIG_METER_SAMPLE_ADAPTIVE
+#define SAMPLE_MAX_PERIOD_MS CONFIG_METER_SAMPLE_MAX_PERIOD_MS
+#define SAMPLE_NEAR_C        CONFIG_METER_SAMPLE_NEAR_C
+#define SAMPLE_SPIKE_C       CONFIG_METER_SAMPLE_SPIKE_C_PER_MIN
+#else
+/* The schedule never leaves the shortest period */
+#define SAMPLE_MAX_PERIOD_MS CONFIG_METER_SAMPLE_PERIOD_MS
+#define SAMPLE_NEAR_C        0
+#define SAMPLE_SPIKE_C       1
+#endif
+/* Samples to spread over the time a probe needs to reach its target at its current rate */
+#define SAMPLES_TO_TARGET 30
+
+_Static_assert(SCHED_PROBE_COUNT == TEMPERATURE_PROBE_COUNT, "sched.h and temperature.h disagree on probes");
+_Static_assert(CONFIG_METER_PUBLISHER_PRIORITY < CONFIG_METER_SAMPLER_PRIORITY, "listeners must not delay a sample");
+
+static const char *TAG = "temperature";
+
+static temperature_snapshot_t s_snapshot;
+/* Targets as last read from NVS, so the sampler never waits for flash */
+static int32_t s_targets[TEMPERATURE_PROBE_COUNT];
+/* Guards s_snapshot and s_targets */
+static portMUX_TYPE s_snapshot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static temperature_listener_t s_listeners[MAX_LISTENERS];
+/* A slot is filled before the count makes it visible to the publisher */
+static _Atomic int s_listener_count = 0;
+static QueueHandle_t s_publish_queue;
+static StaticQueue_t s_publish_queue_buf;
+static uint8_t s_publish_queue_storage[PUBLISH_QUEUE_LEN * sizeof(temperature_snapshot_t)];
+
+static const uint32_t s_jitter_le_us[TEMPERATURE_JITTER_BUCKETS] = {
+    50, 100, 250, 500, 1000, 2000, 5000, 10000, 50000, UINT32_MAX,
+};
+static temperature_jitter_t s_jitter;
+static portMUX_TYPE s_jitter_lock = portMUX_INITIALIZER_UNLOCKED;
 
 int32_t temperature_get_value(int32_t probe_id) {
-    return esp_random() % 20;
-}
\ No newline at end of file
+    probe_reading_t readings[TEMPERATURE_PROBE_COUNT];
+    if (probe_id < 0 || probe_id >= TEMPERATURE_PROBE_COUNT) {
+        return 0;
+    }
+    probe_read(readings);
+    return readings[probe_id].temp;
+}
+
+esp_err_t temperature_add_listener(temperature_listener_t listener) {
+    int count = s_listener_count;
+    if (count >= MAX_LISTENERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_listeners[count] = listener;
+    s_listener_count = count + 1;
+    return ESP_OK;
+}
+
+void temperature_get_snapshot(temperature_snapshot_t *snapshot) {
+    portENTER_CRITICAL(&s_snapshot_lock);
+    *snapshot = s_snapshot;
+    portEXIT_CRITICAL(&s_snapshot_lock);
+}
+
+void temperature_refresh_targets(void) {
+    int32_t target[TEMPERATURE_PROBE_COUNT] = {0};
+    settings_get_temp_target(&target[0], &target[1], &target[2], &target[3]);
+
+    portENTER_CRITICAL(&s_snapshot_lock);
+    memcpy(s_targets, target, sizeof(target));
+    memcpy(s_snapshot.target, target, sizeof(target));
+    portEXIT_CRITICAL(&s_snapshot_lock);
+}
+
+void temperature_get_jitter(temperature_jitter_t *jitter) {
+    portENTER_CRITICAL(&s_jitter_lock);
+    *jitter = s_jitter;
+    portEXIT_CRITICAL(&s_jitter_lock);
+}
+
+void temperature_reset_jitter(void) {
+    portENTER_CRITICAL(&s_jitter_lock);
+    memset(&s_jitter, 0, sizeof(s_jitter));
+    s_jitter.period_us = SAMPLE_PERIOD_US;
+    memcpy(s_jitter.bucket_le_us, s_jitter_le_us, sizeof(s_jitter_le_us));
+    portEXIT_CRITICAL(&s_jitter_lock);
+}
+
+static void record_jitter(int64_t late_us, int64_t work_us, const sched_t *sched, bool dropped) {
+    uint32_t late = MAX(late_us, 0);
+    int bucket = 0;
+    while (late > s_jitter_le_us[bucket]) {
+        bucket++;
+    }
+
+    portENTER_CRITICAL(&s_jitter_lock);
+    s_jitter.samples++;
+    s_jitter.buckets[bucket]++;
+    s_jitter.total_late_us += late;
+    s_jitter.max_late_us = MAX(s_jitter.max_late_us, late);
+    s_jitter.max_work_us = MAX(s_jitter.max_work_us, (uint32_t)work_us);
+    s_jitter.period_us = sched->period_ms * 1000;
+    s_jitter.reason = sched->reason;
+    if (late >= s_jitter.period_us) {
+        s_jitter.missed++;
+    }
+    if (dropped) {
+        s_jitter.dropped++;
+    }
+    portEXIT_CRITICAL(&s_jitter_lock);
+}
+
+/* Compare every working probe against its target, logging only when an alarm starts or clears */
+static void evaluate_alarms(temperature_snapshot_t *snapshot) {
+    uint32_t mask = 0;
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        if (snapshot->fault_mask & (1 << i)) {
+            /* Keep the alarm state of an unplugged probe rather than flapping it */
+            mask |= snapshot->alarm_mask & (1 << i);
+        } else if (snapshot->target[i] > 0 && snapshot->temp[i] >= snapshot->target[i]) {
+            mask |= 1 << i;
+        }
+    }
+    uint32_t changed = mask ^ snapshot->alarm_mask;
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        if (changed & (1 << i)) {
+            if (mask & (1 << i)) {
+                ESP_LOGW(TAG, "Probe %d reached its target of %ld", i, snapshot->target[i]);
+            } else {
+                ESP_LOGI(TAG, "Probe %d back below its target", i);
+            }
+        }
+    }
+    snapshot->alarm_mask = mask;
+}
+
+static void log_faults(uint32_t changed, const probe_reading_t *readings) {
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        if (!(changed & (1 << i))) {
+            continue;
+        }
+        if (readings[i].fault != PROBE_FAULT_NONE) {
+            ESP_LOGW(TAG, "Probe %d fault: %s", i, probe_fault_name(readings[i].fault));
+        } else {
+            ESP_LOGI(TAG, "Probe %d working again", i);
+        }
+    }
+}
+
+/* Runs the listeners below the sampler's priority, so a slow one delays later snapshots but never a sample */
+static void publisher_task(void *arg) {
+    temperature_snapshot_t snapshot;
+    for (;;) {
+        if (xQueueReceive(s_publish_queue, &snapshot, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        for (int i = 0; i < s_listener_count; i++) {
+            s_listeners[i](&snapshot);
+        }
+    }
+}
+
+static void sampler_task(void *arg) {
+    temperature_snapshot_t snapshot;
+    temperature_get_snapshot(&snapshot);
+    probe_reading_t readings[TEMPERATURE_PROBE_COUNT];
+    static const sched_config_t sched_config = {
+        .min_period_ms = CONFIG_METER_SAMPLE_PERIOD_MS,
+        .max_period_ms = SAMPLE_MAX_PERIOD_MS,
+        .near_c = SAMPLE_NEAR_C,
+        .spike_c_per_min = SAMPLE_SPIKE_C,
+        .samples_to_target = SAMPLES_TO_TARGET,
+    };
+    sched_t sched;
+    sched_init(&sched, &sched_config);
+    const checkpoint_state_t *restored = checkpoint_restored();
+    if (restored != NULL) {
+        int32_t temp[TEMPERATURE_PROBE_COUNT];
+        for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+            temp[i] = restored->temp[i];
+        }
+        sched_resume(&sched, restored->period_ms, restored->reason, temp, restored->slope, restored->fault_mask,
+                     esp_timer_get_time());
+    }
+
+    /* Start on a tick boundary so the tick-based schedule and esp_timer agree */
+    vTaskDelay(1);
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t due_us = esp_timer_get_time();
+
+    for (;;) {
+        int64_t start_us = esp_timer_get_time();
+
+        snapshot.seq++;
+        snapshot.timestamp_us = start_us;
+        probe_read(readings);
+        uint32_t fault_mask = 0;
+        for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+            snapshot.temp[i] = readings[i].temp;
+            if (readings[i].fault != PROBE_FAULT_NONE) {
+                fault_mask |= 1 << i;
+            }
+        }
+        log_faults(fault_mask ^ snapshot.fault_mask, readings);
+        snapshot.fault_mask = fault_mask;
+        portENTER_CRITICAL(&s_snapshot_lock);
+        memcpy(snapshot.target, s_targets, sizeof(s_targets));
+        portEXIT_CRITICAL(&s_snapshot_lock);
+        evaluate_alarms(&snapshot);
+
+        portENTER_CRITICAL(&s_snapshot_lock);
+        s_snapshot = snapshot;
+        portEXIT_CRITICAL(&s_snapshot_lock);
+
+        /* A snapshot the publisher has no room for is dropped rather than waited for */
+        bool dropped = s_listener_count > 0 && xQueueSend(s_publish_queue, &snapshot, 0) != pdTRUE;
+
+        sched_reason_t reason = sched.reason;
+        uint32_t period_ms = sched_update(&sched, snapshot.temp, snapshot.target, snapshot.fault_mask, start_us);
+        if (sched.reason != reason) {
+            ESP_LOGI(TAG, "Sampling every %lu ms (%s)", period_ms, sched_reason_name(sched.reason));
+        }
+        /* Only a copy to RTC memory, the NVS copy is written by its own task */
+        checkpoint_save(&snapshot, &sched);
+        record_jitter(start_us - due_us, esp_timer_get_time() - start_us, &sched, dropped);
+
+        /* The CPU may light sleep until then, see CONFIG_METER_POWER_SAVE */
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(period_ms));
+        due_us += period_ms * 1000LL;
+    }
+}
+
+void temperature_sampler_start(void) {
+    ESP_LOGI(TAG, "Sampling %d probes every %d-%d ms on core %d, priority %d", TEMPERATURE_PROBE_COUNT,
+             CONFIG_METER_SAMPLE_PERIOD_MS, SAMPLE_MAX_PERIOD_MS, CONFIG_METER_SAMPLER_CORE,
+             CONFIG_METER_SAMPLER_PRIORITY);
+    temperature_reset_jitter();
+    temperature_refresh_targets();
+
+    /* Readings and alarms of the restored cook are served until the first sample replaces them, and alarms that
+     * were already raised are not raised again */
+    const checkpoint_state_t *restored = checkpoint_restored();
+    if (restored != NULL) {
+        temperature_snapshot_t snapshot = {
+            .seq = restored->seq,
+            .timestamp_us = esp_timer_get_time(),
+            .alarm_mask = restored->alarm_mask,
+            .fault_mask = restored->fault_mask,
+        };
+        for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+            snapshot.temp[i] = restored->temp[i];
+        }
+        portENTER_CRITICAL(&s_snapshot_lock);
+        memcpy(snapshot.target, s_targets, sizeof(s_targets));
+        s_snapshot = snapshot;
+        portEXIT_CRITICAL(&s_snapshot_lock);
+    }
+    probe_init();
+    s_publish_queue = xQueueCreateStatic(PUBLISH_QUEUE_LEN, sizeof(temperature_snapshot_t), s_publish_queue_storage,
+                                         &s_publish_queue_buf);
+    MEM_TASK_CREATE(publisher_task, "publisher", 4096, NULL, CONFIG_METER_PUBLISHER_PRIORITY,
+                    CONFIG_METER_NETWORK_CORE);
+    MEM_TASK_CREATE(sampler_task, "sampler", 4096, NULL, CONFIG_METER_SAMPLER_PRIORITY, CONFIG_METER_SAMPLER_CORE);
+}
@@ -1,5 +1,90 @@
 #pragma once
 
+#include "esp_err.h"
+#include "sched.h"
 #include <stdint.h>
 
-int32_t temperature_get_value(int32_t probe_id);
\ No newline at end of file
+#define TEMPERATURE_PROBE_COUNT 4
+#define TEMPERATURE_JITTER_BUCKETS 10
+
+/**
+ * @brief One reading of all probes, taken by the sampler task
+ */
+typedef struct {
+    uint32_t seq;
+    int64_t timestamp_us;
+    int32_t temp[TEMPERATURE_PROBE_COUNT];
+    int32_t target[TEMPERATURE_PROBE_COUNT];
+    uint32_t alarm_mask; /* Bit n set while probe n is at or above its non-zero target */
+    uint32_t fault_mask; /* Bit n set while probe n reports a fault, its temp is then 0 */
+} temperature_snapshot_t;
+
+/**
+ * @brief Histogram of how late samples were taken compared to their schedule
+ */
+typedef struct {
+    uint32_t period_us;    /* Period the sampler currently runs at */
+    sched_reason_t reason; /* Why it runs at that period */
+    uint32_t samples;
+    uint32_t missed; /* Samples taken a full current period or more after their schedule */
+    uint32_t max_late_us;
+    uint64_t total_late_us;
+    uint32_t dropped;     /* Snapshots the listeners missed because the publisher had fallen behind */
+    uint32_t max_work_us; /* Longest time spent reading probes, evaluating alarms and checkpointing */
+    uint32_t bucket_le_us[TEMPERATURE_JITTER_BUCKETS]; /* Upper bound of each bucket, last is UINT32_MAX */
+    uint32_t buckets[TEMPERATURE_JITTER_BUCKETS];
+} temperature_jitter_t;
+
+/**
+ * @brief Called from the publisher task with every sample, at CONFIG_METER_PUBLISHER_PRIORITY
+ */
+typedef void (*temperature_listener_t)(const temperature_snapshot_t *snapshot);
+
+/**
+ * @brief Read one probe now through the active probe driver, bypassing the sampler
+ *
+ * @param probe_id Probe index
+ * @return int32_t Temperature in C, 0 if the probe is faulty
+ */
+int32_t temperature_get_value(int32_t probe_id);
+
+/**
+ * @brief Register a listener for new samples, also while the sampler runs
+ *
+ * @param listener Callback invoked with every new snapshot
+ * @return esp_err_t ESP_ERR_NO_MEM if all listener slots are taken
+ */
+esp_err_t temperature_add_listener(temperature_listener_t listener);
+
+/**
+ * @brief Start the probe driver and the task sampling all probes, pinned to CONFIG_METER_SAMPLER_CORE at
+ * CONFIG_METER_SAMPLER_PRIORITY, and the task running the listeners
+ *
+ * Samples are taken every CONFIG_METER_SAMPLE_PERIOD_MS, or with CONFIG_METER_SAMPLE_ADAPTIVE at a period between
+ * that and CONFIG_METER_SAMPLE_MAX_PERIOD_MS picked by sched_update().
+ */
+void temperature_sampler_start(void);
+
+/**
+ * @brief Copy the latest snapshot
+ *
+ * @param snapshot Destination of the copy
+ */
+void temperature_get_snapshot(temperature_snapshot_t *snapshot);
+
+/**
+ * @brief Reload the targets from NVS after they were changed. The sampler only uses the copy this keeps in RAM
+ */
+void temperature_refresh_targets(void);
+
+/**
+ * @brief Copy the sampling jitter histogram
+ *
+ * @param jitter Destination of the copy
+ */
+void temperature_get_jitter(temperature_jitter_t *jitter);
+
+/**
+ * @brief Clear the sampling jitter histogram
+ */
+void temperature_reset_jitter(void);
@@ -0,0 +1,498 @@
+#include "webui.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs.h"
+#include "mbedtls/sha256.h"
+#include "session.h"
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Uploaded UIs are stored content-addressed next to the factory files:
+ *
+ *   <base>/.ui/objects/<hash>   file contents, named after their SHA-256
+ *   <base>/.ui/manifest         one "<hash> <size> <path>" line per file
+ *
+ * An upload only writes objects that do not exist yet and builds manifest.new.
+ * Renaming it over the manifest is the single atomic switch to the new UI.
+ */
+
+static const char *TAG = "webui";
+
+#define UI_DIR           "/.ui"
+#define OBJECTS_DIR      UI_DIR "/objects"
+#define MANIFEST         UI_DIR "/manifest"
+#define MANIFEST_NEW     UI_DIR "/manifest.new"
+#define TMP_SUFFIX       ".tmp"
+#define BUNDLE_MAGIC     "WUB1"
+#define UI_PATH_MAX      128
+#define HASH_LEN         32
+#define OBJECT_NAME_LEN  32 /* Hex of the first 16 bytes of the hash */
+#define META_LEN         (4 + HASH_LEN)
+#define GC_BATCH         8
+#define FS_PATH_MAX      (ESP_VFS_PATH_MAX + sizeof(OBJECTS_DIR) + OBJECT_NAME_LEN + sizeof(TMP_SUFFIX) + 2)
+#define MANIFEST_LINE    (OBJECT_NAME_LEN + 12 + UI_PATH_MAX + 3)
+
+typedef enum {
+    STATE_MAGIC,
+    STATE_PATH_LEN,
+    STATE_PATH,
+    STATE_META,
+    STATE_DATA,
+    STATE_DONE,
+    STATE_ERROR,
+} parse_state_t;
+
+static char s_base_path[ESP_VFS_PATH_MAX + 1];
+static bool s_has_manifest;
+
+static struct {
+    bool active;
+    parse_state_t state;
+    uint8_t field[MAX(UI_PATH_MAX, META_LEN)];
+    size_t field_len;
+    char path[UI_PATH_MAX + 1];
+    size_t path_len;
+    uint32_t size;
+    uint32_t remaining;
+    uint8_t hash[HASH_LEN];
+    char object[OBJECT_NAME_LEN + 1];
+    FILE *object_file; /* NULL while skipping an object that already exists */
+    mbedtls_sha256_context sha;
+    FILE *manifest;
+    int64_t start_us;
+    webui_update_stats_t stats;
+} s_update;
+
+static void fs_path(char *out, size_t size, const char *relative) {
+    snprintf(out, size, "%s%s", s_base_path, relative);
+}
+
+static void object_path(char *out, size_t size, const char *object, const char *suffix) {
+    snprintf(out, size, "%s" OBJECTS_DIR "/%s%s", s_base_path, object, suffix);
+}
+
+static bool file_exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/* Split a manifest line into object name and path; returns false for malformed lines */
+static bool parse_manifest_line(char *line, char **object, char **path) {
+    line[strcspn(line, "\n")] = '\0';
+    char *size = strchr(line, ' ');
+    if (size == NULL || size - line != OBJECT_NAME_LEN) {
+        return false;
+    }
+    *size++ = '\0';
+    char *name = strchr(size, ' ');
+    if (name == NULL) {
+        return false;
+    }
+    *object = line;
+    *path = name + 1;
+    return true;
+}
+
+/* Find the object holding a UI path in the active manifest */
+static bool manifest_lookup(const char *path, char *object) {
+    char manifest[FS_PATH_MAX];
+    fs_path(manifest, sizeof(manifest), MANIFEST);
+    FILE *f = fopen(manifest, "r");
+    if (f == NULL) {
+        return false;
+    }
+
+    char line[MANIFEST_LINE];
+    bool found = false;
+    char *line_object, *line_path;
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        if (parse_manifest_line(line, &line_object, &line_path) && strcmp(line_path, path) == 0) {
+            strlcpy(object, line_object, OBJECT_NAME_LEN + 1);
+            found = true;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+static bool manifest_references(const char *object) {
+    char manifest[FS_PATH_MAX];
+    fs_path(manifest, sizeof(manifest), MANIFEST);
+    FILE *f = fopen(manifest, "r");
+    if (f == NULL) {
+        return false;
+    }
+
+    char line[MANIFEST_LINE];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        found = strncmp(line, object, OBJECT_NAME_LEN) == 0 && line[OBJECT_NAME_LEN] == ' ';
+    }
+    fclose(f);
+    return found;
+}
+
+/* Delete objects the active manifest does not reference, a few names at a time */
+static void collect_garbage(void) {
+    char dir_path[FS_PATH_MAX];
+    fs_path(dir_path, sizeof(dir_path), OBJECTS_DIR);
+
+    char batch[GC_BATCH][OBJECT_NAME_LEN + sizeof(TMP_SUFFIX)];
+    int count;
+    uint32_t removed = 0;
+    do {
+        DIR *dir = opendir(dir_path);
+        if (dir == NULL) {
+            return;
+        }
+        count = 0;
+        struct dirent *entry;
+        while (count < GC_BATCH && (entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.' || strlen(entry->d_name) >= sizeof(batch[0])) {
+                continue;
+            }
+            if (!s_has_manifest || strlen(entry->d_name) != OBJECT_NAME_LEN || !manifest_references(entry->d_name)) {
+                strlcpy(batch[count++], entry->d_name, sizeof(batch[0]));
+            }
+        }
+        closedir(dir);
+
+        int unlinked = 0;
+        for (int i = 0; i < count; i++) {
+            char path[FS_PATH_MAX];
+            object_path(path, sizeof(path), batch[i], "");
+            if (unlink(path) == 0) {
+                unlinked++;
+            }
+        }
+        removed += unlinked;
+        if (unlinked < count) {
+            ESP_LOGW(TAG, "Failed to remove %d unused files", count - unlinked);
+            break;
+        }
+    } while (count == GC_BATCH);
+
+    if (removed > 0) {
+        ESP_LOGI(TAG, "Removed %lu unused files", removed);
+    }
+}
+
+void webui_init(const char *base_path) {
+    strlcpy(s_base_path, base_path, sizeof(s_base_path));
+
+    char path[FS_PATH_MAX];
+    fs_path(path, sizeof(path), UI_DIR);
+    mkdir(path, 0775);
+    fs_path(path, sizeof(path), OBJECTS_DIR);
+    mkdir(path, 0775);
+
+    /* A manifest.new left behind means the device reset during an upload */
+    fs_path(path, sizeof(path), MANIFEST_NEW);
+    unlink(path);
+
+    fs_path(path, sizeof(path), MANIFEST);
+    s_has_manifest = file_exists(path);
+    collect_garbage();
+    ESP_LOGI(TAG, "Serving %s web UI", s_has_manifest ? "uploaded" : "factory");
+}
+
+/* Cook sessions and the uploaded UI's own store share the partition with the factory UI but are not part of it */
+static bool is_private(const char *uri_path) {
+    size_t len = strlen(SESSION_DIR);
+    if (strncmp(uri_path, SESSION_DIR, len) == 0 && (uri_path[len] == '\0' || uri_path[len] == '/')) {
+        return true;
+    }
+    /* Also catches UI_DIR, and "//" or "/./" spellings of the paths above */
+    return strstr(uri_path, "//") != NULL || strstr(uri_path, "/.") != NULL;
+}
+
+static bool lookup(const char *uri_path, char *filepath, size_t filepath_size) {
+    if (!s_has_manifest) {
+        if (is_private(uri_path)) {
+            return false;
+        }
+        snprintf(filepath, filepath_size, "%s%s", s_base_path, uri_path);
+        return file_exists(filepath);
+    }
+
+    char object[OBJECT_NAME_LEN + 1];
+    if (!manifest_lookup(uri_path + 1, object)) {
+        return false;
+    }
+    object_path(filepath, filepath_size, object, "");
+    return true;
+}
+
+esp_err_t webui_resolve(char *uri_path, size_t uri_size, char *filepath, size_t filepath_size) {
+    if (uri_path[strlen(uri_path) - 1] == '/') {
+        strlcat(uri_path, "index.html", uri_size);
+    } else if (lookup(uri_path, filepath, filepath_size)) {
+        return ESP_OK;
+    } else {
+        /* Not a file, try the index.html of a directory route */
+        strlcat(uri_path, "/index.html", uri_size);
+    }
+    return lookup(uri_path, filepath, filepath_size) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t webui_resolve_encoded(const char *uri_path, const char *suffix, char *filepath, size_t filepath_size) {
+    char variant[UI_PATH_MAX + 8];
+    if (snprintf(variant, sizeof(variant), "%s%s", uri_path, suffix) >= sizeof(variant)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return lookup(variant, filepath, filepath_size) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t webui_update_begin(void) {
+    if (s_update.active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char path[FS_PATH_MAX];
+    fs_path(path, sizeof(path), MANIFEST_NEW);
+    FILE *manifest = fopen(path, "w");
+    if (manifest == NULL) {
+        ESP_LOGE(TAG, "Failed to create %s", path);
+        return ESP_FAIL;
+    }
+
+    memset(&s_update, 0, sizeof(s_update));
+    s_update.manifest = manifest;
+    s_update.state = STATE_MAGIC;
+    s_update.start_us = esp_timer_get_time();
+    s_update.active = true;
+    return ESP_OK;
+}
+
+/* Accumulate bytes of the current field; true once `need` bytes are available in s_update.field */
+static bool take(const uint8_t **data, size_t *len, size_t need) {
+    size_t n = MIN(*len, need - s_update.field_len);
+    memcpy(&s_update.field[s_update.field_len], *data, n);
+    s_update.field_len += n;
+    *data += n;
+    *len -= n;
+    if (s_update.field_len < need) {
+        return false;
+    }
+    s_update.field_len = 0;
+    return true;
+}
+
+static bool valid_path(const char *path) {
+    return path[0] != '\0' && path[0] != '/' && strstr(path, "..") == NULL && strchr(path, '\n') == NULL;
+}
+
+static esp_err_t fail(esp_err_t err, const char *reason) {
+    ESP_LOGE(TAG, "Bundle rejected at '%s': %s", s_update.path, reason);
+    s_update.state = STATE_ERROR;
+    return err;
+}
+
+static esp_err_t start_entry(void) {
+    s_update.size = s_update.field[0] | s_update.field[1] << 8 | s_update.field[2] << 16 | (uint32_t)s_update.field[3] << 24;
+    s_update.remaining = s_update.size;
+    memcpy(s_update.hash, &s_update.field[4], HASH_LEN);
+    for (int i = 0; i < OBJECT_NAME_LEN / 2; i++) {
+        sprintf(&s_update.object[2 * i], "%02x", s_update.hash[i]);
+    }
+    s_update.stats.files++;
+
+    char path[FS_PATH_MAX];
+    object_path(path, sizeof(path), s_update.object, "");
+    if (file_exists(path)) {
+        /* Same content is already on flash, only the manifest needs to point at it */
+        s_update.object_file = NULL;
+        s_update.stats.files_skipped++;
+        return ESP_OK;
+    }
+
+    object_path(path, sizeof(path), s_update.object, TMP_SUFFIX);
+    s_update.object_file = fopen(path, "w");
+    if (s_update.object_file == NULL) {
+        return fail(ESP_FAIL, "cannot create file");
+    }
+    mbedtls_sha256_init(&s_update.sha);
+    mbedtls_sha256_starts(&s_update.sha, 0);
+    return ESP_OK;
+}
+
+static esp_err_t finish_entry(void) {
+    if (s_update.object_file != NULL) {
+        uint8_t hash[HASH_LEN];
+        mbedtls_sha256_finish(&s_update.sha, hash);
+        mbedtls_sha256_free(&s_update.sha);
+        fclose(s_update.object_file);
+        s_update.object_file = NULL;
+
+        char tmp[FS_PATH_MAX], path[FS_PATH_MAX];
+        object_path(tmp, sizeof(tmp), s_update.object, TMP_SUFFIX);
+        if (memcmp(hash, s_update.hash, HASH_LEN) != 0) {
+            unlink(tmp);
+            return fail(ESP_ERR_INVALID_CRC, "content does not match its hash");
+        }
+        object_path(path, sizeof(path), s_update.object, "");
+        if (rename(tmp, path) != 0) {
+            return fail(ESP_FAIL, "cannot store file");
+        }
+        s_update.stats.files_written++;
+    }
+
+    if (fprintf(s_update.manifest, "%s %lu %s\n", s_update.object, s_update.size, s_update.path) < 0) {
+        return fail(ESP_FAIL, "cannot write manifest");
+    }
+    s_update.state = STATE_PATH_LEN;
+    return ESP_OK;
+}
+
+esp_err_t webui_update_feed(const uint8_t *data, size_t len) {
+    if (!s_update.active || s_update.state == STATE_ERROR) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_update.stats.bytes_received += len;
+
+    esp_err_t err = ESP_OK;
+    while (len > 0 && err == ESP_OK) {
+        switch (s_update.state) {
+            case STATE_MAGIC:
+                if (take(&data, &len, strlen(BUNDLE_MAGIC))) {
+                    if (memcmp(s_update.field, BUNDLE_MAGIC, strlen(BUNDLE_MAGIC)) != 0) {
+                        return fail(ESP_ERR_INVALID_ARG, "not a web UI bundle");
+                    }
+                    s_update.state = STATE_PATH_LEN;
+                }
+                break;
+
+            case STATE_PATH_LEN:
+                if (take(&data, &len, 2)) {
+                    s_update.path_len = s_update.field[0] | s_update.field[1] << 8;
+                    if (s_update.path_len == 0) {
+                        s_update.state = STATE_DONE;
+                    } else if (s_update.path_len > UI_PATH_MAX) {
+                        return fail(ESP_ERR_INVALID_ARG, "path too long");
+                    } else {
+                        s_update.state = STATE_PATH;
+                    }
+                }
+                break;
+
+            case STATE_PATH:
+                if (take(&data, &len, s_update.path_len)) {
+                    memcpy(s_update.path, s_update.field, s_update.path_len);
+                    s_update.path[s_update.path_len] = '\0';
+                    if (!valid_path(s_update.path)) {
+                        return fail(ESP_ERR_INVALID_ARG, "invalid path");
+                    }
+                    s_update.state = STATE_META;
+                }
+                break;
+
+            case STATE_META:
+                if (take(&data, &len, META_LEN)) {
+                    err = start_entry();
+                    if (err == ESP_OK) {
+                        s_update.state = STATE_DATA;
+                        if (s_update.remaining == 0) {
+                            err = finish_entry();
+                        }
+                    }
+                }
+                break;
+
+            case STATE_DATA: {
+                size_t n = MIN(len, s_update.remaining);
+                if (s_update.object_file != NULL) {
+                    if (fwrite(data, 1, n, s_update.object_file) != n) {
+                        return fail(ESP_FAIL, "write failed");
+                    }
+                    mbedtls_sha256_update(&s_update.sha, data, n);
+                    s_update.stats.bytes_written += n;
+                }
+                data += n;
+                len -= n;
+                s_update.remaining -= n;
+                if (s_update.remaining == 0) {
+                    err = finish_entry();
+                }
+                break;
+            }
+
+            case STATE_DONE:
+                return fail(ESP_ERR_INVALID_ARG, "data after end of bundle");
+
+            case STATE_ERROR:
+            default:
+                return ESP_ERR_INVALID_STATE;
+        }
+    }
+    return err;
+}
+
+void webui_update_abort(void) {
+    if (!s_update.active) {
+        return;
+    }
+    if (s_update.object_file != NULL) {
+        mbedtls_sha256_free(&s_update.sha);
+        fclose(s_update.object_file);
+        char path[FS_PATH_MAX];
+        object_path(path, sizeof(path), s_update.object, TMP_SUFFIX);
+        unlink(path);
+    }
+    fclose(s_update.manifest);
+    char path[FS_PATH_MAX];
+    fs_path(path, sizeof(path), MANIFEST_NEW);
+    unlink(path);
+    s_update.active = false;
+    ESP_LOGW(TAG, "Update aborted, keeping the current UI");
+}
+
+esp_err_t webui_update_finish(webui_update_stats_t *stats) {
+    if (!s_update.active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_update.state != STATE_DONE) {
+        webui_update_abort();
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    char manifest_new[FS_PATH_MAX], manifest[FS_PATH_MAX];
+    fs_path(manifest_new, sizeof(manifest_new), MANIFEST_NEW);
+    fs_path(manifest, sizeof(manifest), MANIFEST);
+    fflush(s_update.manifest);
+    fsync(fileno(s_update.manifest));
+    fclose(s_update.manifest);
+    s_update.active = false;
+
+    if (rename(manifest_new, manifest) != 0) {
+        ESP_LOGE(TAG, "Failed to activate new manifest");
+        unlink(manifest_new);
+        return ESP_FAIL;
+    }
+    s_has_manifest = true;
+    collect_garbage();
+
+    s_update.stats.elapsed_us = esp_timer_get_time() - s_update.start_us;
+    *stats = s_update.stats;
+    ESP_LOGI(TAG, "Web UI updated: %lu files, %lu written (%lu bytes), %lu unchanged", stats->files,
+             stats->files_written, stats->bytes_written, stats->files_skipped);
+    return ESP_OK;
+}
+
+esp_err_t webui_reset(void) {
+    if (s_update.active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    char path[FS_PATH_MAX];
+    fs_path(path, sizeof(path), MANIFEST);
+    unlink(path);
+    s_has_manifest = false;
+    collect_garbage();
+    ESP_LOGI(TAG, "Reverted to factory web UI");
+    return ESP_OK;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Outcome of a web UI bundle upload
+ */
+typedef struct {
+    uint32_t files;
+    uint32_t files_written;
+    uint32_t files_skipped;
+    uint32_t bytes_received;
+    uint32_t bytes_written;
+    int64_t elapsed_us;
+} webui_update_stats_t;
+
+/**
+ * @brief Pick up the web UI installed on the filesystem and clean up after interrupted updates
+ *
+ * @param base_path Mount point of the www partition
+ */
+void webui_init(const char *base_path);
+
+/**
+ * @brief Map a request path to the file that holds its content
+ *
+ * Directory paths and unknown paths fall back to their index.html for SPA routing.
+ *
+ * @param uri_path Request path without query; rewritten to the path that was resolved
+ * @param uri_size Size of the uri_path buffer
+ * @param filepath Filled with the file to send
+ * @param filepath_size Size of the filepath buffer
+ * @return esp_err_t ESP_ERR_NOT_FOUND if nothing matches
+ */
+esp_err_t webui_resolve(char *uri_path, size_t uri_size, char *filepath, size_t filepath_size);
+
+/**
+ * @brief Find a precompressed variant of a resolved path
+ *
+ * @param uri_path Path as rewritten by webui_resolve()
+ * @param suffix Suffix of the encoding, ".gz" or ".br"
+ * @param filepath Filled with the file holding the variant
+ * @param filepath_size Size of the filepath buffer
+ * @return esp_err_t ESP_ERR_NOT_FOUND if the path has no such variant
+ */
+esp_err_t webui_resolve_encoded(const char *uri_path, const char *suffix, char *filepath, size_t filepath_size);
+
+/**
+ * @brief Start receiving a bundle packed by tools/pack_webui.py
+ *
+ * @return esp_err_t ESP_ERR_INVALID_STATE if an update is already in progress
+ */
+esp_err_t webui_update_begin(void);
+
+/**
+ * @brief Feed the next chunk of the bundle. Chunks may split records anywhere.
+ *
+ * @param data Chunk of the bundle
+ * @param len Length of the chunk
+ * @return esp_err_t ESP_ERR_INVALID_ARG for a malformed bundle, ESP_ERR_INVALID_CRC for a corrupted file
+ */
+esp_err_t webui_update_feed(const uint8_t *data, size_t len);
+
+/**
+ * @brief Atomically switch to the uploaded UI and delete files it no longer uses
+ *
+ * @param stats Filled with the update statistics
+ * @return esp_err_t ESP_ERR_INVALID_SIZE if the bundle was truncated
+ */
+esp_err_t webui_update_finish(webui_update_stats_t *stats);
+
+/**
+ * @brief Abort the update in progress. The current UI stays active.
+ */
+void webui_update_abort(void);
+
+/**
+ * @brief Drop the uploaded UI and go back to the one flashed with the firmware
+ *
+ * @return esp_err_t
+ */
+esp_err_t webui_reset(void);
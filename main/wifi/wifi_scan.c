@@ -8,7 +8,7 @@ static const char *TAG = "wifi scan";
 int wifi_scan(wifi_ap_record_t *ap_info, int size) {
     uint16_t number = size;
     uint16_t ap_count = 0;
-    memset(ap_info, 0, sizeof(ap_info));
+    memset(ap_info, 0, size * sizeof(*ap_info));
 
     esp_wifi_scan_start(NULL, true);
 
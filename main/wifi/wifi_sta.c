@@ -38,6 +38,10 @@ esp_netif_t *wifi_init_sta(void) {
     ESP_LOGI(TAG, "Connecting to WiFi (SSID: %s) ...", wifi_sta_config.sta.ssid);
 
     esp_wifi_start();
+#if CONFIG_METER_POWER_SAVE
+    /* Wake the modem for every DTIM beacon only, light sleep needs it asleep in between */
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+#endif
 
     return esp_netif_sta;
 }
@@ -45,6 +49,10 @@ esp_netif_t *wifi_init_sta(void) {
 
 void wifi_get_station_ssid(uint8_t *ssid, size_t ssid_len) {
     wifi_ap_record_t ap_info;
-    esp_wifi_sta_get_ap_info(&ap_info);
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        /* Not connected */
+        memset(ssid, 0, ssid_len);
+        return;
+    }
     memcpy(ssid, ap_info.ssid, ssid_len);
 }
\ No newline at end of file
@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""Check the request buffer pool under concurrent use on the host.
+
+Builds main/buf_pool/buf_pool.c with the host C compiler against pthread
+stand-ins for the FreeRTOS counting semaphore and spinlock, with the buffer
+counts, sizes and wait of the Kconfig defaults. Then:
+
+  concurrency  many threads check out buffers of both classes, fill them with
+               their own pattern, yield and check the pattern is still there
+               before returning them, so two holders of one buffer show up
+  exhaustion   with every large buffer checked out, one more request has to
+               give up after the configured wait and count a timeout
+  foreign      returning a pointer that is not a pool buffer is refused
+
+and checks that the occupancy statistics add up afterwards. By default the
+build uses ThreadSanitizer (--no-tsan without it), which also reports races
+on the pool's own state.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+BUF_POOL_DIR = os.path.join(ROOT, "main", "buf_pool")
+KCONFIG = os.path.join(ROOT, "main", "Kconfig.projbuild")
+
+STUBS = {
+    "esp_log.h": r"""
+#pragma once
+#include <stdatomic.h>
+#include <stdio.h>
+extern atomic_int s_log_errors;
+#define ESP_LOGI(tag, format, ...) printf("log %s: " format "\n", tag, ##__VA_ARGS__)
+/* Timeouts are counted by the pool itself */
+#define ESP_LOGW(tag, format, ...) ((void)0)
+#define ESP_LOGE(tag, format, ...)                                \
+    do {                                                         \
+        s_log_errors++;                                          \
+        printf("log %s: " format "\n", tag, ##__VA_ARGS__);     \
+    } while (0)
+""",
+    "freertos/FreeRTOS.h": r"""
+#pragma once
+#include "sdkconfig.h"
+#include <pthread.h>
+#include <stdint.h>
+typedef uint32_t TickType_t;
+#define pdTRUE  1
+#define pdFALSE 0
+/* One tick per millisecond */
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY     UINT32_MAX
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)      pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)       pthread_mutex_unlock(mux)
+""",
+    "freertos/semphr.h": r"""
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include <errno.h>
+#include <time.h>
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t given;
+    unsigned count;
+} StaticSemaphore_t;
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateCountingStatic(unsigned max, unsigned initial,
+                                                               StaticSemaphore_t *buf) {
+    pthread_mutex_init(&buf->lock, NULL);
+    pthread_cond_init(&buf->given, NULL);
+    buf->count = initial;
+    return buf;
+}
+
+static inline int xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&sem->given, &sem->lock);
+        } else if (pthread_cond_timedwait(&sem->given, &sem->lock, &deadline) == ETIMEDOUT && sem->count == 0) {
+            pthread_mutex_unlock(&sem->lock);
+            return pdFALSE;
+        }
+    }
+    sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+
+static inline int xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->lock);
+    sem->count++;
+    pthread_cond_signal(&sem->given);
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+""",
+}
+
+DRIVER = r"""
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "buf_pool.c"
+
+atomic_int s_log_errors;
+
+#define MAX_BUFFERS 16
+
+/* Thread holding each buffer, 0 while it is free */
+static atomic_int s_owner[BUF_POOL_CLASS_COUNT][MAX_BUFFERS];
+static atomic_int s_overlaps;
+static atomic_int s_timeouts;
+static atomic_long s_checkouts;
+static long s_rounds;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int index_of(buf_pool_class_t cls, const uint8_t *buf) {
+    return (buf - s_classes[cls].storage) / s_classes[cls].stats.size;
+}
+
+static void *worker(void *arg) {
+    int id = (int)(intptr_t)arg;
+    unsigned seed = id;
+    for (long r = 0; r < s_rounds; r++) {
+        buf_pool_class_t cls = rand_r(&seed) % 4 == 0 ? BUF_POOL_LARGE : BUF_POOL_SMALL;
+        uint8_t *buf = buf_pool_get(cls);
+        if (buf == NULL) {
+            s_timeouts++;
+            continue;
+        }
+        s_checkouts++;
+        int index = index_of(cls, buf);
+        if (atomic_exchange(&s_owner[cls][index], id) != 0) {
+            s_overlaps++;
+        }
+        size_t size = buf_pool_size(cls);
+        memset(buf, id, size);
+        for (int y = rand_r(&seed) % 3; y > 0; y--) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < size; i++) {
+            if (buf[i] != (uint8_t)id) {
+                s_overlaps++;
+                break;
+            }
+        }
+        if (atomic_exchange(&s_owner[cls][index], 0) != id) {
+            s_overlaps++;
+        }
+        buf_pool_put(buf);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int threads = atoi(argv[1]);
+    s_rounds = atol(argv[2]);
+    buf_pool_init();
+
+    pthread_t tids[threads];
+    double start = now_ms();
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, worker, (void *)(intptr_t)(i + 1));
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double elapsed = now_ms() - start;
+
+    buf_pool_stats_t small, large;
+    buf_pool_get_stats(BUF_POOL_SMALL, &small);
+    buf_pool_get_stats(BUF_POOL_LARGE, &large);
+    printf("concurrency %ld %d %d %ld %u %u %u %u %u %u %.0f\n", (long)s_checkouts, (int)s_overlaps, (int)s_timeouts,
+           (long)(small.checkouts + large.checkouts), small.timeouts + large.timeouts, small.in_use + large.in_use,
+           small.high_water, small.count, large.high_water, large.count, elapsed);
+
+    void *held[MAX_BUFFERS];
+    for (int i = 0; i < large.count; i++) {
+        held[i] = buf_pool_get(BUF_POOL_LARGE);
+    }
+    start = now_ms();
+    void *extra = buf_pool_get(BUF_POOL_LARGE);
+    elapsed = now_ms() - start;
+    buf_pool_stats_t after;
+    buf_pool_get_stats(BUF_POOL_LARGE, &after);
+    printf("exhaustion %d %u %.0f\n", extra == NULL, after.timeouts - large.timeouts, elapsed);
+    for (int i = 0; i < large.count; i++) {
+        buf_pool_put(held[i]);
+    }
+
+    static uint8_t foreign[16];
+    int errors = s_log_errors;
+    buf_pool_put(foreign);
+    buf_pool_get_stats(BUF_POOL_LARGE, &after);
+    buf_pool_get_stats(BUF_POOL_SMALL, &small);
+    printf("foreign %d %u\n", s_log_errors - errors, after.in_use + small.in_use);
+    return 0;
+}
+"""
+
+
+def kconfig_defaults():
+    """Defaults of the METER_BUF_POOL_* options"""
+    with open(KCONFIG) as f:
+        text = f.read()
+    values = dict(re.findall(r"config (METER_BUF_POOL_\w+)\n(?:[ \t]+(?!config)[^\n]*\n)*?[ \t]+default (\d+)",
+                             text))
+    names = ["SMALL_COUNT", "SMALL_SIZE", "LARGE_COUNT", "LARGE_SIZE", "WAIT_MS"]
+    missing = [n for n in names if "METER_BUF_POOL_" + n not in values]
+    if missing:
+        sys.exit("no default for %s in %s" % (", ".join(missing), KCONFIG))
+    return {n: int(values["METER_BUF_POOL_" + n]) for n in names}
+
+
+def build(build_dir, cc, config, tsan):
+    for name, text in STUBS.items():
+        path = os.path.join(build_dir, name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as f:
+            f.write(text)
+    with open(os.path.join(build_dir, "sdkconfig.h"), "w") as f:
+        f.write("#pragma once\n")
+        for name, value in config.items():
+            f.write("#define CONFIG_METER_BUF_POOL_%s %d\n" % (name, value))
+    driver = os.path.join(build_dir, "driver.c")
+    with open(driver, "w") as f:
+        f.write(DRIVER)
+    binary = os.path.join(build_dir, "buf_pool_concurrency")
+    flags = ["-std=gnu17", "-O1", "-g", "-Wall", "-Wno-format", "-pthread"]
+    if tsan:
+        flags.append("-fsanitize=thread")
+    subprocess.check_call([cc] + flags + ["-I", build_dir, "-I", BUF_POOL_DIR, "-o", binary, driver])
+    return binary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--threads", type=int, default=16, help="threads checking out buffers at once")
+    parser.add_argument("--rounds", type=int, default=10000, help="checkouts per thread")
+    parser.add_argument("--no-tsan", action="store_true", help="build without ThreadSanitizer")
+    args = parser.parse_args()
+
+    config = kconfig_defaults()
+    print("Pool: %d x %d and %d x %d bytes, %d ms wait" % (config["SMALL_COUNT"], config["SMALL_SIZE"],
+                                                          config["LARGE_COUNT"], config["LARGE_SIZE"],
+                                                          config["WAIT_MS"]))
+    cc = os.environ.get("CC", "cc")
+    with tempfile.TemporaryDirectory() as build_dir:
+        binary = build(build_dir, cc, config, not args.no_tsan)
+        env = dict(os.environ, TSAN_OPTIONS="halt_on_error=1 exitcode=66")
+        result = subprocess.run([binary, str(args.threads), str(args.rounds)], stdout=subprocess.PIPE,
+                                universal_newlines=True, env=env)
+
+    failures = []
+    if result.returncode == 66:
+        failures.append("ThreadSanitizer reported a race")
+    elif result.returncode != 0:
+        failures.append("driver exited with %d" % result.returncode)
+    for line in result.stdout.splitlines():
+        fields = line.split()
+        if fields[0] == "concurrency":
+            (checkouts, overlaps, timeouts, pool_checkouts, pool_timeouts, in_use, small_high, small_count,
+             large_high, large_count) = map(int, fields[1:11])
+            print("%d threads: %d checkouts, %d timeouts in %s ms, high water %d/%d small, %d/%d large" %
+                  (args.threads, checkouts, timeouts, fields[11], small_high, small_count, large_high, large_count))
+            if overlaps:
+                failures.append("%d checkouts shared a buffer with another thread" % overlaps)
+            if pool_checkouts != checkouts or pool_timeouts != timeouts:
+                failures.append("pool counted %d checkouts and %d timeouts" % (pool_checkouts, pool_timeouts))
+            if in_use:
+                failures.append("%d buffers still in use after all were returned" % in_use)
+            if small_high > small_count or large_high > large_count:
+                failures.append("high water above the buffer count")
+        elif fields[0] == "exhaustion":
+            refused, counted, waited = int(fields[1]), int(fields[2]), float(fields[3])
+            print("Exhausted large class: request %s after %.0f ms" % ("refused" if refused else "served", waited))
+            if not refused or counted != 1:
+                failures.append("a request to an exhausted class was not refused and counted once")
+            if waited < config["WAIT_MS"] * 0.9:
+                failures.append("gave up after %.0f ms instead of %d" % (waited, config["WAIT_MS"]))
+        elif fields[0] == "foreign":
+            if int(fields[1]) != 1 or int(fields[2]) != 0:
+                failures.append("a foreign pointer was not refused")
+    for failure in failures:
+        print("FAIL", failure)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
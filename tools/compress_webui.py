@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Stage a built web UI for the LittleFS image with precompressed variants.
+
+Every file of the input directory is copied to the output directory. Next to
+each compressible file a .gz (and with --brotli a .br) variant is written when
+it saves at least --min-saving of the original, which the server sends to
+clients that list the encoding in Accept-Encoding.
+
+The transfer size of the bundle is the sum, over all served files, of the
+smallest variant a gzip-capable browser receives. With --budget the script
+fails when it exceeds that many bytes, which fails the firmware build.
+"""
+
+import argparse
+import gzip
+import os
+import shutil
+import sys
+
+COMPRESSIBLE = {".html", ".js", ".mjs", ".css", ".json", ".map", ".svg", ".txt", ".xml", ".ico", ".webmanifest"}
+ENCODED_SUFFIXES = (".gz", ".br")
+MIN_SIZE = 256
+
+
+def is_compressible(name):
+    return os.path.splitext(name)[1].lower() in COMPRESSIBLE
+
+
+def load_brotli():
+    try:
+        import brotli
+    except ImportError:
+        raise SystemExit("--brotli needs the brotli module: pip install brotli")
+    return brotli
+
+
+def variants(name, content, brotli=None, min_saving=0.1):
+    """Return [(suffix, data)] of the encodings worth storing for one file."""
+    if not is_compressible(name) or len(content) < MIN_SIZE:
+        return []
+    limit = len(content) * (1.0 - min_saving)
+    out = []
+    # mtime=0 keeps the output identical between builds
+    gz = gzip.compress(content, compresslevel=9, mtime=0)
+    if len(gz) <= limit:
+        out.append((".gz", gz))
+    if brotli is not None:
+        br = brotli.compress(content, quality=11)
+        if len(br) <= limit:
+            out.append((".br", br))
+    return out
+
+
+def iter_files(root):
+    for directory, dirs, files in os.walk(root):
+        dirs.sort()
+        for name in sorted(files):
+            if name.endswith(ENCODED_SUFFIXES):
+                continue
+            path = os.path.join(directory, name)
+            yield os.path.relpath(path, root), path
+
+
+def stage(src, dst, brotli, min_saving):
+    """Fill dst and return (files, raw bytes, gzip transfer bytes, brotli transfer bytes)."""
+    if os.path.isdir(dst):
+        shutil.rmtree(dst)
+    files = raw = gz_total = br_total = 0
+    for rel, path in iter_files(src):
+        target = os.path.join(dst, rel)
+        os.makedirs(os.path.dirname(target), exist_ok=True)
+        with open(path, "rb") as f:
+            content = f.read()
+        with open(target, "wb") as f:
+            f.write(content)
+        sizes = {"": len(content)}
+        for suffix, data in variants(rel, content, brotli, min_saving):
+            with open(target + suffix, "wb") as f:
+                f.write(data)
+            sizes[suffix] = len(data)
+        files += 1
+        raw += len(content)
+        gz_total += min(sizes[""], sizes.get(".gz", sizes[""]))
+        br_total += min(sizes.values())
+    return files, raw, gz_total, br_total
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("src", help="directory produced by 'pnpm build'")
+    parser.add_argument("dst", help="directory to stage the image contents in, replaced if it exists")
+    parser.add_argument("--brotli", action="store_true", help="also write .br variants")
+    parser.add_argument("--budget", type=int, default=0, help="largest allowed gzip transfer size in bytes, 0 for none")
+    parser.add_argument("--min-saving", type=float, default=0.1,
+                        help="smallest fraction a variant must save to be stored (default 0.1)")
+    args = parser.parse_args()
+
+    brotli = load_brotli() if args.brotli else None
+    files, raw, gz_total, br_total = stage(args.src, args.dst, brotli, args.min_saving)
+    print("web UI: %d files, %d bytes raw, %d bytes gzip (%.0f%%)" % (files, raw, gz_total, 100.0 * gz_total / max(raw, 1)))
+    if brotli is not None:
+        print("web UI: %d bytes brotli (%.0f%%)" % (br_total, 100.0 * br_total / max(raw, 1)))
+    if args.budget and gz_total > args.budget:
+        print("web UI: gzip transfer size %d bytes exceeds the budget of %d bytes" % (gz_total, args.budget),
+              file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Measure the API traffic a device serves over a period, e.g. with a dashboard open.
+
+Reads the http counters of /api/v1/system/metrics at the start and the end of
+the period and prints new connections, API responses and response bytes per
+second between the two. Open the dashboard (or several) before starting; the
+script's own two requests are left out of the rates.
+
+The counters cover the HTTP payload the device sends, not radio airtime, which
+needs a capture in monitor mode on the device's channel.
+"""
+
+import argparse
+import json
+import sys
+import time
+import urllib.request
+
+
+def http_counters(base):
+    """The http counters and the size of the response they came in"""
+    with urllib.request.urlopen(base + "/api/v1/system/metrics", timeout=10) as response:
+        body = response.read()
+    return json.loads(body)["http"], len(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="device address, e.g. dashboard.local")
+    parser.add_argument("--duration", type=float, default=3600, help="seconds to measure for")
+    parser.add_argument("--scheme", default="http", choices=["http", "https"])
+    args = parser.parse_args()
+
+    base = "%s://%s" % (args.scheme, args.host)
+    start, start_bytes = http_counters(base)
+    started = time.monotonic()
+    time.sleep(args.duration)
+    end, _ = http_counters(base)
+    elapsed = time.monotonic() - started
+
+    # The 32-bit counters may wrap during a long run. The end request's connection and the start request's
+    # response fall inside the period, as the device counts a response once it is sent
+    connections = (end["connections"] - start["connections"]) % (1 << 32) - 1
+    responses = (end["api_responses"] - start["api_responses"]) % (1 << 32) - 1
+    response_bytes = end["api_response_bytes"] - start["api_response_bytes"] - start_bytes
+    print("%.0f s measured" % elapsed)
+    print("connections     %8d  %8.3f /s" % (connections, connections / elapsed))
+    print("API responses   %8d  %8.3f /s" % (responses, responses / elapsed))
+    print("response bytes  %8d  %8.1f B/s, %.0f B per response" % (response_bytes, response_bytes / elapsed,
+                                                                      response_bytes / responses if responses else 0))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
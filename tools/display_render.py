@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+"""Render the display UI into the framebuffer backend on the host and check it.
+
+Builds main/display/display.c with CONFIG_METER_DISPLAY_PANEL_FRAMEBUFFER and
+LVGL 8 from the component manager's checkout (managed_components/lvgl__lvgl
+after an idf.py build, or --lvgl), against small stand-ins for the ESP-IDF and
+FreeRTOS headers. The driver includes display.c, so it renders with the same
+create_ui(), update_values() and flush_cb() as the firmware, but refreshes
+synchronously with lv_refr_now() instead of running the display task. Checked:
+
+  - the first refresh redraws the whole screen
+  - the framebuffer is plain RGB565 even though LVGL renders byte-swapped for
+    the SPI panel (LV_COLOR_16_SWAP, as in sdkconfig)
+  - changing one probe redraws only an area inside that probe's row
+  - the flush time and area land in display_get_stats()
+
+--ppm writes the final frame for a look.
+"""
+
+import argparse
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+MAIN = os.path.join(ROOT, "main")
+
+WIDTH = 240
+HEIGHT = 240
+
+# Stand-ins for the headers display.c, mem.h and temperature.h include
+STUBS = {
+    "esp_err.h": r"""
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERROR_CHECK(x) ((void)(x))
+""",
+    "esp_attr.h": "#pragma once\n#define DMA_ATTR\n",
+    "esp_heap_caps.h": r"""
+#pragma once
+#include <stdlib.h>
+#define MALLOC_CAP_DMA 0
+#define MALLOC_CAP_INTERNAL 0
+#define heap_caps_malloc(size, caps) malloc(size)
+""",
+    "esp_log.h": r"""
+#pragma once
+#include <stdio.h>
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)
+""",
+    "esp_timer.h": r"""
+#pragma once
+#include <stdint.h>
+#include <time.h>
+static inline int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+""",
+    "freertos/FreeRTOS.h": r"""
+#pragma once
+#include <stdint.h>
+/* Single-threaded on the host, the locks only have to compile */
+typedef int portMUX_TYPE;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+typedef int StaticTask_t;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_SAFE(mux) ((void)(mux))
+#define portEXIT_CRITICAL_SAFE(mux) ((void)(mux))
+#define pdMS_TO_TICKS(ms) (ms)
+""",
+    "freertos/task.h": r"""
+#pragma once
+/* The driver refreshes by hand, the display task is never started */
+#define xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, core) ((void)(fn))
+#define xTaskCreateStaticPinnedToCore(fn, name, stack, arg, prio, buf, tcb, core) ((void)(fn))
+#define vTaskDelay(ticks)
+""",
+}
+
+DRIVER = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include "display.c"
+
+static temperature_snapshot_t s_snapshot;
+
+void temperature_get_snapshot(temperature_snapshot_t *snapshot) {
+    *snapshot = s_snapshot;
+}
+
+void *mem_alloc_cold(size_t size) {
+    return calloc(1, size);
+}
+
+static uint16_t s_previous[DISPLAY_W * DISPLAY_H];
+
+static void refresh(const char *what) {
+    memcpy(s_previous, display_get_framebuffer(), sizeof(s_previous));
+    update_values(&s_snapshot);
+    lv_refr_now(NULL);
+    display_stats_t stats;
+    display_get_stats(&stats);
+
+    /* Bounding box of the pixels that changed */
+    const uint16_t *fb = display_get_framebuffer();
+    int x1 = DISPLAY_W, y1 = DISPLAY_H, x2 = -1, y2 = -1;
+    for (int y = 0; y < DISPLAY_H; y++) {
+        for (int x = 0; x < DISPLAY_W; x++) {
+            if (fb[y * DISPLAY_W + x] != s_previous[y * DISPLAY_W + x]) {
+                x1 = x < x1 ? x : x1;
+                y1 = y < y1 ? y : y1;
+                x2 = x > x2 ? x : x2;
+                y2 = y > y2 ? y : y2;
+            }
+        }
+    }
+    printf("refresh %s updates=%u area=%u flush_us=%u changed=%d,%d,%d,%d\n", what, (unsigned)stats.updates,
+           (unsigned)stats.last_area_px, (unsigned)stats.last_flush_us, x1, y1, x2, y2);
+}
+
+int main(int argc, char **argv) {
+    display_init();
+    if (display_get_framebuffer() == NULL) {
+        return 1;
+    }
+    for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+        s_snapshot.temp[i] = 20 + i;
+        s_snapshot.target[i] = 60 + i;
+    }
+    s_snapshot.seq = 1;
+    memset(s_previous, 0, sizeof(s_previous));
+    refresh("initial");
+
+    s_snapshot.temp[2] = 85;
+    s_snapshot.seq = 2;
+    refresh("probe2");
+
+    /* The targets are drawn in grey, count it in either byte order */
+    lv_color_t grey = lv_palette_main(LV_PALETTE_GREY);
+    uint16_t plain = (LV_COLOR_GET_R(grey) << 11) | (LV_COLOR_GET_G(grey) << 5) | LV_COLOR_GET_B(grey);
+    uint16_t swapped = __builtin_bswap16(plain);
+    const uint16_t *fb = display_get_framebuffer();
+    unsigned plain_px = 0, swapped_px = 0;
+    for (int i = 0; i < DISPLAY_W * DISPLAY_H; i++) {
+        plain_px += fb[i] == plain;
+        swapped_px += fb[i] == swapped;
+    }
+    printf("grey plain=%u swapped=%u swap=%d row_h=%d\n", plain_px, swapped_px, LV_COLOR_16_SWAP,
+           DISPLAY_H / TEMPERATURE_PROBE_COUNT);
+
+    if (argc > 1) {
+        FILE *f = fopen(argv[1], "wb");
+        fprintf(f, "P6\n%d %d\n255\n", DISPLAY_W, DISPLAY_H);
+        for (int i = 0; i < DISPLAY_W * DISPLAY_H; i++) {
+            uint8_t rgb[3] = {(fb[i] >> 11) << 3, ((fb[i] >> 5) & 0x3f) << 2, (fb[i] & 0x1f) << 3};
+            fwrite(rgb, 1, 3, f);
+        }
+        fclose(f);
+    }
+    return 0;
+}
+"""
+
+
+def build(build_dir, lvgl, cc):
+    for name, text in STUBS.items():
+        path = os.path.join(build_dir, name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as f:
+            f.write(text)
+    with open(os.path.join(build_dir, "sdkconfig.h"), "w") as f:
+        f.write("#pragma once\n#define CONFIG_METER_DISPLAY_ENABLE 1\n"
+                "#define CONFIG_METER_DISPLAY_PANEL_FRAMEBUFFER 1\n"
+                "#define CONFIG_METER_DISPLAY_WIDTH %d\n#define CONFIG_METER_DISPLAY_HEIGHT %d\n"
+                "#define CONFIG_METER_DISPLAY_BUF_LINES 20\n#define CONFIG_METER_DISPLAY_TASK_PRIORITY 1\n"
+                "#define CONFIG_METER_NETWORK_CORE 0\n#define CONFIG_LV_FONT_MONTSERRAT_28 1\n" % (WIDTH, HEIGHT))
+    driver = os.path.join(build_dir, "driver.c")
+    with open(driver, "w") as f:
+        f.write(DRIVER)
+
+    # The options sdkconfig sets for LVGL, the rest are LVGL's defaults
+    lv_defines = ["-DLV_CONF_SKIP", "-DLV_COLOR_DEPTH=16", "-DLV_COLOR_16_SWAP=1", "-DLV_FONT_MONTSERRAT_28=1",
+                  "-DLV_MEM_SIZE=(128U*1024U)"]
+    sources = glob.glob(os.path.join(lvgl, "src", "**", "*.c"), recursive=True)
+    includes = ["-I", build_dir, "-I", lvgl] + sum([["-I", os.path.join(MAIN, d)]
+                                                    for d in ("display", "temperature", "sched", "mem")], [])
+    binary = os.path.join(build_dir, "display_render")
+    flags = ["-std=gnu17", "-O1", "-w", "-include", "sdkconfig.h"]
+    subprocess.check_call([cc] + flags + lv_defines + includes + ["-o", binary, driver] + sources)
+    return binary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--lvgl", default=os.path.join(ROOT, "managed_components", "lvgl__lvgl"),
+                        help="LVGL 8 source tree")
+    parser.add_argument("--ppm", help="write the rendered frame to this file")
+    args = parser.parse_args()
+
+    if not os.path.isfile(os.path.join(args.lvgl, "lvgl.h")):
+        sys.exit("no LVGL at %s, run idf.py reconfigure or pass --lvgl" % args.lvgl)
+    cc = os.environ.get("CC", "cc")
+    with tempfile.TemporaryDirectory() as build_dir:
+        binary = build(build_dir, args.lvgl, cc)
+        output = subprocess.run([binary] + ([args.ppm] if args.ppm else []), stdout=subprocess.PIPE,
+                                universal_newlines=True, check=True).stdout
+    print(output, end="")
+
+    refreshes = {}
+    grey = {}
+    for line in output.splitlines():
+        words = line.split()
+        fields = dict(word.split("=", 1) for word in words[1:] if "=" in word)
+        if words[0] == "refresh":
+            refreshes[words[1]] = fields
+        elif words[0] == "grey":
+            grey = {key: int(value) for key, value in fields.items()}
+
+    failures = []
+    initial, probe2 = refreshes["initial"], refreshes["probe2"]
+    if int(initial["area"]) < WIDTH * HEIGHT:
+        failures.append("first refresh redrew %s of %d px" % (initial["area"], WIDTH * HEIGHT))
+    if int(probe2["updates"]) != int(initial["updates"]) + 1:
+        failures.append("changing a probe did not cause exactly one refresh")
+    if int(probe2["area"]) >= WIDTH * HEIGHT // 4:
+        failures.append("changing one probe redrew %s px" % probe2["area"])
+    x1, y1, x2, y2 = (int(v) for v in probe2["changed"].split(","))
+    row_h = grey["row_h"]
+    if y2 < 0 or y1 < 2 * row_h or y2 >= 3 * row_h:
+        failures.append("pixels changed in rows %d-%d, probe 2 is rows %d-%d" %
+                        (y1, y2, 2 * row_h, 3 * row_h - 1))
+    if grey["plain"] == 0 or grey["swapped"] != 0:
+        failures.append("framebuffer is not plain RGB565 (%d plain, %d swapped grey px)" %
+                        (grey["plain"], grey["swapped"]))
+
+    for failure in failures:
+        print("FAIL", failure)
+    if not failures:
+        print("ok")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Measure what a first visit to the dashboard transfers, with and without compression.
+
+Fetches a page and every script, stylesheet, font and image it references from
+the device, one after another over a single kept-alive connection like a
+browser's first connection does, once accepting no encoding and once accepting
+gzip (and br). Prints bytes on the wire and wall time for both.
+"""
+
+import argparse
+import gzip
+import http.client
+import re
+import ssl
+import sys
+import time
+import urllib.parse
+
+ASSET_RE = re.compile(r'(?:src|href)="(/[^"#?]+\.(?:js|css|woff2?|ttf|png|svg|ico|json|webmanifest))"')
+
+
+def decode(body, encoding):
+    if encoding == "gzip":
+        return gzip.decompress(body)
+    if encoding == "br":
+        import brotli
+        return brotli.decompress(body)
+    return body
+
+
+def connect(host, port, use_tls):
+    if use_tls:
+        ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+        ctx.check_hostname = False
+        ctx.verify_mode = ssl.CERT_NONE
+        return http.client.HTTPSConnection(host, port, context=ctx, timeout=30)
+    return http.client.HTTPConnection(host, port, timeout=30)
+
+
+def fetch(conn, path, accept):
+    conn.request("GET", path, headers={"Accept-Encoding": accept})
+    response = conn.getresponse()
+    body = response.read()
+    if response.status != 200:
+        raise RuntimeError("GET %s answered %d" % (path, response.status))
+    return body, response.getheader("Content-Encoding", "identity")
+
+
+def first_load(host, port, use_tls, page, accept, verbose):
+    """Return (files, bytes received, seconds)."""
+    start = time.perf_counter()
+    conn = connect(host, port, use_tls)
+    body, encoding = fetch(conn, page, accept)
+    total = len(body)
+    assets = sorted(set(ASSET_RE.findall(decode(body, encoding).decode("utf-8", errors="replace"))))
+    if verbose:
+        print("  %-60s %8d %s" % (page, len(body), encoding))
+    for asset in assets:
+        body, encoding = fetch(conn, urllib.parse.urljoin(page, asset), accept)
+        total += len(body)
+        if verbose:
+            print("  %-60s %8d %s" % (asset, len(body), encoding))
+    conn.close()
+    return 1 + len(assets), total, time.perf_counter() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="device address, e.g. dashboard.local")
+    parser.add_argument("--port", type=int, help="default 80, or 443 with --https")
+    parser.add_argument("--https", action="store_true", help="connect over TLS (CONFIG_METER_HTTPS_ENABLE)")
+    parser.add_argument("--page", default="/", help="page to load (default /)")
+    parser.add_argument("-r", "--runs", type=int, default=3, help="loads per mode, the fastest counts (default 3)")
+    parser.add_argument("-v", "--verbose", action="store_true", help="list every file")
+    args = parser.parse_args()
+    port = args.port or (443 if args.https else 80)
+
+    # Browsers only offer br over HTTPS
+    modes = [("identity", "identity"), ("gzip", "gzip, deflate, br" if args.https else "gzip, deflate")]
+    results = {}
+    for label, accept in modes:
+        runs = []
+        for run in range(args.runs):
+            if args.verbose:
+                print("%s, run %d:" % (label, run + 1))
+            runs.append(first_load(args.host, port, args.https, args.page, accept, args.verbose))
+        results[label] = min(runs, key=lambda r: r[2])
+
+    for label, _ in modes:
+        files, size, seconds = results[label]
+        print("%-9s %3d files %9d bytes %8.0f ms" % (label, files, size, seconds * 1e3))
+    before, after = results["identity"], results["gzip"]
+    print("compression saves %.0f%% of the bytes and %.0f%% of the time" % (
+        100.0 * (1 - after[1] / max(before[1], 1)), 100.0 * (1 - after[2] / max(before[2], 1e-9))))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
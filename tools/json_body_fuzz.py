@@ -0,0 +1,382 @@
+#!/usr/bin/env python3
+"""Fuzz the request body parser on the host and time it against cJSON.
+
+Builds main/json_body/json_body.c with the host C compiler, under AddressSanitizer
+and UndefinedBehaviorSanitizer, and feeds it bodies for the schemas of
+POST /temp/target and POST /wifi/credentials:
+
+  valid     well formed bodies with members in any order, whitespace, escapes
+            and fractions, which must all be accepted
+  mutated   valid bodies with bytes flipped, inserted, deleted or truncated
+  random    bytes drawn mostly from JSON's punctuation
+
+Every body is parsed in one piece and again cut into random chunks, as
+httpd_req_recv() hands them over, and both must agree to the byte offset of
+the error. Python's json module is the reference: a body json_body accepts
+must parse to the same members and values there, with no duplicates.
+
+The timing parses a POST /temp/target body in a loop with json_body and, if
+its sources are found (--cjson, by default ESP-IDF's copy under $IDF_PATH),
+with cJSON_Parse() and cJSON_GetObjectItem() as the handlers did before. Host
+times only compare the two, an ESP32-S3 is an order of magnitude slower.
+"""
+
+import argparse
+import json
+import math
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+JSON_BODY_DIR = os.path.join(ROOT, "main", "json_body")
+REST_SERVER = os.path.join(ROOT, "main", "rest_server.c")
+
+STUBS = {
+    "esp_err.h": r"""
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_INVALID_ARG 0x102
+""",
+}
+
+DRIVER = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "json_body.h"
+#ifdef HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+/* The schemas of the POST /temp/target and POST /wifi/credentials handlers in rest_server.c */
+static int32_t s_targets[4];
+static char s_ssid[33];
+static char s_password[64];
+
+static const json_field_t s_target_fields[] = {
+    {"temp_0", JSON_FIELD_INT, &s_targets[0], 0, 0, TEMP_TARGET_MAX, true},
+    {"temp_1", JSON_FIELD_INT, &s_targets[1], 0, 0, TEMP_TARGET_MAX, true},
+    {"temp_2", JSON_FIELD_INT, &s_targets[2], 0, 0, TEMP_TARGET_MAX, true},
+    {"temp_3", JSON_FIELD_INT, &s_targets[3], 0, 0, TEMP_TARGET_MAX, true},
+};
+static const json_field_t s_credential_fields[] = {
+    {"ssid", JSON_FIELD_STRING, s_ssid, sizeof(s_ssid), 1, 32, true},
+    {"password", JSON_FIELD_STRING, s_password, sizeof(s_password), 0, 63, true},
+};
+
+static int parse(int schema, const char *body, size_t len, size_t *cuts, size_t cut_count, json_body_t *p) {
+    if (schema == 0) {
+        json_body_init(p, s_target_fields, 4);
+    } else {
+        json_body_init(p, s_credential_fields, 2);
+    }
+    if (cut_count == 0) {
+        esp_err_t err = json_body_feed(p, body, len);
+        return err == ESP_OK ? json_body_finish(p) : err;
+    }
+    size_t start = 0;
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i <= cut_count && err == ESP_OK; i++) {
+        size_t end = i < cut_count ? cuts[i] : len;
+        /* Each chunk in a buffer of its own, so reading past it is caught */
+        char *chunk = malloc(end - start + 1);
+        memcpy(chunk, body + start, end - start);
+        err = json_body_feed(p, chunk, end - start);
+        free(chunk);
+        start = end;
+    }
+    return err == ESP_OK ? json_body_finish(p) : err;
+}
+
+static void print_result(int schema, int err, const json_body_t *p) {
+    if (err != ESP_OK) {
+        printf("error %zu %s\n", p->offset, json_body_error(p));
+    } else if (schema == 0) {
+        printf("ok %ld %ld %ld %ld\n", (long)s_targets[0], (long)s_targets[1], (long)s_targets[2], (long)s_targets[3]);
+    } else {
+        /* Hex, the strings may hold anything */
+        printf("ok ");
+        for (const char *s = s_ssid; *s != '\0'; s++) {
+            printf("%02x", (unsigned char)*s);
+        }
+        printf(" ");
+        for (const char *s = s_password; *s != '\0'; s++) {
+            printf("%02x", (unsigned char)*s);
+        }
+        printf(" \n");
+    }
+}
+
+/* Records on stdin: "<schema> <length> <seed>\n" and the body, two lines out per record: whole and chunked */
+static int fuzz(void) {
+    int schema;
+    size_t len;
+    unsigned seed;
+    while (scanf("%d %zu %u", &schema, &len, &seed) == 3 && getchar() == '\n') {
+        char *body = malloc(len ? len : 1);
+        if (fread(body, 1, len, stdin) != len) {
+            return 1;
+        }
+        json_body_t p;
+        print_result(schema, parse(schema, body, len, NULL, 0, &p), &p);
+
+        srand(seed);
+        size_t cuts[64];
+        size_t cut_count = 0;
+        for (size_t at = 0; len > 0 && cut_count < 64;) {
+            at += 1 + rand() % (seed % 3 == 0 ? 2 : 24);
+            if (at >= len) {
+                break;
+            }
+            cuts[cut_count++] = at;
+        }
+        print_result(schema, parse(schema, body, len, cuts, cut_count, &p), &p);
+        free(body);
+    }
+    return 0;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile int32_t s_sink;
+
+static int bench(const char *body, long rounds) {
+    size_t len = strlen(body);
+    json_body_t p;
+    double start = now_ns();
+    for (long r = 0; r < rounds; r++) {
+        if (parse(0, body, len, NULL, 0, &p) != ESP_OK) {
+            return 1;
+        }
+        s_sink += s_targets[3];
+    }
+    printf("json_body %.1f\n", (now_ns() - start) / rounds);
+#ifdef HAVE_CJSON
+    static const char *keys[4] = {"temp_0", "temp_1", "temp_2", "temp_3"};
+    start = now_ns();
+    for (long r = 0; r < rounds; r++) {
+        cJSON *root = cJSON_Parse(body);
+        for (int i = 0; i < 4; i++) {
+            s_sink += cJSON_GetObjectItem(root, keys[i])->valueint;
+        }
+        cJSON_Delete(root);
+    }
+    printf("cjson %.1f\n", (now_ns() - start) / rounds);
+#endif
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "bench") == 0) {
+        return bench(argv[2], atol(argv[3]));
+    }
+    return fuzz();
+}
+"""
+
+TARGET_KEYS = ["temp_0", "temp_1", "temp_2", "temp_3"]
+PUNCTUATION = b'{}[]:,"\\ -.0123456789eEtrufalsn\t\n'
+
+
+def temp_target_max():
+    with open(REST_SERVER) as f:
+        match = re.search(r"#define TEMP_TARGET_MAX\s+(\d+)", f.read())
+    if match is None:
+        sys.exit("TEMP_TARGET_MAX not found in " + REST_SERVER)
+    return int(match.group(1))
+
+
+def build(build_dir, cc, flags, cjson=None):
+    for name, text in STUBS.items():
+        with open(os.path.join(build_dir, name), "w") as f:
+            f.write(text)
+    driver = os.path.join(build_dir, "driver.c")
+    with open(driver, "w") as f:
+        f.write(DRIVER)
+    binary = os.path.join(build_dir, "json_body_" + ("cjson" if cjson else "fuzz" if "-g" in flags else "bench"))
+    sources = [driver, os.path.join(JSON_BODY_DIR, "json_body.c")]
+    includes = ["-I", build_dir, "-I", JSON_BODY_DIR]
+    defines = ["-DTEMP_TARGET_MAX=%d" % temp_target_max()]
+    if cjson:
+        sources.append(os.path.join(cjson, "cJSON.c"))
+        includes += ["-I", cjson]
+        defines.append("-DHAVE_CJSON")
+    subprocess.check_call([cc, "-std=gnu17", "-Wall"] + flags + defines + includes + ["-o", binary] + sources + ["-lm"])
+    return binary
+
+
+def spaces(rng):
+    return "".join(rng.choice(" \t\r\n") for _ in range(rng.choice([0, 0, 0, 1, 3])))
+
+
+def json_string(rng, text):
+    """A JSON string literal of text with random escaping"""
+    out = []
+    for c in text:
+        r = rng.random()
+        if c in '"\\' or ord(c) < 0x20:
+            out.append(json.dumps(c)[1:-1])
+        elif r < 0.05:
+            out.append("\\u%04x" % ord(c) if ord(c) < 0x10000 else c)
+        elif r < 0.08 and c == "/":
+            out.append("\\/")
+        else:
+            out.append(c)
+    return '"' + "".join(out) + '"'
+
+
+def valid_body(rng, schema, target_max):
+    if schema == 0:
+        members = []
+        for key in TARGET_KEYS:
+            value = rng.randint(0, target_max)
+            literal = str(value)
+            if rng.random() < 0.2:
+                literal += "." + str(rng.randint(0, 999))
+            members.append('"%s"%s:%s%s' % (key, spaces(rng), spaces(rng), literal))
+    else:
+        alphabet = "abcXYZ09 _-/\"\\\té€"
+        ssid = "".join(rng.choice(alphabet) for _ in range(rng.randint(1, 10)))
+        password = "".join(rng.choice(alphabet) for _ in range(rng.randint(0, 20)))
+        members = ['"ssid":%s%s' % (spaces(rng), json_string(rng, ssid)),
+                   '"password":%s%s' % (spaces(rng), json_string(rng, password))]
+    rng.shuffle(members)
+    body = spaces(rng) + "{" + spaces(rng) + ("," + spaces(rng)).join(members) + spaces(rng) + "}" + spaces(rng)
+    return body.encode()
+
+
+def mutate(rng, body):
+    body = bytearray(body)
+    for _ in range(rng.randint(1, 4)):
+        op = rng.random()
+        at = rng.randrange(len(body) + 1)
+        if op < 0.3 and body:
+            body[min(at, len(body) - 1)] = rng.choice(PUNCTUATION + bytes([rng.randrange(256)]))
+        elif op < 0.6:
+            body[at:at] = bytes([rng.choice(PUNCTUATION)])
+        elif op < 0.85 and body:
+            del body[min(at, len(body) - 1)]
+        else:
+            del body[at:]
+    return bytes(body)
+
+
+def reference(schema, body, target_max):
+    """What a body has to parse to if json_body accepts it, None if it must be rejected"""
+    def no_duplicates(pairs):
+        keys = [k for k, _ in pairs]
+        if len(keys) != len(set(keys)):
+            raise ValueError("duplicate")
+        return dict(pairs)
+    def no_constants(name):
+        raise ValueError(name + " is not JSON")
+    try:
+        # Strings are taken as bytes, like cJSON did, an SSID does not have to be UTF-8
+        obj = json.loads(body.decode("utf-8", "surrogateescape"), object_pairs_hook=no_duplicates,
+                         parse_constant=no_constants)
+    except (ValueError, RecursionError):
+        return None
+    if not isinstance(obj, dict):
+        return None
+    if schema == 0:
+        if sorted(obj) != TARGET_KEYS:
+            return None
+        values = []
+        for key in TARGET_KEYS:
+            value = obj[key]
+            if isinstance(value, bool) or not isinstance(value, (int, float)) or not math.isfinite(value):
+                return None
+            if not 0 <= int(value) <= target_max:
+                return None
+            values.append(str(int(value)))
+        return "ok " + " ".join(values)
+    if sorted(obj) != ["password", "ssid"] or not all(isinstance(v, str) for v in obj.values()):
+        return None
+    try:
+        ssid, password = (obj[key].encode("utf-8", "surrogateescape") for key in ("ssid", "password"))
+    except UnicodeEncodeError:
+        return None
+    if not 1 <= len(ssid) <= 32 or len(password) > 63:
+        return None
+    return "ok %s %s " % (ssid.hex(), password.hex())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bodies", type=int, default=200000, help="bodies to fuzz with")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--rounds", type=int, default=1000000, help="parses per timing")
+    parser.add_argument("--cjson", default=os.path.join(os.environ.get("IDF_PATH", ""), "components", "json", "cJSON"),
+                        help="directory with cJSON.c and cJSON.h")
+    args = parser.parse_args()
+
+    cc = os.environ.get("CC", "cc")
+    rng = random.Random(args.seed)
+    target_max = temp_target_max()
+    cjson = args.cjson if os.path.isfile(os.path.join(args.cjson, "cJSON.c")) else None
+
+    bodies = []
+    for _ in range(args.bodies):
+        schema = rng.randrange(2)
+        kind = rng.random()
+        if kind < 0.2:
+            body = valid_body(rng, schema, target_max)
+        elif kind < 0.9:
+            body = mutate(rng, valid_body(rng, schema, target_max))
+        else:
+            body = bytes(rng.choice(PUNCTUATION) for _ in range(rng.randint(0, 40)))
+        bodies.append((schema, body, kind < 0.2))
+
+    with tempfile.TemporaryDirectory() as build_dir:
+        fuzz = build(build_dir, cc, ["-O1", "-g", "-fsanitize=address,undefined", "-fno-sanitize-recover=all"])
+        records = b"".join(b"%d %d %d\n" % (schema, len(body), rng.randrange(1 << 30)) + body
+                           for schema, body, _ in bodies)
+        result = subprocess.run([fuzz], input=records, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        if result.returncode != 0:
+            sys.stderr.write(result.stderr.decode(errors="replace"))
+            print("FAIL the parser crashed or a sanitizer fired, exit status %d" % result.returncode)
+            return 1
+        lines = result.stdout.decode().split("\n")
+
+        failures = []
+        accepted = 0
+        for i, (schema, body, valid) in enumerate(bodies):
+            whole, chunked = lines[2 * i], lines[2 * i + 1]
+            expect = reference(schema, body, target_max)
+            if whole != chunked:
+                failures.append("%r: %r whole, %r in chunks" % (body, whole, chunked))
+            elif whole.startswith("ok") and whole != expect:
+                failures.append("%r: accepted as %r, json parses it to %r" % (body, whole, expect))
+            elif valid and whole != expect:
+                failures.append("%r: valid, but %r" % (body, whole))
+            accepted += whole.startswith("ok")
+
+        body = '{"temp_0":63,"temp_1":71,"temp_2":0,"temp_3":250}'
+        timings = []
+        for binary in [build(build_dir, cc, ["-O2"])] + ([build(build_dir, cc, ["-O2"], cjson)] if cjson else []):
+            output = subprocess.run([binary, "bench", body, str(args.rounds)], stdout=subprocess.PIPE,
+                                    universal_newlines=True, check=True).stdout
+            timings = [line.split() for line in output.splitlines()]
+
+    for failure in failures[:20]:
+        print("FAIL", failure)
+    print("%d bodies, %d accepted, %d disagreements, no sanitizer reports" % (len(bodies), accepted, len(failures)))
+    for name, ns in timings:
+        print("%-10s %7.1f ns per POST /temp/target body, %5.1f MB/s" % (name, float(ns), len(body) * 1e3 / float(ns)))
+    if not cjson:
+        print("cJSON not found at %s, pass --cjson to compare" % args.cjson)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
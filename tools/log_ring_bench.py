@@ -0,0 +1,220 @@
+#!/usr/bin/env python3
+"""Time a log call on the host with and without the log ring.
+
+Builds main/log_ring/log_ring.c with the host C compiler against stand-ins for
+esp_log (log v1 formats, as in sdkconfig) and FreeRTOS, and times a typical
+line at each level through:
+
+  direct   esp_log's own vprintf, what CONFIG_METER_LOG_RING_ENABLE=n does
+  ring     the ring's hook, with errors (and warnings, the default) also
+           printed in the call
+
+The console stand-in is a line-buffered stream to /dev/null, so every printed
+line costs a write() like a console write on the device; it is the cheapest
+such console there is. On the ESP32-S3 the USB CDC console blocks the caller
+until the host has taken the line, which is what the ring keeps out of the
+logging task for info and debug lines.
+
+The driver includes log_ring.c, so it also checks that exactly the direct levels
+reach the console from the call, and that the echo task would skip them.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+MAIN = os.path.join(ROOT, "main")
+
+STUBS = {
+    "esp_err.h": r"""
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_INVALID_ARG 0x102
+""",
+    "esp_log.h": r"""
+#pragma once
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+typedef enum {
+    ESP_LOG_NONE, ESP_LOG_ERROR, ESP_LOG_WARN, ESP_LOG_INFO, ESP_LOG_DEBUG, ESP_LOG_VERBOSE
+} esp_log_level_t;
+typedef int (*vprintf_like_t)(const char *, va_list);
+extern vprintf_like_t s_log_vprintf;
+static inline vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+    vprintf_like_t previous = s_log_vprintf;
+    s_log_vprintf = func;
+    return previous;
+}
+static inline void esp_log_level_set(const char *tag, esp_log_level_t level) {}
+static inline void esp_log_write(const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    s_log_vprintf(format, ap);
+    va_end(ap);
+}
+/* LOG_FORMAT() of log v1 without colours */
+#define LOG_FORMAT(letter, format) #letter " (%" PRIu32 ") %s: " format "\n"
+#define ESP_LOG_AT(letter, tag, format, ...) \
+    esp_log_write(LOG_FORMAT(letter, format), (uint32_t)123456, tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...) ESP_LOG_AT(E, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_AT(W, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_AT(I, tag, format, ##__VA_ARGS__)
+""",
+    "host.h": r"""
+#pragma once
+#include <string.h>
+/* newlib has it, older glibc does not */
+static inline size_t host_strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#define strlcpy host_strlcpy
+""",
+    "mem.h": r"""
+#pragma once
+#include <stdlib.h>
+static inline void *mem_alloc_cold(size_t size) { return calloc(1, size); }
+/* The echo task is not run, the driver checks what it would print instead */
+#define MEM_TASK_CREATE(fn, name, stack, arg, prio, core) ((void)(fn))
+""",
+    "freertos/FreeRTOS.h": "#pragma once\n#define pdMS_TO_TICKS(ms) (ms)\n",
+    "freertos/task.h": "#pragma once\n#define vTaskDelay(ticks)\n",
+}
+
+DRIVER = r"""
+#include <string.h>
+#include <time.h>
+#include "log_ring.c"
+
+static FILE *s_console;
+static unsigned s_console_lines;
+
+static int console_vprintf(const char *fmt, va_list ap) {
+    s_console_lines++;
+    return vfprintf(s_console, fmt, ap);
+}
+
+vprintf_like_t s_log_vprintf = console_vprintf;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* A line of the size and shape of the firmware's, at each level */
+static void log_at(char level, int i) {
+    static const char *ssid = "HomeNetwork";
+    switch (level) {
+        case 'E':
+            ESP_LOGE("esp-rest", "Failed to connect to %s, attempt %d, reason %d", ssid, i, 201);
+            break;
+        case 'W':
+            ESP_LOGW("esp-rest", "Failed to connect to %s, attempt %d, reason %d", ssid, i, 201);
+            break;
+        default:
+            ESP_LOGI("esp-rest", "Failed to connect to %s, attempt %d, reason %d", ssid, i, 201);
+            break;
+    }
+}
+
+static double bench(char level, long rounds) {
+    double start = now_ns();
+    for (long i = 0; i < rounds; i++) {
+        log_at(level, i);
+    }
+    return (now_ns() - start) / rounds;
+}
+
+int main(int argc, char **argv) {
+    long rounds = atol(argv[1]);
+    s_console = fopen("/dev/null", "w");
+    setvbuf(s_console, NULL, _IOLBF, 256);
+
+    printf("direct %.1f %.1f %.1f\n", bench('I', rounds), bench('W', rounds), bench('E', rounds));
+
+    log_ring_init();
+    printf("ring %.1f %.1f %.1f\n", bench('I', rounds), bench('W', rounds), bench('E', rounds));
+
+    /* One line at each level: which reached the console from the call, which the echo task would print */
+    static const char levels[] = "IWE";
+    for (int i = 0; i < 3; i++) {
+        unsigned before = s_console_lines;
+        log_at(levels[i], 1);
+        char line[ECHO_LINE_MAX];
+        int len = log_ring_format(log_ring_head() - 1, line, sizeof(line));
+        printf("level %c %u %d %d\n", levels[i], s_console_lines - before, len > 0 && !is_direct(line), len);
+    }
+    return 0;
+}
+"""
+
+
+def build(build_dir, cc, direct_warn):
+    for name, text in STUBS.items():
+        path = os.path.join(build_dir, name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as f:
+            f.write(text)
+    with open(os.path.join(build_dir, "sdkconfig.h"), "w") as f:
+        f.write("#pragma once\n#define CONFIG_METER_LOG_RING_ENABLE 1\n#define CONFIG_METER_LOG_RING_ENTRIES 64\n"
+                "#define CONFIG_METER_LOG_RING_ECHO 1\n#define CONFIG_METER_NETWORK_CORE 0\n")
+        if direct_warn:
+            f.write("#define CONFIG_METER_LOG_RING_DIRECT_WARN 1\n")
+    driver = os.path.join(build_dir, "driver.c")
+    with open(driver, "w") as f:
+        f.write(DRIVER)
+    binary = os.path.join(build_dir, "log_ring_bench" + ("_warn" if direct_warn else ""))
+    subprocess.check_call([cc, "-std=gnu17", "-O2", "-Wall", "-Wno-format", "-Wno-unused-function",
+                           "-include", "host.h", "-I", build_dir, "-I", os.path.join(MAIN, "log_ring"),
+                           "-o", binary, driver])
+    return binary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--rounds", type=int, default=200000, help="log calls per level and path")
+    args = parser.parse_args()
+
+    cc = os.environ.get("CC", "cc")
+    failures = []
+    print("%-34s %9s %9s %9s" % ("ns per call", "info", "warn", "error"))
+    with tempfile.TemporaryDirectory() as build_dir:
+        for direct_warn in (True, False):
+            binary = build(build_dir, cc, direct_warn)
+            output = subprocess.run([binary, str(args.rounds)], stdout=subprocess.PIPE, universal_newlines=True,
+                                    check=True).stdout
+            config = "DIRECT_WARN=%s" % ("y" if direct_warn else "n")
+            for line in output.splitlines():
+                fields = line.split()
+                if fields[0] == "direct" and direct_warn:
+                    print("%-34s %9s %9s %9s" % ("direct (ring off)", *fields[1:]))
+                elif fields[0] == "ring":
+                    print("%-34s %9s %9s %9s" % ("ring, " + config, *fields[1:]))
+                elif fields[0] == "level":
+                    level, printed, echoed, length = fields[1], int(fields[2]), int(fields[3]), int(fields[4])
+                    direct = level == "E" or (level == "W" and direct_warn)
+                    if length <= 0:
+                        failures.append("%s, %s: line not in the ring" % (config, level))
+                    if printed != direct:
+                        failures.append("%s, %s: printed %d times in the call" % (config, level, printed))
+                    if echoed == direct:
+                        failures.append("%s, %s: echo task would %sprint it" % (config, level,
+                                                                               "" if echoed else "not "))
+    for failure in failures:
+        print("FAIL", failure)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+"""Create the HTTPS certificate and key of one device.
+
+Writes a self-signed ECDSA P-256 certificate (servercert.pem) and its private
+key (prvtkey.pem) into a directory, for CONFIG_METER_HTTPS_CERT_DIR. Use a
+directory outside the repository and one pair per device: the key is embedded
+in that device's firmware image. An existing key is never overwritten.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dir", help="directory to write servercert.pem and prvtkey.pem to")
+    parser.add_argument("--name", default="dashboard.local", help="host name the certificate is for")
+    parser.add_argument("--ip", default="192.168.4.1", help="address the certificate is also for, the soft AP's")
+    parser.add_argument("--days", type=int, default=3650)
+    args = parser.parse_args()
+
+    cert = os.path.join(args.dir, "servercert.pem")
+    key = os.path.join(args.dir, "prvtkey.pem")
+    if os.path.exists(key):
+        sys.exit("%s exists, remove it first to replace the key" % key)
+    os.makedirs(args.dir, exist_ok=True)
+
+    # Only readable by the owner from the start
+    os.close(os.open(key, os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o600))
+    try:
+        subprocess.check_call(["openssl", "req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1",
+                               "-nodes", "-keyout", key, "-out", cert, "-days", str(args.days),
+                               "-subj", "/CN=" + args.name,
+                               "-addext", "subjectAltName=DNS:%s,IP:%s" % (args.name, args.ip)])
+    except (OSError, subprocess.CalledProcessError) as e:
+        os.remove(key)
+        sys.exit("openssl failed: %s" % e)
+    print("Wrote %s and %s, set CONFIG_METER_HTTPS_CERT_DIR to %s" % (cert, key, os.path.abspath(args.dir)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
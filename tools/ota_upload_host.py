@@ -0,0 +1,375 @@
+#!/usr/bin/env python3
+"""Feed firmware images through the OTA upload handler on the host.
+
+Builds ota_firmware_upload() and parse_sha256_hex(), cut out of
+main/rest_server.c, together with main/ota/ota.c against stand-ins for
+esp_http_server, esp_ota_ops and mbedtls (SHA-256 from OpenSSL's libcrypto).
+The OTA slot is a file of the size of ota_0 in partitions.csv, and the request
+body arrives in recv() calls of at most the pool buffer's size, interleaved
+with the timeouts and drops a slow or broken client would cause. Checked:
+
+  ok          a multi-megabyte image lands in the slot byte for byte, its
+              SHA-256 matches, the slot is selected for boot
+  hash        a wrong X-Image-SHA256 is refused with 400, nothing is selected
+  too-large   an image bigger than the slot is refused with 413 before writing
+  slow        timeouts below the limit only slow the upload down
+  stall       a client that stops sending is answered 408 and the update aborted
+  drop        a connection closed mid-upload is answered 500 and the update aborted
+
+Each case also checks that a following ota_begin() succeeds, so no case leaves
+an update hanging. Host throughput is printed only to show the handler streams.
+"""
+
+import argparse
+import hashlib
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+MAIN = os.path.join(ROOT, "main")
+REST_SERVER = os.path.join(MAIN, "rest_server.c")
+
+STUBS = {
+    "esp_err.h": r"""
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_INVALID_CRC 0x109
+#define ESP_ERR_OTA_VALIDATE_FAILED 0x1503
+static inline const char *esp_err_to_name(esp_err_t err) { return "error"; }
+""",
+    "esp_log.h": r"""
+#pragma once
+#include <stdio.h>
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__)
+""",
+    "esp_timer.h": r"""
+#pragma once
+#include <stdint.h>
+#include <time.h>
+static inline int64_t esp_timer_get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+""",
+    "mbedtls/sha256.h": r"""
+#pragma once
+#include <openssl/sha.h>
+typedef SHA256_CTX mbedtls_sha256_context;
+#define mbedtls_sha256_init(ctx) ((void)(ctx))
+#define mbedtls_sha256_starts(ctx, is224) SHA256_Init(ctx)
+#define mbedtls_sha256_update(ctx, data, len) SHA256_Update(ctx, data, len)
+#define mbedtls_sha256_finish(ctx, out) SHA256_Final(out, ctx)
+#define mbedtls_sha256_free(ctx) ((void)(ctx))
+""",
+    "esp_ota_ops.h": r"""
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+typedef struct { const char *label; uint32_t size; } esp_partition_t;
+typedef int esp_ota_handle_t;
+typedef enum { ESP_OTA_IMG_VALID, ESP_OTA_IMG_PENDING_VERIFY } esp_ota_img_states_t;
+#define OTA_WITH_SEQUENTIAL_WRITES 0xfffffffe
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start);
+const esp_partition_t *esp_ota_get_running_partition(void);
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t size, esp_ota_handle_t *handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *state);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void);
+""",
+    "esp_http_server.h": r"""
+#pragma once
+#include <stddef.h>
+#include "esp_err.h"
+typedef struct { size_t content_len; } httpd_req_t;
+typedef enum {
+    HTTPD_500_INTERNAL_SERVER_ERROR = 500,
+    HTTPD_400_BAD_REQUEST = 400,
+    HTTPD_408_REQ_TIMEOUT = 408,
+    HTTPD_413_CONTENT_TOO_LARGE = 413,
+} httpd_err_code_t;
+#define HTTPD_SOCK_ERR_TIMEOUT -3
+#define HTTPD_SOCK_ERR_FAIL -1
+int httpd_req_recv(httpd_req_t *req, char *buf, size_t len);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *field, char *val, size_t val_size);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg);
+""",
+    "cJSON.h": r"""
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+/* Objects print straight to stdout as key=value, there is only ever one */
+typedef struct { int unused; } cJSON;
+static inline cJSON *cJSON_CreateObject(void) { static cJSON root; return &root; }
+static inline void cJSON_AddBoolToObject(cJSON *o, const char *k, bool v) { printf("%s=%d ", k, v); }
+static inline void cJSON_AddStringToObject(cJSON *o, const char *k, const char *v) { printf("%s=%s ", k, v); }
+static inline void cJSON_AddNumberToObject(cJSON *o, const char *k, double v) { printf("%s=%.0f ", k, v); }
+""",
+    "freertos/FreeRTOS.h": "#pragma once\n#define pdMS_TO_TICKS(ms) (ms)\n",
+    "freertos/task.h": "#pragma once\n#define vTaskDelay(ticks)\n",
+}
+
+DRIVER = r"""
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_http_server.h"
+#include "esp_ota_ops.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "cJSON.h"
+#include "ota.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *REST_TAG = "esp-rest";
+
+/* The partition stand-in */
+static esp_partition_t s_slot = {.label = "ota_0"};
+static FILE *s_slot_file;
+static size_t s_slot_written;
+static bool s_slot_open;
+static const char *s_boot = "factory";
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start) { return &s_slot; }
+const esp_partition_t *esp_ota_get_running_partition(void) { return NULL; }
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *p, esp_ota_img_states_t *state) { return ESP_FAIL; }
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) { return ESP_OK; }
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t size, esp_ota_handle_t *handle) {
+    if (s_slot_open) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    rewind(s_slot_file);
+    s_slot_written = 0;
+    s_slot_open = true;
+    *handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size) {
+    if (!s_slot_open || s_slot_written + size > s_slot.size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    fwrite(data, 1, size, s_slot_file);
+    s_slot_written += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    s_slot_open = false;
+    fflush(s_slot_file);
+    /* What the real one checks first: the image header magic */
+    uint8_t magic = 0;
+    rewind(s_slot_file);
+    if (fread(&magic, 1, 1, s_slot_file) != 1 || magic != 0xE9) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    s_slot_open = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition) {
+    s_boot = partition->label;
+    return ESP_OK;
+}
+
+void esp_restart(void) {
+}
+
+/* The client: the image from a file, cut into recv() calls, with timeouts or a drop injected */
+static FILE *s_image;
+static const char *s_sha256_hex;
+static int s_recv_calls;
+static int s_timeout_every; /* Every n-th recv() times out once */
+static int s_stall_after;   /* Bytes after which every recv() times out, -1 for never */
+static int s_drop_after;    /* Bytes after which the connection closes, -1 for never */
+static size_t s_sent;
+
+int httpd_req_recv(httpd_req_t *req, char *buf, size_t len) {
+    s_recv_calls++;
+    if (s_stall_after >= 0 && s_sent >= (size_t)s_stall_after) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    if (s_drop_after >= 0 && s_sent >= (size_t)s_drop_after) {
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    if (s_timeout_every > 0 && s_recv_calls % s_timeout_every == 0) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    /* Like a socket, hand out less than asked now and then */
+    size_t n = fread(buf, 1, s_recv_calls % 3 == 0 ? len / 2 + 1 : len, s_image);
+    s_sent += n;
+    return n > 0 ? (int)n : HTTPD_SOCK_ERR_FAIL;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *field, char *val, size_t val_size) {
+    if (strcmp(field, "X-Image-SHA256") != 0 || s_sha256_hex == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(val, val_size, "%s", s_sha256_hex);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    printf("status=%d message=%s ", error, msg);
+    return ESP_OK;
+}
+
+static esp_err_t rest_send_json(httpd_req_t *req, cJSON *root, int64_t start_us) {
+    printf("status=200 ");
+    return ESP_OK;
+}
+
+/* Cut out of rest_server.c */
+%(functions)s
+
+int main(int argc, char **argv) {
+    if (argc != 9) {
+        return 2;
+    }
+    s_image = fopen(argv[1], "rb");
+    s_slot_file = fopen(argv[2], "w+b");
+    s_slot.size = strtoul(argv[3], NULL, 0);
+    s_sha256_hex = strcmp(argv[4], "-") == 0 ? NULL : argv[4];
+    s_timeout_every = atoi(argv[5]);
+    s_stall_after = atoi(argv[6]);
+    s_drop_after = atoi(argv[7]);
+    size_t buf_size = strtoul(argv[8], NULL, 0);
+
+    fseek(s_image, 0, SEEK_END);
+    httpd_req_t req = {.content_len = ftell(s_image)};
+    rewind(s_image);
+    char *buf = malloc(buf_size);
+
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err = ota_firmware_upload(&req, buf, buf_size);
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    /* Nothing may be left half open */
+    size_t written = s_slot_written;
+    bool idle = ota_begin(1) == ESP_OK;
+    ota_abort();
+    printf("result=%s boot=%s slot_bytes=%zu recv_calls=%d idle=%d host_us=%lld\n", err == ESP_OK ? "ok" : "fail",
+           s_boot, written, s_recv_calls, idle, (long long)elapsed_us);
+    return 0;
+}
+"""
+
+
+def cut_functions(names):
+    """Source of static functions of rest_server.c, with the comment above each, and the limits they use"""
+    with open(REST_SERVER) as f:
+        source = f.read()
+    parts = re.findall(r"^#define RECV_TIMEOUTS_MAX .*$", source, re.M)
+    for name in names:
+        match = re.search(r"(/\*[^\n]*\*/\n)?static [^\n]*\b%s\(.*?\n}\n" % name, source, re.S)
+        if match is None:
+            sys.exit("%s not found in %s" % (name, REST_SERVER))
+        parts.append(match.group(0))
+    return "\n".join(parts)
+
+
+def ota_0_size():
+    with open(os.path.join(ROOT, "partitions.csv")) as f:
+        for line in f:
+            fields = [field.strip() for field in line.split(",")]
+            if fields[0] == "ota_0":
+                size = fields[4].upper()
+                scale = {"K": 1024, "M": 1024 * 1024}.get(size[-1], 1)
+                return int(size.rstrip("KM"), 0) * scale
+    sys.exit("no ota_0 in partitions.csv")
+
+
+def build(build_dir, cc):
+    for name, text in STUBS.items():
+        path = os.path.join(build_dir, name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as f:
+            f.write(text)
+    driver = os.path.join(build_dir, "driver.c")
+    with open(driver, "w") as f:
+        f.write(DRIVER.replace("%(functions)s", cut_functions(["parse_sha256_hex", "ota_firmware_upload"])))
+    binary = os.path.join(build_dir, "ota_upload")
+    includes = ["-I", build_dir, "-I", os.path.join(MAIN, "ota")]
+    flags = ["-std=gnu17", "-Wall", "-Wno-format", "-Wno-deprecated-declarations", "-Wno-unused-function"]
+    subprocess.check_call([cc] + flags + includes + ["-o", binary, driver, os.path.join(MAIN, "ota", "ota.c"),
+                                                     "-lcrypto"])
+    return binary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--size", type=int, default=768 * 1024, help="image size in bytes, below the ota_0 slot")
+    parser.add_argument("--buf", type=int, default=4096, help="request buffer size, CONFIG_METER_BUF_POOL_LARGE_SIZE")
+    args = parser.parse_args()
+
+    cc = os.environ.get("CC", "cc")
+    slot_size = ota_0_size()
+    with tempfile.TemporaryDirectory() as work:
+        binary = build(work, cc)
+        image_path = os.path.join(work, "image.bin")
+        image = b"\xe9" + os.urandom(args.size - 1)
+        with open(image_path, "wb") as f:
+            f.write(image)
+        big_path = os.path.join(work, "big.bin")
+        with open(big_path, "wb") as f:
+            f.write(b"\xe9" + bytes(slot_size))
+        digest = hashlib.sha256(image).hexdigest()
+        slot_path = os.path.join(work, "slot.bin")
+
+        cases = [
+            # name, image, X-Image-SHA256, timeout every, stall after, drop after, expected
+            ("ok", image_path, digest, 0, -1, -1, {"status": "200", "boot": "ota_0", "sha256": digest}),
+            ("hash", image_path, "00" * 32, 0, -1, -1, {"status": "400", "boot": "factory"}),
+            ("too-large", big_path, "-", 0, -1, -1, {"status": "413", "boot": "factory", "slot_bytes": "0"}),
+            ("slow", image_path, digest, 7, -1, -1, {"status": "200", "boot": "ota_0", "sha256": digest}),
+            ("stall", image_path, "-", 0, args.size // 2, -1, {"status": "408", "boot": "factory"}),
+            ("drop", image_path, "-", 0, -1, args.size // 3, {"status": "500", "boot": "factory"}),
+        ]
+        failures = 0
+        for name, path, sha, every, stall, drop, expect in cases:
+            output = subprocess.run([binary, path, slot_path, str(slot_size), sha, str(every), str(stall), str(drop),
+                                     str(args.buf)], stdout=subprocess.PIPE, universal_newlines=True,
+                                    check=True).stdout
+            fields = dict(word.split("=", 1) for word in output.split() if "=" in word)
+            problems = ["%s=%s, expected %s" % (key, fields.get(key), value)
+                        for key, value in expect.items() if fields.get(key) != value]
+            if fields.get("idle") != "1":
+                problems.append("update left open")
+            if expect.get("boot") == "ota_0":
+                with open(slot_path, "rb") as f:
+                    if f.read(len(image)) != image:
+                        problems.append("slot differs from the image")
+            host_us = int(fields.get("host_us", 0))
+            rate = "%.0f MB/s" % (int(fields.get("slot_bytes", 0)) / host_us) if host_us else "-"
+            print("%-4s %-10s status %-4s %8s bytes in %5s recv() calls, %s on the host%s" % (
+                "FAIL" if problems else "ok", name, fields.get("status"), fields.get("slot_bytes"),
+                fields.get("recv_calls"), rate, "".join("\n     " + problem for problem in problems)))
+            failures += bool(problems)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Pack a built web UI into a bundle for POST /api/v1/webui/bundle.
+
+Bundle layout (little-endian):
+
+    b"WUB1"
+    per file: u16 path_len | path (utf-8, relative, '/' separated) | u32 size | sha256 (32 bytes) | content
+    u16 0 terminator
+
+The device stores files by content hash, so files that did not change since
+the last upload are skipped and only their manifest entry is rewritten.
+Compressible files are followed by their .gz (and with --brotli .br) variants,
+see compress_webui.py.
+"""
+
+import argparse
+import hashlib
+import http.client
+import os
+import struct
+import sys
+import urllib.parse
+
+from compress_webui import ENCODED_SUFFIXES, load_brotli, variants
+
+MAGIC = b"WUB1"
+
+
+def iter_files(root):
+    for directory, dirs, files in os.walk(root):
+        dirs.sort()
+        for name in sorted(files):
+            if name.endswith(ENCODED_SUFFIXES):
+                continue
+            path = os.path.join(directory, name)
+            yield os.path.relpath(path, root).replace(os.sep, "/"), path
+
+
+def write_entry(out, rel, content):
+    encoded = rel.encode("utf-8")
+    if len(encoded) > 128:
+        raise SystemExit("path too long for the device: %s" % rel)
+    out.write(struct.pack("<H", len(encoded)))
+    out.write(encoded)
+    out.write(struct.pack("<I", len(content)))
+    out.write(hashlib.sha256(content).digest())
+    out.write(content)
+
+
+def pack(root, out, brotli=None):
+    count = 0
+    out.write(MAGIC)
+    for rel, path in iter_files(root):
+        with open(path, "rb") as f:
+            content = f.read()
+        write_entry(out, rel, content)
+        count += 1
+        for suffix, data in variants(rel, content, brotli):
+            write_entry(out, rel + suffix, data)
+            count += 1
+    out.write(struct.pack("<H", 0))
+    return count
+
+
+def upload(bundle_path, url, token):
+    parsed = urllib.parse.urlparse(url)
+    conn = http.client.HTTPConnection(parsed.hostname, parsed.port or 80, timeout=120)
+    with open(bundle_path, "rb") as body:
+        headers = {"Content-Length": str(os.path.getsize(bundle_path)), "Content-Type": "application/octet-stream"}
+        if token:
+            headers["Authorization"] = "Bearer " + token
+        conn.request("POST", parsed.path or "/api/v1/webui/bundle", body=body, headers=headers)
+    response = conn.getresponse()
+    print(response.status, response.read().decode(errors="replace"))
+    return response.status == 200
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dist", help="directory produced by 'pnpm build'")
+    parser.add_argument("-o", "--output", default="webui.bundle")
+    parser.add_argument("--brotli", action="store_true", help="also add .br variants")
+    parser.add_argument("--upload", metavar="URL", help="e.g. http://dashboard.local/api/v1/webui/bundle")
+    parser.add_argument("--token", default=os.environ.get("METER_API_TOKEN"),
+                        help="CONFIG_METER_API_TOKEN of the device, default $METER_API_TOKEN")
+    args = parser.parse_args()
+
+    with open(args.output, "wb") as out:
+        count = pack(args.dist, out, load_brotli() if args.brotli else None)
+    print("%s: %d files, %d bytes" % (args.output, count, os.path.getsize(args.output)))
+
+    if args.upload and not upload(args.output, args.upload, args.token):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+"""Time API route dispatch on the host: route table versus a linear wildcard scan.
+
+Builds main/router/router.c with the host C compiler together with a small
+driver and times a lookup of every route of a table, and of a path no route
+has, for three tables:
+
+  8        the first 8 routes of the firmware's table
+  firmware the table in main/rest_server.c
+  64       the firmware's table padded with made up resources to 64 routes
+
+The baseline is what esp_http_server does with handlers registered one by one:
+try httpd_uri_match_wildcard() on each of them in turn, with every route that
+has a {parameter} collapsed to a trailing '*' as before the route table. The
+router is also checked to accept the firmware's table, so a route added out of
+order shows up here before it does on a device.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+ROUTER_DIR = os.path.join(ROOT, "main", "router")
+REST_SERVER = os.path.join(ROOT, "main", "rest_server.c")
+
+# Method numbers of http_parser, which esp_http_server uses
+METHODS = {"HTTP_DELETE": 0, "HTTP_GET": 1, "HTTP_HEAD": 2, "HTTP_POST": 3, "HTTP_PUT": 4, "HTTP_PATCH": 28}
+
+DRIVER = r"""
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "router.h"
+
+typedef struct {
+    int method;
+    const char *pattern;
+} linear_route_t;
+
+/* httpd_uri_match_wildcard() of esp_http_server, without the '?' its templates may end with */
+static bool match_wildcard(const char *template, const char *uri, size_t len) {
+    size_t tpl_len = strlen(template);
+    bool asterisk = tpl_len > 0 && template[tpl_len - 1] == '*';
+    size_t exact = tpl_len - asterisk;
+    if (len < exact || (!asterisk && len != exact)) {
+        return false;
+    }
+    return strncmp(template, uri, exact) == 0;
+}
+
+static int linear_lookup(const linear_route_t *routes, size_t count, int method, const char *uri, size_t len) {
+    for (size_t i = 0; i < count; i++) {
+        /* httpd_find_uri_handler() matches the URI first, a wrong method only means 405 if nothing else matches */
+        if (match_wildcard(routes[i].pattern, uri, len) && routes[i].method == method) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile int s_sink;
+
+static int bench(const char *name, const router_route_t *routes, size_t count, const linear_route_t *linear,
+                 size_t linear_count, const int *methods, const char **paths, const int *expect, size_t requests,
+                 unsigned rounds) {
+    static router_t router;
+    size_t bad;
+    if (!router_init(&router, routes, count, &bad)) {
+        printf("error %s %s %zu\n", name, routes[bad].path, bad);
+        return 1;
+    }
+    for (size_t i = 0; i < requests; i++) {
+        router_match_t match;
+        bool found = router_lookup(&router, methods[i], paths[i], strlen(paths[i]), &match);
+        int got = found ? (int)(match.route - routes) : -1;
+        if (got != expect[i]) {
+            printf("error %s %s matched %d instead of %d\n", name, paths[i], got, expect[i]);
+            return 1;
+        }
+    }
+
+    size_t lens[requests];
+    for (size_t i = 0; i < requests; i++) {
+        lens[i] = strlen(paths[i]);
+    }
+    double start = now_ns();
+    for (unsigned r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < requests; i++) {
+            router_match_t match;
+            s_sink += router_lookup(&router, methods[i], paths[i], lens[i], &match);
+        }
+    }
+    double table_ns = (now_ns() - start) / rounds / requests;
+
+    start = now_ns();
+    for (unsigned r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < requests; i++) {
+            s_sink += linear_lookup(linear, linear_count, methods[i], paths[i], lens[i]);
+        }
+    }
+    double linear_ns = (now_ns() - start) / rounds / requests;
+    printf("result %s %zu %zu %.1f %.1f\n", name, count, linear_count, table_ns, linear_ns);
+    return 0;
+}
+"""
+
+
+def firmware_routes():
+    with open(REST_SERVER) as f:
+        source = f.read()
+    routes = [(METHODS[m], "/api/v1" + p) for m, p in re.findall(r'REST_ROUTE\((HTTP_\w+), "([^"]+)"', source)]
+    if not routes:
+        sys.exit("no REST_ROUTE entries found in " + REST_SERVER)
+    return routes
+
+
+def sort_key(route):
+    """Order of router.h: per segment, ended < literal (bytewise) < parameter, then method."""
+    method, path = route
+    key = []
+    for seg in path.strip("/").split("/"):
+        key.append((2, b"") if seg.startswith("{") else (1, seg.encode()))
+    key.append((0, b""))
+    return key + [method]
+
+
+def padded(routes, count):
+    routes = list(routes)
+    n = 0
+    while len(routes) < count:
+        resource = "/api/v1/res%02d" % n
+        extra = [(METHODS["HTTP_GET"], resource), (METHODS["HTTP_POST"], resource),
+                 (METHODS["HTTP_GET"], resource + "/{id}"), (METHODS["HTTP_DELETE"], resource + "/{id}")]
+        routes += extra[:count - len(routes)]
+        n += 1
+    return sorted(routes, key=sort_key)
+
+
+def linear_table(routes):
+    """Handlers as registered before the route table, a {parameter} and all after it becoming '*'."""
+    table = []
+    for method, path in routes:
+        pattern = path.split("{", 1)[0] + "*" if "{" in path else path
+        if (method, pattern) not in table:
+            table.append((method, pattern))
+    return table
+
+
+def requests(routes):
+    reqs = []
+    for i, (method, path) in enumerate(routes):
+        reqs.append((method, re.sub(r"\{[^}]*\}", "42", path), i))
+    reqs.append((METHODS["HTTP_GET"], "/api/v1/nothing/here", -1))
+    return reqs
+
+
+def c_string(s):
+    return '"' + s.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def emit_case(name, routes, rounds):
+    ident = "t_" + name
+    reqs = requests(routes)
+    linear = linear_table(routes)
+    lines = ["static const router_route_t %s_routes[] = {" % ident]
+    lines += ["    {%d, %s, NULL}," % (m, c_string(p)) for m, p in routes]
+    lines += ["};", "static const linear_route_t %s_linear[] = {" % ident]
+    lines += ["    {%d, %s}," % (m, c_string(p)) for m, p in linear]
+    lines += ["};"]
+    lines += ["static const int %s_methods[] = {%s};" % (ident, ", ".join(str(m) for m, _, _ in reqs))]
+    lines += ["static const char *%s_paths[] = {%s};" % (ident, ", ".join(c_string(p) for _, p, _ in reqs))]
+    lines += ["static const int %s_expect[] = {%s};" % (ident, ", ".join(str(e) for _, _, e in reqs))]
+    call = ("    err |= bench(%s, %s_routes, %d, %s_linear, %d, %s_methods, %s_paths, %s_expect, %d, %d);" %
+            (c_string(name), ident, len(routes), ident, len(linear), ident, ident, ident, len(reqs), rounds))
+    return "\n".join(lines), call
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--rounds", type=int, default=200000, help="lookups of every request per table")
+    args = parser.parse_args()
+
+    firmware = firmware_routes()
+    if sorted(firmware, key=sort_key) != firmware:
+        print("warning: the table in rest_server.c is not in router order, the device will refuse to start")
+    cases = [("8", sorted(firmware[:8], key=sort_key)), ("firmware", firmware), ("64", padded(firmware, 64))]
+
+    source = [DRIVER]
+    calls = []
+    for name, routes in cases:
+        table, call = emit_case(name, routes, args.rounds)
+        source.append(table)
+        calls.append(call)
+    source.append("int main(void) {\n    int err = 0;\n%s\n    return err;\n}\n" % "\n".join(calls))
+
+    with tempfile.TemporaryDirectory() as build_dir:
+        driver = os.path.join(build_dir, "route_bench.c")
+        binary = os.path.join(build_dir, "route_bench")
+        with open(driver, "w") as f:
+            f.write("\n".join(source))
+        cc = os.environ.get("CC", "cc")
+        subprocess.check_call([cc, "-O2", "-I", ROUTER_DIR, "-o", binary, driver,
+                               os.path.join(ROUTER_DIR, "router.c")])
+        result = subprocess.run([binary], stdout=subprocess.PIPE, universal_newlines=True)
+
+    failed = result.returncode != 0
+    print("%-10s %7s %9s %12s %12s %8s" % ("table", "routes", "handlers", "table ns", "linear ns", "speedup"))
+    for line in result.stdout.splitlines():
+        fields = line.split()
+        if fields[0] == "error":
+            print("error: " + " ".join(fields[1:]))
+            failed = True
+            continue
+        name, routes, handlers, table_ns, linear_ns = fields[1:]
+        print("%-10s %7s %9s %12s %12s %7.1fx" % (name, routes, handlers, table_ns, linear_ns,
+                                                  float(linear_ns) / float(table_ns)))
+    print("\nTimes are per lookup, averaged over every route of a table and one unknown path.")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""Simulate a cook to compare adaptive sampling with the fixed-rate baseline.
+
+Builds main/sched/sched.c with the host C compiler and drives it with a
+thermal model of a smoker: a pit around 110 C with lid openings, and three cuts
+of meat with the evaporative stall, one of which is unplugged for a minute.
+Each cut is taken off 15 minutes after it is done.
+Readings are rounded to whole degrees like the probe drivers do.
+
+For every scenario it prints how many samples were taken, how late each target
+was noticed after the meat actually reached it, and the energy a cook takes
+under a simple current model. The model's figures are estimates for an
+ESP32-S3 module connected to an access point with DTIM 1; measure your own board
+and pass them with the --*-ma options for real numbers.
+"""
+
+import argparse
+import ctypes
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+SCHED_SRC = os.path.join(ROOT, "main", "sched", "sched.c")
+PROBES = 4
+REASONS = ["start", "steady", "approach", "near_target", "spike", "fault"]
+
+
+class SchedConfig(ctypes.Structure):
+    _fields_ = [
+        ("min_period_ms", ctypes.c_uint32),
+        ("max_period_ms", ctypes.c_uint32),
+        ("near_c", ctypes.c_int32),
+        ("spike_c_per_min", ctypes.c_int32),
+        ("samples_to_target", ctypes.c_uint32),
+    ]
+
+
+class Sched(ctypes.Structure):
+    """Mirror of sched_t in main/sched/sched.h."""
+    _fields_ = [
+        ("config", SchedConfig),
+        ("period_ms", ctypes.c_uint32),
+        ("reason", ctypes.c_int),
+        ("primed", ctypes.c_bool),
+        ("last_us", ctypes.c_int64),
+        ("fault_mask", ctypes.c_uint32),
+        ("temp", ctypes.c_int32 * PROBES),
+        ("slope", ctypes.c_float * PROBES),
+    ]
+
+
+def load_sched(build_dir):
+    lib_path = os.path.join(build_dir, "libsched.so")
+    cc = os.environ.get("CC", "cc")
+    subprocess.check_call([cc, "-O2", "-shared", "-fPIC", "-o", lib_path, SCHED_SRC])
+    lib = ctypes.CDLL(lib_path)
+    lib.sched_init.argtypes = [ctypes.POINTER(Sched), ctypes.POINTER(SchedConfig)]
+    lib.sched_update.argtypes = [ctypes.POINTER(Sched), ctypes.POINTER(ctypes.c_int32),
+                                 ctypes.POINTER(ctypes.c_int32), ctypes.c_uint32, ctypes.c_int64]
+    lib.sched_update.restype = ctypes.c_uint32
+    return lib
+
+
+class Cook:
+    """Thermal model, stepped once per simulated second."""
+
+    # Heat transfer coefficient per minute, target, stall strength
+    MEATS = [(0.0040, 95, 0.55), (0.0060, 93, 0.45), (0.0120, 74, 0.25)]
+
+    def __init__(self, seed, hours):
+        self.rng = random.Random(seed)
+        self.pit = 20.0
+        self.meat = [20.0 for _ in self.MEATS]
+        self.t = 0
+        self.lid_until = -1
+        # Lid opened about every two hours, for a minute
+        self.lids = sorted(self.rng.uniform(1800, hours * 3600 - 600) for _ in range(max(1, hours // 2)))
+        self.unplugged = (hours * 1800, hours * 1800 + 60)
+        self.done = [None for _ in self.MEATS]
+
+    def targets(self):
+        return [0] + [target for _, target, _ in self.MEATS]
+
+    def step(self):
+        self.t += 1
+        if self.lids and self.t >= self.lids[0]:
+            self.lids.pop(0)
+            self.lid_until = self.t + 60
+        setpoint = 110.0 if self.t >= 900 else 20.0 + 90.0 * self.t / 900
+        if self.t < self.lid_until:
+            self.pit += (40.0 - self.pit) * 0.05
+        else:
+            self.pit += (setpoint - self.pit) * 0.01
+        self.pit += self.rng.gauss(0, 0.05)
+        for i, (k, _, stall) in enumerate(self.MEATS):
+            heat = k / 60 * (self.pit - self.meat[i])
+            # Evaporation holds the surface back between roughly 65 and 75 C
+            if 62.0 < self.meat[i] < 76.0:
+                heat *= 1.0 - stall * (1.0 - abs(self.meat[i] - 69.0) / 7.0)
+            self.meat[i] += heat
+            if self.done[i] is None and self.meat[i] >= self.MEATS[i][1]:
+                self.done[i] = self.t
+
+    def readings(self):
+        temps = [int(round(self.pit))] + [int(round(m)) for m in self.meat]
+        fault = 1 << 3 if self.unplugged[0] <= self.t < self.unplugged[1] else 0
+        # Meat comes off the smoker, probe and all, 15 minutes after it is done
+        for i, (_, target, _) in enumerate(self.MEATS):
+            if self.done[i] is not None and self.t >= self.done[i] + 900:
+                fault |= 1 << (i + 1)
+        for i in range(PROBES):
+            if fault & (1 << i):
+                temps[i] = 0
+        return temps, fault
+
+
+def run(lib, config, args):
+    cook = Cook(args.seed, args.hours)
+    targets = cook.targets()
+    sched = Sched()
+    lib.sched_init(ctypes.byref(sched), ctypes.byref(config))
+    target_arr = (ctypes.c_int32 * PROBES)(*targets)
+
+    samples = 0
+    reasons = [0] * len(REASONS)
+    reached = [None] * PROBES  # When the model crossed the target
+    noticed = [None] * PROBES  # When a sample first showed it
+    next_sample_ms = 0
+    end_ms = args.hours * 3600 * 1000
+    now_ms = 0
+    while now_ms < end_ms:
+        if now_ms >= next_sample_ms:
+            temps, fault = cook.readings()
+            samples += 1
+            for i in range(PROBES):
+                if targets[i] and noticed[i] is None and not fault & (1 << i) and temps[i] >= targets[i]:
+                    noticed[i] = now_ms
+            period = lib.sched_update(ctypes.byref(sched), (ctypes.c_int32 * PROBES)(*temps), target_arr, fault,
+                                      now_ms * 1000)
+            reasons[sched.reason] += 1
+            next_sample_ms = now_ms + period
+        now_ms += 1000
+        cook.step()
+        for i in range(1, PROBES):
+            if reached[i] is None and cook.meat[i - 1] >= targets[i] - 0.5:
+                reached[i] = now_ms
+
+    hours = args.hours
+    active_s = samples * (args.sample_ms + args.publish_ms) / 1000.0
+    idle_ma = args.idle_pm_ma if config.pm else args.idle_ma
+    sample_mas = samples * (args.sample_ms * args.active_ma + args.publish_ms * args.tx_ma) / 1000.0
+    idle_mas = (hours * 3600 - active_s) * idle_ma
+    delays = [(noticed[i] - reached[i]) / 1000.0 if reached[i] and noticed[i] else None for i in range(1, PROBES)]
+    return samples, reasons, delays, (sample_mas + idle_mas) / 3600.0, sample_mas / 3600.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--hours", type=int, default=14, help="length of the cook (default 14)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--period-ms", type=int, default=1000, help="CONFIG_METER_SAMPLE_PERIOD_MS (default 1000)")
+    parser.add_argument("--max-period-ms", type=int, default=10000,
+                        help="CONFIG_METER_SAMPLE_MAX_PERIOD_MS (default 10000)")
+    parser.add_argument("--near-c", type=int, default=5, help="CONFIG_METER_SAMPLE_NEAR_C (default 5)")
+    parser.add_argument("--spike", type=int, default=3, help="CONFIG_METER_SAMPLE_SPIKE_C_PER_MIN (default 3)")
+    parser.add_argument("--sample-ms", type=float, default=4.0, help="CPU time per sample incl. listeners (default 4)")
+    parser.add_argument("--publish-ms", type=float, default=1.5, help="radio time per published sample (default 1.5)")
+    parser.add_argument("--active-ma", type=float, default=45.0, help="current while sampling at 240 MHz (default 45)")
+    parser.add_argument("--tx-ma", type=float, default=190.0, help="current while transmitting (default 190)")
+    parser.add_argument("--idle-ma", type=float, default=38.0,
+                        help="average current between samples without power management (default 38)")
+    parser.add_argument("--idle-pm-ma", type=float, default=6.0,
+                        help="average current between samples with DFS, light sleep and modem sleep (default 6)")
+    args = parser.parse_args()
+
+    def config(max_period_ms, pm):
+        c = SchedConfig(args.period_ms, max_period_ms, args.near_c, args.spike, 30)
+        c.pm = pm
+        return c
+
+    scenarios = [
+        ("fixed rate", config(args.period_ms, False)),
+        ("fixed rate + PM", config(args.period_ms, True)),
+        ("adaptive + PM", config(args.max_period_ms, True)),
+    ]
+    with tempfile.TemporaryDirectory() as build_dir:
+        lib = load_sched(build_dir)
+        results = [(name, run(lib, c, args)) for name, c in scenarios]
+
+    print("%d h cook, %d-%d ms period\n" % (args.hours, args.period_ms, args.max_period_ms))
+    print("%-16s %8s %10s %10s  %s" % ("scenario", "samples", "mAh", "sampling", "target noticed after (s)"))
+    for name, (samples, reasons, delays, mah, sample_mah) in results:
+        late = " ".join("%5.0f" % d if d is not None else "    -" for d in delays)
+        print("%-16s %8d %10.1f %10.2f  %s" % (name, samples, mah, sample_mah, late))
+    base = results[0][1]
+    adaptive = results[-1][1]
+    print("\nadaptive sampling takes %.1f%% of the samples, the whole cook %.1f%% of the energy" % (
+        100.0 * adaptive[0] / base[0], 100.0 * adaptive[3] / base[3]))
+    print("periods chosen: " + ", ".join("%s %d" % (REASONS[i], n) for i, n in enumerate(adaptive[1]) if n))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
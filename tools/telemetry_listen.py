@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Listen for the thermometer's multicast telemetry and print every reading.
+
+The device sends one datagram per sample when CONFIG_METER_TELEMETRY_ENABLE is
+set. Layout (little-endian), temperatures in 0.1 degC:
+
+    u16 magic (0x544D) | u8 version | u8 probe_count | u32 seq | u32 uptime_ms
+    probe_count x (i16 temp | i16 target)
+"""
+
+import argparse
+import socket
+import struct
+
+MAGIC = 0x544D
+VERSION = 1
+HEADER = struct.Struct("<HBBII")
+PROBE = struct.Struct("<hh")
+
+
+def decode(datagram):
+    """Return (seq, uptime_ms, [(temp, target), ...]) or raise ValueError."""
+    if len(datagram) < HEADER.size:
+        raise ValueError("datagram too short")
+    magic, version, probe_count, seq, uptime_ms = HEADER.unpack_from(datagram)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("unknown magic/version %#x/%d" % (magic, version))
+    if len(datagram) < HEADER.size + probe_count * PROBE.size:
+        raise ValueError("truncated probe list")
+    probes = []
+    for i in range(probe_count):
+        temp, target = PROBE.unpack_from(datagram, HEADER.size + i * PROBE.size)
+        probes.append((temp / 10.0, target / 10.0))
+    return seq, uptime_ms, probes
+
+
+def open_socket(group, port, interface):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", port))
+    mreq = struct.pack("4s4s", socket.inet_aton(group), socket.inet_aton(interface))
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    return sock
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--group", default="239.255.77.77")
+    parser.add_argument("--port", type=int, default=5077)
+    parser.add_argument("--interface", default="0.0.0.0", help="local address to join the group on")
+    args = parser.parse_args()
+
+    sock = open_socket(args.group, args.port, args.interface)
+    last_seq = {}
+    while True:
+        datagram, (sender, _) = sock.recvfrom(512)
+        try:
+            seq, uptime_ms, probes = decode(datagram)
+        except ValueError as e:
+            print("%s: %s" % (sender, e))
+            continue
+        lost = seq - last_seq.get(sender, seq - 1) - 1
+        last_seq[sender] = seq
+        readings = "  ".join("%6.1f/%-6.1f" % probe for probe in probes)
+        print("%s seq=%-8d t=%-10d %s%s" % (sender, seq, uptime_ms, readings, "  (lost %d)" % lost if lost > 0 else ""))
+
+
+if __name__ == "__main__":
+    main()
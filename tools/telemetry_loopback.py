@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""Send telemetry from the firmware's encoder over loopback multicast and decode it.
+
+Builds main/telemetry/telemetry.c with the host C compiler, against small
+stand-ins for the ESP-IDF headers it includes, and drives telemetry_publish()
+through the listener it registers. The datagrams go to the multicast group on
+127.0.0.1 and are received and decoded with tools/telemetry_listen.py, so a
+change to the wire format on either side shows up here. Checked:
+
+  - every field round-trips, temperatures clamped to the i16 range
+  - sequence numbers arrive in order, a skipped one is seen as lost
+  - the datagram size matches what the listener expects for the probe count
+"""
+
+import argparse
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import telemetry_listen  # noqa: E402
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+MAIN = os.path.join(ROOT, "main")
+
+# Stand-ins for the headers telemetry.c and temperature.h include
+STUBS = {
+    "esp_err.h": r"""
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERROR_CHECK(x) ((void)(x))
+""",
+    "esp_log.h": r"""
+#pragma once
+#include <stdio.h>
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__)
+""",
+    "host.h": r"""
+#pragma once
+#include <string.h>
+/* newlib has it, older glibc does not */
+static inline size_t host_strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#define strlcpy host_strlcpy
+""",
+    "mdns.h": r"""
+#pragma once
+typedef struct { const char *key; const char *value; } mdns_txt_item_t;
+static inline int mdns_service_add(const char *a, const char *b, const char *c, int d, mdns_txt_item_t *e, int f) {
+    return 0;
+}
+""",
+    "lwip/sockets.h": r"""
+#pragma once
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+/* A device sends on its station interface, the host test on loopback */
+static inline int loopback_socket(int domain, int type, int protocol) {
+    int sock = socket(domain, type, protocol);
+    struct in_addr lo = {.s_addr = htonl(INADDR_LOOPBACK)};
+    unsigned char loop = 1;
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &lo, sizeof(lo));
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    return sock;
+}
+#define socket(domain, type, protocol) loopback_socket(domain, type, protocol)
+""",
+}
+
+DRIVER = r"""
+#include <stdio.h>
+#include "telemetry.h"
+
+static temperature_listener_t s_listener;
+
+esp_err_t temperature_add_listener(temperature_listener_t listener) {
+    s_listener = listener;
+    return ESP_OK;
+}
+
+int main(int argc, char **argv) {
+    telemetry_init();
+    if (s_listener == NULL) {
+        return 1;
+    }
+    /* One line per sample on stdin: seq uptime_ms temp target x probes */
+    temperature_snapshot_t snapshot = {0};
+    unsigned seq;
+    long long uptime_ms;
+    while (scanf("%u %lld", &seq, &uptime_ms) == 2) {
+        snapshot.seq = seq;
+        snapshot.timestamp_us = uptime_ms * 1000;
+        for (int i = 0; i < TEMPERATURE_PROBE_COUNT; i++) {
+            int temp, target;
+            if (scanf("%d %d", &temp, &target) != 2) {
+                return 1;
+            }
+            snapshot.temp[i] = temp;
+            snapshot.target[i] = target;
+        }
+        s_listener(&snapshot);
+    }
+    return 0;
+}
+"""
+
+
+def build(build_dir, group, port, cc):
+    for name, text in STUBS.items():
+        path = os.path.join(build_dir, name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as f:
+            f.write(text)
+    with open(os.path.join(build_dir, "sdkconfig.h"), "w") as f:
+        f.write('#pragma once\n#define CONFIG_METER_TELEMETRY_ENABLE 1\n#define CONFIG_METER_TELEMETRY_GROUP "%s"\n'
+                "#define CONFIG_METER_TELEMETRY_PORT %d\n#define CONFIG_METER_TELEMETRY_TTL 1\n"
+                "#define CONFIG_METER_SAMPLE_PERIOD_MS 1000\n" % (group, port))
+    driver = os.path.join(build_dir, "driver.c")
+    with open(driver, "w") as f:
+        f.write(DRIVER)
+    binary = os.path.join(build_dir, "telemetry_loopback")
+    includes = ["-I", build_dir] + sum([["-I", os.path.join(MAIN, d)] for d in ("telemetry", "temperature", "sched")],
+                                       [])
+    flags = ["-std=gnu17", "-Wall", "-Wno-format", "-include", "sdkconfig.h", "-include", "host.h"]
+    subprocess.check_call([cc] + flags + includes +
+                          ["-o", binary, driver, os.path.join(MAIN, "telemetry", "telemetry.c")])
+    return binary
+
+
+def samples(probe_count):
+    """Samples to send as (seq, uptime_ms, [(temp, target), ...]), seq 4 left out to look lost"""
+    out = []
+    for seq in (1, 2, 3, 5, 6):
+        probes = [(20 + seq * 3 + i, 70 + i if i % 2 else 0) for i in range(probe_count)]
+        out.append((seq, seq * 1000, probes))
+    # Out of the i16 range of 0.1 degC once scaled, the encoder clamps
+    out.append((7, 7000, [(4000, -4000)] + [(0, 0)] * (probe_count - 1)))
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--group", default="239.255.77.77")
+    parser.add_argument("--port", type=int, default=5077)
+    parser.add_argument("--timeout", type=float, default=2.0, help="seconds to wait for each datagram")
+    args = parser.parse_args()
+
+    cc = os.environ.get("CC", "cc")
+    probe_count = 4
+    with open(os.path.join(MAIN, "temperature", "temperature.h")) as f:
+        for line in f:
+            if line.startswith("#define TEMPERATURE_PROBE_COUNT"):
+                probe_count = int(line.split()[2])
+
+    sock = telemetry_listen.open_socket(args.group, args.port, "127.0.0.1")
+    sock.settimeout(args.timeout)
+    sent = samples(probe_count)
+    with tempfile.TemporaryDirectory() as build_dir:
+        binary = build(build_dir, args.group, args.port, cc)
+        lines = "".join("%d %d %s\n" % (seq, uptime, " ".join("%d %d" % p for p in probes))
+                        for seq, uptime, probes in sent)
+        subprocess.run([binary], input=lines, universal_newlines=True, check=True)
+
+    failures = 0
+    last_seq = None
+    for seq, uptime_ms, probes in sent:
+        try:
+            datagram, _ = sock.recvfrom(512)
+        except socket.timeout:
+            print("FAIL seq %d: nothing received" % seq)
+            return 1
+        got_seq, got_uptime, got_probes = telemetry_listen.decode(datagram)
+        expect = [(max(min(t * 10, 32767), -32768) / 10.0, max(min(g * 10, 32767), -32768) / 10.0) for t, g in probes]
+        lost = got_seq - last_seq - 1 if last_seq is not None else 0
+        last_seq = got_seq
+        ok = (got_seq, got_uptime, got_probes) == (seq, uptime_ms, expect) and len(datagram) == 12 + 4 * probe_count
+        print("%s seq=%d t=%d %s%s" % ("ok  " if ok else "FAIL", got_seq, got_uptime,
+                                       " ".join("%.1f/%.1f" % p for p in got_probes),
+                                       "  (lost %d)" % lost if lost > 0 else ""))
+        failures += not ok
+    if failures:
+        print("%d of %d datagrams did not decode to what was sent" % (failures, len(sent)))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Measure what TLS costs the thermometer's web server.
+
+Runs three tests against a device built with CONFIG_METER_HTTPS_ENABLE:
+
+  handshakes  N full handshakes (no session offered) and N resumed ones
+              (offering the ticket of the first), timed on this host
+  https       sequential GET requests over one kept-alive HTTPS connection
+  http        the same over plain HTTP, if --http-port answers (a second
+              device or a build without HTTPS)
+
+Afterwards the device's own handshake counters from /api/v1/system/metrics
+are printed, which time the handshakes without the network round trips.
+"""
+
+import argparse
+import http.client
+import json
+import socket
+import ssl
+import statistics
+import sys
+import time
+
+DEFAULT_PATH = "/api/v1/temp/current"
+
+
+def make_context(cafile):
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    # The device only speaks TLS 1.2, where tickets come with the handshake
+    ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+    if cafile:
+        ctx.load_verify_locations(cafile)
+        ctx.check_hostname = False
+    else:
+        ctx.check_hostname = False
+        ctx.verify_mode = ssl.CERT_NONE
+    return ctx
+
+
+def handshake(ctx, host, port, session=None):
+    """Return (seconds spent in the TLS handshake, session, reused)."""
+    with socket.create_connection((host, port), timeout=30) as sock:
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        start = time.perf_counter()
+        with ctx.wrap_socket(sock, server_hostname=host, session=session) as tls:
+            elapsed = time.perf_counter() - start
+            return elapsed, tls.session, tls.session_reused
+
+
+def bench_handshakes(ctx, host, port, count):
+    full = []
+    for _ in range(count):
+        elapsed, ticket, _ = handshake(ctx, host, port)
+        full.append(elapsed)
+
+    resumed = []
+    fallbacks = 0
+    for _ in range(count):
+        elapsed, new_ticket, reused = handshake(ctx, host, port, ticket)
+        if reused:
+            resumed.append(elapsed)
+        else:
+            fallbacks += 1
+        ticket = new_ticket or ticket
+    return full, resumed, fallbacks
+
+
+def bench_requests(conn, path, duration):
+    """Return (requests, seconds, latencies) for back-to-back GETs on one connection."""
+    latencies = []
+    start = time.perf_counter()
+    while time.perf_counter() - start < duration:
+        t0 = time.perf_counter()
+        conn.request("GET", path)
+        response = conn.getresponse()
+        response.read()
+        if response.status != 200:
+            raise RuntimeError("GET %s answered %d" % (path, response.status))
+        latencies.append(time.perf_counter() - t0)
+    return len(latencies), time.perf_counter() - start, latencies
+
+
+def describe(samples):
+    if not samples:
+        return "none"
+    ordered = sorted(samples)
+    p95 = ordered[min(len(ordered) - 1, int(len(ordered) * 0.95))]
+    return "n=%d median %.1f ms, p95 %.1f ms, max %.1f ms" % (
+        len(samples), statistics.median(samples) * 1e3, p95 * 1e3, ordered[-1] * 1e3)
+
+
+def report_requests(label, result):
+    count, seconds, latencies = result
+    print("%-6s %6.1f req/s  latency %s" % (label, count / seconds, describe(latencies)))
+    return count / seconds
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host", help="device address, e.g. dashboard.local")
+    parser.add_argument("--port", type=int, default=443, help="HTTPS port (default 443)")
+    parser.add_argument("--http-port", type=int, default=80,
+                        help="plain HTTP port to compare with, 0 to skip (default 80)")
+    parser.add_argument("--http-host", help="host serving plain HTTP, if not the same device")
+    parser.add_argument("--cafile", help="verify the device against this certificate, e.g. <cert dir>/servercert.pem")
+    parser.add_argument("-n", "--count", type=int, default=20, help="handshakes of each kind (default 20)")
+    parser.add_argument("-d", "--duration", type=float, default=10.0, help="seconds per request test (default 10)")
+    parser.add_argument("--path", default=DEFAULT_PATH, help="resource to request (default %s)" % DEFAULT_PATH)
+    args = parser.parse_args()
+
+    ctx = make_context(args.cafile)
+
+    full, resumed, fallbacks = bench_handshakes(ctx, args.host, args.port, args.count)
+    print("full handshake     %s" % describe(full))
+    print("resumed handshake  %s" % describe(resumed))
+    if fallbacks:
+        print("  %d resumption attempts fell back to a full handshake" % fallbacks)
+    if full and resumed:
+        print("  resumption is %.1fx faster" % (statistics.median(full) / statistics.median(resumed)))
+
+    conn = http.client.HTTPSConnection(args.host, args.port, context=ctx, timeout=30)
+    https_rate = report_requests("https", bench_requests(conn, args.path, args.duration))
+
+    if args.http_port:
+        http_host = args.http_host or args.host
+        try:
+            plain = http.client.HTTPConnection(http_host, args.http_port, timeout=5)
+            http_rate = report_requests("http", bench_requests(plain, args.path, args.duration))
+            print("  HTTPS sustains %.0f%% of the plain HTTP request rate" % (100.0 * https_rate / http_rate))
+        except (OSError, http.client.HTTPException, RuntimeError) as e:
+            print("http   skipped: %s" % e)
+
+    conn.request("GET", "/api/v1/system/metrics")
+    response = conn.getresponse()
+    body = response.read()
+    if response.status == 200:
+        tls = json.loads(body).get("tls")
+        if tls:
+            print("device: %s" % json.dumps(tls))
+    conn.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())